@@ -65,10 +65,76 @@ CREATE TABLE @extschema@.tb_action
     method              VARCHAR(4),
     static_parameters   JSONB,
     use_ssl             BOOLEAN NOT NULL DEFAULT FALSE,
-    CHECK( uri IS NOT NULL OR query IS NOT NULL ),
-    CHECK( ( method IS NULL OR method IN( 'PUT', 'POST', 'GET' ) ) )
+    body_format         VARCHAR(4) NOT NULL DEFAULT 'form',
+    body_compression    VARCHAR(4),
+    compress_min_size   INTEGER NOT NULL DEFAULT 1024,
+    response_policy     VARCHAR(8) NOT NULL DEFAULT 'head',
+    response_limit      INTEGER NOT NULL DEFAULT 4096,
+    connect_timeout_ms  INTEGER,
+    timeout_ms          INTEGER,
+    rate_limit_per_sec  NUMERIC,
+    burst               INTEGER,
+    idempotent          BOOLEAN NOT NULL DEFAULT FALSE,
+    hedge_percentile    INTEGER,
+    function            REGPROCEDURE,
+    CHECK( uri IS NOT NULL OR query IS NOT NULL OR function IS NOT NULL ),
+    CHECK( function IS NULL OR ( uri IS NULL AND query IS NULL ) ),
+    CHECK( ( method IS NULL OR method IN( 'PUT', 'POST', 'GET' ) ) ),
+    CHECK( body_format IN( 'form', 'json' ) ),
+    CHECK( body_format = 'form' OR COALESCE( method, 'GET' ) IN( 'PUT', 'POST' ) ),
+    CHECK( body_compression IS NULL OR ( body_compression IN( 'gzip', 'zstd' ) AND COALESCE( method, 'GET' ) IN( 'PUT', 'POST' ) ) ),
+    CHECK( compress_min_size >= 0 ),
+    CHECK( response_policy IN( 'discard', 'head', 'store' ) ),
+    CHECK( response_limit >= 0 ),
+    CHECK( connect_timeout_ms IS NULL OR connect_timeout_ms > 0 ),
+    CHECK( timeout_ms IS NULL OR timeout_ms > 0 ),
+    CHECK( rate_limit_per_sec IS NULL OR rate_limit_per_sec > 0 ),
+    CHECK( burst IS NULL OR burst > 0 ),
+    CHECK( hedge_percentile IS NULL OR ( idempotent AND uri IS NOT NULL AND hedge_percentile BETWEEN 50 AND 99 ) ),
+    CHECK( uri IS NULL OR uri !~ '^(unix|fifo|file)://' OR ( body_compression IS NULL AND hedge_percentile IS NULL ) )
 );
 
+COMMENT ON COLUMN @extschema@.tb_action.uri IS 'Endpoint of the action. http(s) URIs are called with method; unix://<socket>, fifo://<pipe> and file://<path> URIs are sent the merged parameters as a line of JSON';
+
+COMMENT ON COLUMN @extschema@.tb_action.body_format IS 'How URI call parameters are sent: form (URL-encoded key=value pairs) or json (a single application/json body, PUT / POST only)';
+COMMENT ON COLUMN @extschema@.tb_action.body_compression IS 'Content-Encoding used to compress PUT / POST bodies: gzip, zstd (when the daemon is built with zstd support) or NULL for none';
+COMMENT ON COLUMN @extschema@.tb_action.compress_min_size IS 'Bodies smaller than this many bytes are sent uncompressed';
+COMMENT ON COLUMN @extschema@.tb_action.response_policy IS 'Handling of URI call response bodies: discard (not buffered), head (first response_limit bytes kept for logging) or store (kept whole, failing the call if larger than response_limit)';
+COMMENT ON COLUMN @extschema@.tb_action.response_limit IS 'Response body byte limit for the head and store response policies';
+COMMENT ON COLUMN @extschema@.tb_action.connect_timeout_ms IS 'Milliseconds allowed to connect for URI calls. NULL uses the @extschema@.connect_timeout_ms setting';
+COMMENT ON COLUMN @extschema@.tb_action.timeout_ms IS 'Milliseconds allowed for the whole URI call, sent downstream as a deadline header. NULL uses the @extschema@.timeout_ms setting';
+COMMENT ON COLUMN @extschema@.tb_action.rate_limit_per_sec IS 'Maximum sustained rate at which this action is executed, shared by all daemons. NULL for no limit';
+COMMENT ON COLUMN @extschema@.tb_action.burst IS 'Number of executions allowed back to back before rate_limit_per_sec applies. NULL allows one';
+COMMENT ON COLUMN @extschema@.tb_action.idempotent IS 'Indicates that the URI call can safely be sent more than once';
+COMMENT ON COLUMN @extschema@.tb_action.hedge_percentile IS 'For idempotent actions, a duplicate request is sent when a call is slower than this percentile of the host''s recent latency, and the first response is used. NULL disables hedging';
+COMMENT ON COLUMN @extschema@.tb_action.function IS 'Function called with the work item''s parameters, matched to its input arguments by name. Arguments without a matching parameter are passed NULL';
+
+CREATE TABLE @extschema@.tb_remote_host
+(
+    host                VARCHAR PRIMARY KEY,
+    rate_limit_per_sec  NUMERIC NOT NULL,
+    burst               INTEGER,
+    CHECK( host = lower( host ) ),
+    CHECK( rate_limit_per_sec > 0 ),
+    CHECK( burst IS NULL OR burst > 0 )
+);
+
+COMMENT ON TABLE @extschema@.tb_remote_host IS 'Rate limits applied to all URI actions calling a host, in addition to any per-action limit';
+COMMENT ON COLUMN @extschema@.tb_remote_host.host IS 'Host name as it appears in action URIs, in lower case';
+COMMENT ON COLUMN @extschema@.tb_remote_host.rate_limit_per_sec IS 'Maximum sustained rate of calls to this host, shared by all daemons';
+COMMENT ON COLUMN @extschema@.tb_remote_host.burst IS 'Number of calls allowed back to back before rate_limit_per_sec applies. NULL allows one';
+
+CREATE TABLE @extschema@.tb_rate_bucket
+(
+    bucket      VARCHAR PRIMARY KEY,
+    tokens      DOUBLE PRECISION NOT NULL,
+    refilled    TIMESTAMP NOT NULL DEFAULT clock_timestamp()
+);
+
+COMMENT ON TABLE @extschema@.tb_rate_bucket IS 'Token bucket state for action and host rate limits, maintained by fn_take_rate_tokens';
+COMMENT ON COLUMN @extschema@.tb_rate_bucket.bucket IS 'action:<action> or host:<host>';
+COMMENT ON COLUMN @extschema@.tb_rate_bucket.tokens IS 'Tokens available as of refilled';
+
 CREATE SEQUENCE @extschema@.sq_pk_event_table_work_item;
 CREATE TABLE @extschema@.tb_event_table_work_item
 (
@@ -83,6 +149,7 @@ CREATE TABLE @extschema@.tb_event_table_work_item
     when_function           VARCHAR DEFAULT current_setting( '@extschema@.default_when_function', TRUE )::VARCHAR,
     op                      CHAR(1)[],
     execute_asynchronously  BOOLEAN DEFAULT COALESCE( current_setting( '@extschema@.execute_asynchronously', TRUE )::BOOLEAN, TRUE ),
+    when_condition          TEXT,
     CHECK( ( op <@ ARRAY[ 'I','U','D' ]::CHAR(1)[] ) )
 );
 
@@ -96,14 +163,15 @@ CREATE UNIQUE INDEX ix_source_action_target_unique ON @extschema@.tb_event_table
 COMMENT ON TABLE @extschema@.tb_event_table_work_item IS 'A list of actions that should occur for any given event table';
 COMMENT ON COLUMN @extschema@.tb_event_table_work_item.source_event_table IS 'Indicates the table that can trigger this work item';
 COMMENT ON COLUMN @extschema@.tb_event_table_work_item.target_event_table IS 'Indicates the target of this work items action. Not necessary but useful for any user interface built around this';
-COMMENT ON COLUMN @extschema@.tb_event_table_work_item.source_column_name IS 'Indicated the column of the source table this event if firing on. This is not used for selectively firing update triggers but to help prevent the user from implementing identical/similar events';
+COMMENT ON COLUMN @extschema@.tb_event_table_work_item.source_column_name IS 'Indicates the column of the source table this event is firing on. UPDATE triggers are generated as UPDATE OF the subscribed columns, and the work item only fires when this column changes. NULL subscribes to all columns';
 COMMENT ON COLUMN @extschema@.tb_event_table_work_item.action IS 'Foreign key to tb_action - indicates what this work item generates parameters for';
 COMMENT ON COLUMN @extschema@.tb_event_table_work_item.description IS 'User-facing description for that this work item is / does';
 COMMENT ON COLUMN @extschema@.tb_event_table_work_item.transaction_label IS 'Label for what the action is performing. Used in Cyanaudit integration';
 COMMENT ON COLUMN @extschema@.tb_event_table_work_item.work_item_query IS 'Generates a list of parameters for the action. This query has named bind point for the columns in this table. Query should generate JSONB aliased as parameters';
 COMMENT ON COLUMN @extschema@.tb_event_table_work_item.when_function IS 'Filters events entering tb_event_queue. Example prototype is fn_dummy_when_function. Function should return BOOLEAN';
-COMMENT ON COLUMN @extschema@.tb_event_table_work_item.op IS 'Indicates what DML operation this work item applies: U - Update, I - Insert, D - Delete.';
+COMMENT ON COLUMN @extschema@.tb_event_table_work_item.op IS 'Indicates what DML operation this work item applies: U - Update, I - Insert, D - Delete. The event triggers on the source table only fire for the union of subscribed operations';
 COMMENT ON COLUMN @extschema@.tb_event_table_work_item.execute_asynchronously IS 'Determines what mode of execution this work item will be ran under.';
+COMMENT ON COLUMN @extschema@.tb_event_table_work_item.when_condition IS 'Optional row predicate referencing NEW.column and OLD.column (for example NEW.status <> OLD.status). Compiled into the WHEN clause of the generated event trigger so filtered rows never reach fn_enqueue_event';
 
 DO
  $_$
@@ -133,6 +201,9 @@ ALTER TABLE @extschema@.tb_event_queue
     ADD COLUMN old JSONB,
     ADD COLUMN new JSONB,
     ADD COLUMN session_values JSONB,
+    ADD COLUMN attempts INTEGER NOT NULL DEFAULT 0,
+    ADD COLUMN last_error TEXT,
+    ADD COLUMN next_attempt_at TIMESTAMP,
     ADD CONSTRAINT op_check CHECK ( ( op IN( 'D', 'U', 'I' ) ) );
 
 COMMENT ON TABLE @extschema@.tb_event_queue IS 'Queue for events arriving from tb_event_tables. Contents are copied from their corresponding event_table_work_item entry.';
@@ -141,9 +212,12 @@ COMMENT ON COLUMN @extschema@.tb_event_queue.uid IS 'Stores the optional session
 COMMENT ON COLUMN @extschema@.tb_event_queue.recorded IS 'timestamp of when the event was triggered';
 COMMENT ON COLUMN @extschema@.tb_event_queue.pk_value IS 'The primary key of the source_table whose modification caused this event to fire';
 COMMENT ON COLUMN @extschema@.tb_event_queue.op IS 'The DML operation that caused this event to fire, either I, U, or D';
-COMMENT ON COLUMN @extschema@.tb_event_queue.old IS 'Copy of the plpgsql OLD psuedorecord';
+COMMENT ON COLUMN @extschema@.tb_event_queue.old IS 'Copy of the plpgsql OLD psuedorecord. When @extschema@.compact_update_payload is set, UPDATE events only store the columns that changed';
 COMMENT ON COLUMN @extschema@.tb_event_queue.new IS 'Copy of the plpgsql new psuedorecord';
 COMMENT ON COLUMN @extschema@.tb_event_queue.session_values IS 'Copy of the comma-delimited session GUCs specified in @extschema@.session_gucs';
+COMMENT ON COLUMN @extschema@.tb_event_queue.attempts IS 'Number of failed attempts to process this event';
+COMMENT ON COLUMN @extschema@.tb_event_queue.last_error IS 'Error from the most recent failed attempt';
+COMMENT ON COLUMN @extschema@.tb_event_queue.next_attempt_at IS 'The event is not processed before this time. NULL when not yet attempted';
 
 DO
  $_$
@@ -171,7 +245,13 @@ ALTER TABLE @extschema@.tb_work_queue
     ADD COLUMN recorded TIMESTAMP NOT NULL DEFAULT clock_timestamp(),
     ADD COLUMN transaction_label VARCHAR,
     ADD COLUMN execute_asynchronously  BOOLEAN DEFAULT COALESCE( current_setting( '@extschema@.execute_asynchronously', TRUE )::BOOLEAN, TRUE ),
-    ADD COLUMN session_values JSONB;
+    ADD COLUMN session_values JSONB,
+    ADD COLUMN attempts INTEGER NOT NULL DEFAULT 0,
+    ADD COLUMN last_error TEXT,
+    ADD COLUMN next_attempt_at TIMESTAMP,
+    ADD COLUMN leased_until TIMESTAMP,
+    ADD COLUMN leased_by VARCHAR,
+    ADD COLUMN host VARCHAR;
 
 COMMENT ON TABLE @extschema@.tb_work_queue IS 'Queue for work_item_query results. Remaining contents copied from the corresponding event_queue entry';
 COMMENT ON COLUMN @extschema@.tb_work_queue.parameters IS 'Parameters returned by work_item_query';
@@ -181,6 +261,33 @@ COMMENT ON COLUMN @extschema@.tb_work_queue.recorded IS 'Recorded timestamp from
 COMMENT ON COLUMN @extschema@.tb_work_queue.transaction_label IS 'Label for transaction in Cyanaudit, if installed';
 COMMENT ON COLUMN @extschema@.tb_work_queue.execute_asynchronously IS 'Indicates how this action should be executed';
 COMMENT ON COLUMN @extschema@.tb_work_queue.session_values IS 'Copy of the session values from the event queue';
+COMMENT ON COLUMN @extschema@.tb_work_queue.attempts IS 'Number of failed attempts to execute this action';
+COMMENT ON COLUMN @extschema@.tb_work_queue.last_error IS 'Error from the most recent failed attempt';
+COMMENT ON COLUMN @extschema@.tb_work_queue.next_attempt_at IS 'The action is not executed before this time. NULL when not yet attempted';
+COMMENT ON COLUMN @extschema@.tb_work_queue.leased_until IS 'A remote call for this item is in progress until this time. Expired leases are reclaimed by the next dequeue';
+COMMENT ON COLUMN @extschema@.tb_work_queue.leased_by IS 'host:pid of the event_manager process holding the lease';
+COMMENT ON COLUMN @extschema@.tb_work_queue.host IS 'Lower case host of the action URI, set on insert by fn_set_work_queue_host. NULL for query, function and local sink actions';
+
+-- Claims walk one host at a time, newest item first, see fn_claim_work_queue_items
+CREATE INDEX ix_work_queue_host_recorded ON @extschema@.tb_work_queue( COALESCE( host, '' ), recorded DESC );
+
+CREATE SEQUENCE @extschema@.sq_pk_dead_letter;
+CREATE TABLE @extschema@.tb_dead_letter
+(
+    dead_letter INTEGER PRIMARY KEY DEFAULT nextval('@extschema@.sq_pk_dead_letter'),
+    queue       VARCHAR(5) NOT NULL,
+    item        JSONB NOT NULL,
+    attempts    INTEGER NOT NULL,
+    last_error  TEXT,
+    failed      TIMESTAMP NOT NULL DEFAULT clock_timestamp(),
+    CHECK( queue IN( 'event', 'work' ) )
+);
+
+COMMENT ON TABLE @extschema@.tb_dead_letter IS 'Queue items that failed @extschema@.retry_max_attempts times, moved here by fn_schedule_retry';
+COMMENT ON COLUMN @extschema@.tb_dead_letter.queue IS 'Queue the item came from: event (tb_event_queue) or work (tb_work_queue)';
+COMMENT ON COLUMN @extschema@.tb_dead_letter.item IS 'The queue row, as JSONB';
+COMMENT ON COLUMN @extschema@.tb_dead_letter.attempts IS 'Number of failed attempts made';
+COMMENT ON COLUMN @extschema@.tb_dead_letter.last_error IS 'Error from the final attempt';
 
 CREATE TABLE @extschema@.tb_setting
 (
@@ -236,7 +343,31 @@ INSERT INTO @extschema@.tb_setting
             ( '@extschema@.get_uid_function', 'NULL' ),
             ( '@extschema@.default_when_function', '@extschema@.fn_dummy_when_function' ),
             ( '@extschema@.session_gucs', '' ),
-            ( '@extschema@.base_url', 'localhost' );
+            ( '@extschema@.base_url', 'localhost' ),
+            ( '@extschema@.compact_update_payload', 'f' ),
+            ( '@extschema@.dns_cache_timeout', '60' ),
+            ( '@extschema@.ssl_session_reuse', 't' ),
+            ( '@extschema@.connect_timeout_ms', '10000' ),
+            ( '@extschema@.timeout_ms', '30000' ),
+            ( '@extschema@.low_speed_limit', '1' ),
+            ( '@extschema@.low_speed_time', '30' ),
+            ( '@extschema@.breaker_failure_rate', '0.5' ),
+            ( '@extschema@.breaker_min_requests', '5' ),
+            ( '@extschema@.breaker_window_ms', '60000' ),
+            ( '@extschema@.breaker_open_ms', '30000' ),
+            ( '@extschema@.breaker_slow_call_ms', '10000' ),
+            ( '@extschema@.concurrency_max', '16' ),
+            ( '@extschema@.concurrency_latency_tolerance', '2.0' ),
+            ( '@extschema@.concurrency_backoff', '0.5' ),
+            ( '@extschema@.max_host_share', '0.5' ),
+            ( '@extschema@.hedge_budget_percent', '5' ),
+            ( '@extschema@.retry_max_attempts', '10' ),
+            ( '@extschema@.retry_base_ms', '1000' ),
+            ( '@extschema@.retry_max_ms', '3600000' ),
+            ( '@extschema@.lease_grace_ms', '30000' ),
+            ( '@extschema@.spool_batch_size', '100' ),
+            ( '@extschema@.sink_rotate_bytes', '104857600' ),
+            ( '@extschema@.fail_on_http_error', 'f' );
 
 CREATE SEQUENCE @extschema@.sq_pk_event_table_work_item_instance;
 CREATE TABLE @extschema@.tb_event_table_work_item_instance
@@ -327,37 +458,81 @@ CREATE TRIGGER tr_event_table_catalog_check
     AFTER INSERT OR UPDATE ON @extschema@.tb_event_table
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_catalog_check();
 
+CREATE OR REPLACE FUNCTION @extschema@.fn_get_session_state
+(
+    OUT uid             INTEGER,
+    OUT session_values  JSONB
+)
+RETURNS RECORD AS
+ $_$
+DECLARE
+    my_cache_key    TEXT;
+BEGIN
+    -- Evaluated once per statement and kept in transaction-local GUCs instead of re-running them
+    -- for every captured row. A set_config() made while the statement runs is not seen until the next one
+    my_cache_key := txid_current()::TEXT || '/' || statement_timestamp()::TEXT;
+
+    IF( current_setting( '@extschema@.session_state_key', TRUE ) IS NOT DISTINCT FROM my_cache_key ) THEN
+        uid            := NULLIF( current_setting( '@extschema@.session_state_uid', TRUE ), '' )::INTEGER;
+        session_values := NULLIF( current_setting( '@extschema@.session_state_values', TRUE ), '' )::JSONB;
+        RETURN;
+    END IF;
+
+    EXECUTE 'SELECT ' || COALESCE( current_setting( '@extschema@.get_uid_function', TRUE ),
+                        'NULL'
+                    ) || '::INTEGER'
+       INTO uid;
+
+    IF( length( current_setting( '@extschema@.session_gucs', TRUE ) ) > 0 ) THEN
+        SELECT jsonb_object(
+                   array_agg( x ORDER BY x ),
+                   array_agg( current_setting( x, TRUE ) ORDER BY x )
+               )
+          INTO session_values
+          FROM regexp_split_to_table(
+                   current_setting( '@extschema@.session_gucs', TRUE ),
+                   ','
+               ) x;
+    END IF;
+
+    PERFORM set_config( '@extschema@.session_state_uid', COALESCE( uid::TEXT, '' ), TRUE ),
+            set_config( '@extschema@.session_state_values', COALESCE( session_values::TEXT, '' ), TRUE ),
+            set_config( '@extschema@.session_state_key', my_cache_key, TRUE );
+
+    IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
+        RAISE DEBUG '@extschema@: cached session state for %', my_cache_key;
+    END IF;
+
+    RETURN;
+END
+ $_$
+    LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
+
 CREATE OR REPLACE FUNCTION @extschema@.fn_enqueue_event()
 RETURNS TRIGGER AS
  $_$
 DECLARE
     my_pk_value                 INTEGER;
     my_when_function            VARCHAR;
+    my_when_condition           TEXT;
+    my_source_column_name       VARCHAR;
+    my_condition_checked        BOOLEAN;
     my_when_result              BOOLEAN;
     my_record                   RECORD;
     new_record                  JSONB;
     old_record                  JSONB;
+    my_records_ready            BOOLEAN := FALSE;
     my_uid                      INTEGER;
     my_event_table_work_item    INTEGER;
     my_guc_values               JSONB;
+    my_old_payload              JSONB;
+    my_old_payload_ready        BOOLEAN := FALSE;
 BEGIN
-    IF( TG_OP = 'INSERT' ) THEN
-        my_record := NEW;
-        new_record := to_jsonb( NEW );
-        old_record := NULL;
-    ELSIF( TG_OP = 'UPDATE' ) THEN
-        IF( NEW::VARCHAR IS DISTINCT FROM OLD::VARCHAR ) THEN
-            my_record := NEW;
-            new_record := to_jsonb( NEW );
-            old_record := to_jsonb( OLD );
-        ELSE
-            -- Reject dubious UPDATE
-            RETURN NEW;
-        END IF;
-    ELSE
+    -- Dubious UPDATEs are rejected by the trigger's WHEN clause
+    IF( TG_OP = 'DELETE' ) THEN
         my_record := OLD;
-        old_record := to_jsonb( OLD );
-        new_record := NULL;
+    ELSE
+        my_record := NEW;
     END IF;
 
     IF( TG_ARGV[0] IS NULL ) THEN
@@ -365,35 +540,31 @@ BEGIN
         RETURN my_record;
     END IF;
 
+    -- The trigger's WHEN clause already evaluated the only work item's when_condition
+    my_condition_checked := COALESCE( TG_ARGV[1]::BOOLEAN, FALSE );
+
     EXECUTE 'SELECT $1.' || TG_ARGV[0]::VARCHAR
        INTO my_pk_value
       USING my_record;
 
-    EXECUTE 'SELECT ' || COALESCE( current_setting( '@extschema@.get_uid_function', TRUE ),
-                        'NULL'
-                    ) || '::INTEGER'
-       INTO my_uid;
-
-    IF( length( current_setting( '@extschema@.session_gucs', TRUE ) ) > 0 ) THEN
-        SELECT jsonb_object(
-                   array_agg( x ORDER BY x ),
-                   array_agg( current_setting( x, TRUE ) ORDER BY x )
-               )
-          INTO my_guc_values
-          FROM regexp_split_to_table(
-                   current_setting( '@extschema@.session_gucs', TRUE ),
-                   ','
-               ) x;
-    END IF;
+    SELECT ss.uid,
+           ss.session_values
+      INTO my_uid,
+           my_guc_values
+      FROM @extschema@.fn_get_session_state() ss;
 
     IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
         RAISE DEBUG '@extschema@: event_enqueue - uid %', my_uid;
     END IF;
 
     FOR my_when_function,
+        my_when_condition,
+        my_source_column_name,
         my_event_table_work_item
                         IN(
                             SELECT etwi.when_function,
+                                   etwi.when_condition,
+                                   etwi.source_column_name,
                                    etwi.event_table_work_item
                               FROM @extschema@.tb_event_table_work_item etwi
                         INNER JOIN @extschema@.tb_event_table et
@@ -405,16 +576,83 @@ BEGIN
                                      OR etwi.op IS NULL
                                    )
                          ) LOOP
-        EXECUTE 'SELECT ' || my_when_function
-             || '( $1::INTEGER, $2::INTEGER, $3::CHAR(1), $4::JSONB, $5::JSONB )::BOOLEAN'
-           INTO my_when_result
-          USING my_event_table_work_item,
-                my_pk_value,
-                substr( TG_OP, 1, 1 ), -- Get either 'U', 'I', or 'D'
-                new_record,
-                old_record;
+        IF( my_when_condition IS NOT NULL AND my_condition_checked IS FALSE ) THEN
+            -- Several work items share this trigger, evaluate this item's own predicate
+            IF( TG_OP = 'UPDATE' ) THEN
+                EXECUTE 'SELECT ( '
+                     || regexp_replace(
+                            regexp_replace( my_when_condition, '\mNEW\.', '$1.', 'gi' ),
+                            '\mOLD\.',
+                            '$2.',
+                            'gi'
+                        )
+                     || ' )::BOOLEAN'
+                   INTO my_when_result
+                  USING NEW,
+                        OLD;
+            ELSE
+                EXECUTE 'SELECT ( '
+                     || regexp_replace( my_when_condition, '\m(NEW|OLD)\.', '$1.', 'gi' )
+                     || ' )::BOOLEAN'
+                   INTO my_when_result
+                  USING my_record;
+            END IF;
+
+            CONTINUE WHEN my_when_result IS NOT TRUE;
+        END IF;
+
+        IF( my_records_ready IS FALSE ) THEN
+            IF( TG_OP IN( 'INSERT', 'UPDATE' ) ) THEN
+                new_record := to_jsonb( NEW );
+            END IF;
+
+            IF( TG_OP IN( 'UPDATE', 'DELETE' ) ) THEN
+                old_record := to_jsonb( OLD );
+            END IF;
+
+            my_records_ready := TRUE;
+        END IF;
+
+        CONTINUE WHEN TG_OP = 'UPDATE'
+                  AND my_source_column_name IS NOT NULL
+                  AND new_record->my_source_column_name IS NOT DISTINCT FROM old_record->my_source_column_name;
+
+        IF(
+                my_when_function IS NULL
+             OR my_when_function IN( '@extschema@.fn_dummy_when_function', 'fn_dummy_when_function' )
+          ) THEN
+            -- The default when function always passes, skip the dynamic call
+            my_when_result := TRUE;
+        ELSE
+            EXECUTE 'SELECT ' || my_when_function
+                 || '( $1::INTEGER, $2::INTEGER, $3::CHAR(1), $4::JSONB, $5::JSONB )::BOOLEAN'
+               INTO my_when_result
+              USING my_event_table_work_item,
+                    my_pk_value,
+                    substr( TG_OP, 1, 1 ), -- Get either 'U', 'I', or 'D'
+                    new_record,
+                    old_record;
+        END IF;
 
         IF( my_when_result IS TRUE ) THEN
+            IF( my_old_payload_ready IS FALSE ) THEN
+                IF(
+                        TG_OP = 'UPDATE'
+                    AND COALESCE( current_setting( '@extschema@.compact_update_payload', TRUE )::BOOLEAN, FALSE ) IS TRUE
+                  ) THEN
+                    -- Compact mode only stores the OLD values that changed, the
+                    -- unchanged columns are read back from NEW by the consumers
+                    SELECT COALESCE( jsonb_object_agg( o.key, o.value ), '{}'::JSONB )
+                      INTO my_old_payload
+                      FROM jsonb_each( old_record ) o
+                     WHERE new_record->o.key IS DISTINCT FROM o.value;
+                ELSE
+                    my_old_payload := old_record;
+                END IF;
+
+                my_old_payload_ready := TRUE;
+            END IF;
+
             INSERT INTO @extschema@.tb_event_queue
                         (
                             event_table_work_item,
@@ -433,7 +671,7 @@ BEGIN
                             now(),
                             my_pk_value,
                             substr( TG_OP, 1, 1 ),
-                            old_record,
+                            my_old_payload,
                             new_record,
                             my_guc_values
                         );
@@ -507,12 +745,39 @@ CREATE TRIGGER tr_no_ddl_check
     BEFORE INSERT OR UPDATE ON @extschema@.tb_event_table_work_item
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_no_ddl_check( 'work_item_query' );
 
-CREATE FUNCTION @extschema@.fn_new_event_trigger()
-RETURNS TRIGGER AS
+CREATE FUNCTION @extschema@.fn_rebuild_event_triggers
+(
+    in_event_table  INTEGER
+)
+RETURNS VOID AS
  $_$
 DECLARE
-    my_pk_column    VARCHAR;
+    my_schema_name      VARCHAR;
+    my_table_name       VARCHAR;
+    my_no_trigger       BOOLEAN;
+    my_pk_column        VARCHAR;
+    my_ops              CHAR(1)[];
+    my_op               CHAR(1);
+    my_event            VARCHAR;
+    my_all_columns      BOOLEAN;
+    my_columns          VARCHAR;
+    my_all_conditions   BOOLEAN;
+    my_when_clause      TEXT;
+    my_item_count       INTEGER;
 BEGIN
+    SELECT et.schema_name,
+           et.table_name,
+           et.no_trigger
+      INTO my_schema_name,
+           my_table_name,
+           my_no_trigger
+      FROM @extschema@.tb_event_table et
+     WHERE et.event_table = in_event_table;
+
+    IF NOT FOUND THEN
+        RETURN;
+    END IF;
+
     SELECT a.attname::VARCHAR
       INTO my_pk_column
       FROM pg_class c
@@ -524,30 +789,117 @@ INNER JOIN pg_constraint cn
         ON cn.conrelid = c.oid
        AND cn.contype = 'p'
        AND cn.conkey[1] = a.attnum
-     WHERE c.relname::VARCHAR = NEW.table_name
-       AND n.nspname::VARCHAR = NEW.schema_name;
+     WHERE c.relname::VARCHAR = my_table_name
+       AND n.nspname::VARCHAR = my_schema_name;
 
     IF( my_pk_column IS NULL ) THEN
         RAISE EXCEPTION 'Target table, %.% needs to have a surrogate integer primary key!',
-            NEW.schema_name,
-            NEW.table_name;
+            my_schema_name,
+            my_table_name;
     END IF;
 
-    IF( NEW.no_trigger IS TRUE ) THEN
-        RETURN NEW;
+    FOR my_event IN( SELECT unnest( ARRAY[ 'insert', 'update', 'delete' ]::VARCHAR[] ) ) LOOP
+        EXECUTE format(
+                    'DROP TRIGGER IF EXISTS %I ON %I.%I',
+                    'tr_event_enqueue_' || my_event,
+                    my_schema_name,
+                    my_table_name
+                );
+    END LOOP;
+
+    IF( my_no_trigger IS TRUE ) THEN
+        RETURN;
     END IF;
 
-    EXECUTE format(
-                'CREATE TRIGGER tr_event_enqueue '
-             || '    AFTER INSERT OR UPDATE OR DELETE ON %I.%I '
-             || '    FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_enqueue_event( %L );',
-                NEW.schema_name,
-                NEW.table_name,
-                my_pk_column
-            );
+    -- Only subscribe to the DML the work items are interested in, a NULL op means all of them
+    SELECT array_agg( DISTINCT o.op )
+      INTO my_ops
+      FROM @extschema@.tb_event_table_work_item etwi,
+           unnest( COALESCE( etwi.op, ARRAY[ 'I','U','D' ]::CHAR(1)[] ) ) o( op )
+     WHERE etwi.source_event_table = in_event_table;
+
+    IF( my_ops IS NULL ) THEN
+        IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
+            RAISE DEBUG '@extschema@: no work items subscribed to %.%', my_schema_name, my_table_name;
+        END IF;
+
+        RETURN;
+    END IF;
+
+    FOR my_op, my_event IN(
+                              SELECT o.op,
+                                     CASE o.op
+                                          WHEN 'I' THEN 'INSERT'
+                                          WHEN 'U' THEN 'UPDATE'
+                                          ELSE 'DELETE'
+                                           END
+                                FROM unnest( my_ops ) o( op )
+                          ) LOOP
+        -- Any UPDATE work item without a source column needs every column
+        SELECT bool_or( etwi.source_column_name IS NULL ),
+               string_agg( DISTINCT quote_ident( etwi.source_column_name ), ', ' ),
+               bool_and( etwi.when_condition IS NOT NULL ),
+               string_agg( '( ' || etwi.when_condition || ' )', ' OR ' ),
+               COUNT(*)
+          INTO my_all_columns,
+               my_columns,
+               my_all_conditions,
+               my_when_clause,
+               my_item_count
+          FROM @extschema@.tb_event_table_work_item etwi
+         WHERE etwi.source_event_table = in_event_table
+           AND (
+                    etwi.op IS NULL
+                 OR my_op = ANY( etwi.op )
+               );
+
+        -- Conditions can only be folded in when every work item for this op has one
+        IF( my_all_conditions IS NOT TRUE ) THEN
+            my_when_clause := NULL;
+        END IF;
+
+        IF( my_op = 'U' ) THEN
+            my_when_clause := 'OLD.* IS DISTINCT FROM NEW.*'
+                           || COALESCE( ' AND ( ' || my_when_clause || ' )', '' );
+        END IF;
+
+        EXECUTE format(
+                    'CREATE TRIGGER %I '
+                 || '    AFTER %s %s ON %I.%I '
+                 || '    FOR EACH ROW %s '
+                 || '    EXECUTE PROCEDURE @extschema@.fn_enqueue_event( %L, %L );',
+                    'tr_event_enqueue_' || lower( my_event ),
+                    my_event,
+                    CASE WHEN my_op = 'U' AND my_all_columns IS NOT TRUE
+                         THEN 'OF ' || my_columns
+                         ELSE ''
+                          END,
+                    my_schema_name,
+                    my_table_name,
+                    COALESCE( 'WHEN ( ' || my_when_clause || ' )', '' ),
+                    my_pk_column,
+                    ( my_all_conditions IS TRUE AND my_item_count = 1 )
+                );
+    END LOOP;
+
+    IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
+        RAISE DEBUG '@extschema@: rebuilt triggers on %.% for ops %', my_schema_name, my_table_name, my_ops;
+    END IF;
+
+    RETURN;
+END
+ $_$
+    LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
+
+CREATE FUNCTION @extschema@.fn_new_event_trigger()
+RETURNS TRIGGER AS
+ $_$
+BEGIN
+    -- Triggers are created once work items subscribe to the table
+    PERFORM @extschema@.fn_rebuild_event_triggers( NEW.event_table );
 
     IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
-        RAISE DEBUG '@extschema@: created trigger on %.%', NEW.schema_name, NEW.column_name;
+        RAISE DEBUG '@extschema@: registered event table %.%', NEW.schema_name, NEW.table_name;
     END IF;
 
     RETURN NEW;
@@ -556,23 +908,27 @@ END
     LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
 
 CREATE TRIGGER tr_new_enqueue_trigger
-    AFTER INSERT ON @extschema@.tb_event_table
+    AFTER INSERT OR UPDATE OF no_trigger ON @extschema@.tb_event_table
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_new_event_trigger();
 
 CREATE FUNCTION @extschema@.fn_remove_event_trigger()
 RETURNS TRIGGER AS
  $_$
+DECLARE
+    my_event    VARCHAR;
 BEGIN
     IF( OLD.no_trigger IS TRUE ) THEN
         RETURN OLD;
     END IF;
 
-    EXECUTE format(
-                'DROP TRIGGER tr_event_enqueue '
-             || ' ON %I.%I',
-                OLD.schema_name,
-                OLD.table_name
-            );
+    FOR my_event IN( SELECT unnest( ARRAY[ 'insert', 'update', 'delete' ]::VARCHAR[] ) ) LOOP
+        EXECUTE format(
+                    'DROP TRIGGER IF EXISTS %I ON %I.%I',
+                    'tr_event_enqueue_' || my_event,
+                    OLD.schema_name,
+                    OLD.table_name
+                );
+    END LOOP;
 
     IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
         RAISE DEBUG '@extschema@: dropped event trigger on %.%', OLD.schema_name, OLD.table_name;
@@ -587,6 +943,43 @@ CREATE TRIGGER tr_remove_enqueue_trigger
     AFTER DELETE ON @extschema@.tb_event_table
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_remove_event_trigger();
 
+CREATE FUNCTION @extschema@.fn_work_item_rebuild_event_triggers()
+RETURNS TRIGGER AS
+ $_$
+BEGIN
+    IF( TG_OP IN( 'UPDATE', 'DELETE' ) ) THEN
+        PERFORM @extschema@.fn_rebuild_event_triggers( OLD.source_event_table );
+    END IF;
+
+    IF(
+            TG_OP = 'INSERT'
+        OR (
+                TG_OP = 'UPDATE'
+            AND NEW.source_event_table IS DISTINCT FROM OLD.source_event_table
+           )
+      ) THEN
+        PERFORM @extschema@.fn_rebuild_event_triggers( NEW.source_event_table );
+    END IF;
+
+    RETURN NULL;
+END
+ $_$
+    LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
+
+CREATE TRIGGER tr_work_item_rebuild_event_triggers
+    AFTER INSERT OR UPDATE OF source_event_table, source_column_name, op, when_condition OR DELETE ON @extschema@.tb_event_table_work_item
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_work_item_rebuild_event_triggers();
+
+CREATE OR REPLACE FUNCTION @extschema@.fn_bind_query
+(
+    in_query        TEXT,
+    in_parameters   JSONB[],
+    in_prefixes     TEXT[] DEFAULT '{}'::TEXT[]
+)
+RETURNS TEXT
+    AS '$libdir/event_manager_bind', 'fn_bind_query'
+    LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
 CREATE OR REPLACE FUNCTION @extschema@.fn_handle_new_event_queue_item()
 RETURNS TRIGGER AS
   $_$
@@ -597,8 +990,6 @@ DECLARE
     my_uid          INTEGER;
     my_action       INTEGER;
     my_transaction_label    VARCHAR;
-    my_key          VARCHAR;
-    my_value        VARCHAR;
 BEGIN
     my_is_async := TRUE;
     SELECT COALESCE(
@@ -631,44 +1022,34 @@ BEGIN
         RETURN NEW;
     END IF;
 
-    EXECUTE 'SELECT ' || COALESCE(
-                current_setting( '@extschema@.get_uid_function', TRUE ),
-                'NULL'
-            ) || '::INTEGER'
-      INTO my_uid;
+    SELECT ss.uid
+      INTO my_uid
+      FROM @extschema@.fn_get_session_state() ss;
 
     IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
         RAISE DEBUG '@extschema@: event processing - uid %', my_uid;
     END IF;
 
-    my_query := regexp_replace( my_query, '\?pk_value\?', NEW.pk_value::VARCHAR, 'g' );
-    my_query := regexp_replace( my_query, '\?recorded\?', quote_nullable( NEW.recorded::VARCHAR ), 'g' );
-    my_query := regexp_replace( my_query, '\?uid\?', quote_nullable( NEW.uid::VARCHAR ), 'g' );
-    my_query := regexp_replace( my_query, '\?op\?', quote_nullable( NEW.op::VARCHAR ), 'g' );
-    my_query := regexp_replace( my_query, '\?event_table_work_item\?', NEW.event_table_work_item::VARCHAR, 'g' );
-
-    FOR my_key, my_value IN(
-                                SELECT 'OLD.' || key,
-                                       value
-                                  FROM jsonb_each_text( NEW.old )
-                                 UNION ALL
-                                SELECT 'NEW.' || key,
-                                       value
-                                  FROM jsonb_each_text( NEW.new )
-                           ) LOOP
-        my_query := regexp_replace( my_query, '\?' || my_key || '\?', quote_nullable( my_value ), 'g' );
-    END LOOP;
-
-    FOR my_key, my_value IN(
-                            SELECT key,
-                                   value
-                              FROM jsonb_each_text( NEW.session_values )
-                           ) LOOP
-        my_query := regexp_replace( my_query, '\?' || my_key || '\?', quote_nullable( my_value ), 'g' );
-    END LOOP;
-
-    -- Replace any remaining bindpoints with NULL
-    my_query := regexp_replace( my_query, '\?(((OLD)|(NEW))\.)?\w+\?', 'NULL', 'g' );
+    -- Bind in a single pass; earlier objects take precedence, and remaining bindpoints become NULL
+    my_query := @extschema@.fn_bind_query(
+                    my_query,
+                    ARRAY[
+                        jsonb_build_object(
+                            'pk_value', NEW.pk_value,
+                            'recorded', NEW.recorded::VARCHAR,
+                            'uid', NEW.uid,
+                            'op', NEW.op,
+                            'event_table_work_item', NEW.event_table_work_item
+                        ),
+                        CASE WHEN NEW.op = 'U'
+                             THEN NEW.new || NEW.old -- Compact payloads only carry changed OLD values
+                             ELSE NEW.old
+                              END,
+                        NEW.new,
+                        NEW.session_values
+                    ],
+                    ARRAY[ NULL, 'OLD.', 'NEW.', NULL ]
+                );
 
     IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
         RAISE DEBUG '@extschema@: Event processing - Final query %', my_query;
@@ -737,8 +1118,6 @@ DECLARE
     my_is_async          BOOLEAN;
     my_query             TEXT;
     my_static_parameters JSONB;
-    my_key               TEXT;
-    my_value             TEXT;
     my_set_uid_query     TEXT;
 BEGIN
     my_is_async := TRUE;
@@ -771,58 +1150,38 @@ BEGIN
      WHERE action = NEW.action;
 
     IF( my_query IS NULL ) THEN
-        RAISE NOTICE 'Cannot execute API endpoint call in synchronous mode!';
+        RAISE NOTICE 'Cannot execute API endpoint or function call in synchronous mode!';
         NOTIFY new_work_queue_item;
         RETURN NULL;
     END IF;
 
-    SELECT 'SELECT ' || COALESCE(
-                    regexp_replace(
-                        COALESCE( current_setting( '@extschema@.set_uid_function', TRUE ), 'NULL' ),
-                        '\?uid\?',
-                        quote_nullable( NEW.uid ),
-                        'g'
-                    ),
-                    'NULL'
-           )
-      INTO my_set_uid_query;
-
-    my_query := regexp_replace( my_query, '\?recorded\?', quote_nullable( NEW.recorded::VARCHAR ), 'g' );
-    my_query := regexp_replace( my_query, '\?uid\?', quote_nullable( NEW.uid::VARCHAR ), 'g' );
-    my_query := regexp_replace( my_query, '\?transaction_label\?', quote_nullable( NEW.transaction_label::VARCHAR ), 'g' );
-
-    FOR my_key, my_value IN(
-                            SELECT key,
-                                   value
-                              FROM jsonb_each_text( NEW.parameters )
-                           ) LOOP
-        my_query := regexp_replace( my_query, '\?' || my_key || '\?', quote_nullable( my_value ), 'g' );
-    END LOOP;
-
-    FOR my_key, my_value IN(
-                            SELECT key,
-                                   value
-                              FROM jsonb_each_text( my_static_parameters )
-                           ) LOOP
-        my_query := regexp_replace( my_query, '\?' || my_key || '\?', quote_nullable( my_value ), 'g' );
-    END LOOP;
-
-    FOR my_key, my_value IN(
-                            SELECT key,
-                                   value
-                              FROM jsonb_each_text( NEW.session_values )
-                           ) LOOP
-        my_query := regexp_replace( my_query, '\?' || my_key || '\?', quote_nullable( my_value ), 'g' );
-        my_set_uid_query := regexp_replace( my_set_uid_query, '\?' || my_key || '\?', quote_nullable( my_value ), 'g' );
-    END LOOP;
-
-    my_query := regexp_replace( my_query, '\?(((OLD)|(NEW))\.)?\w+\?', 'NULL', 'g' );
+    my_set_uid_query := 'SELECT ' || @extschema@.fn_bind_query(
+                                         COALESCE( current_setting( '@extschema@.set_uid_function', TRUE ), 'NULL' ),
+                                         ARRAY[
+                                             jsonb_build_object( 'uid', NEW.uid ),
+                                             NEW.session_values
+                                         ]
+                                     );
+
+    my_query := @extschema@.fn_bind_query(
+                    my_query,
+                    ARRAY[
+                        jsonb_build_object(
+                            'recorded', NEW.recorded::VARCHAR,
+                            'uid', NEW.uid,
+                            'transaction_label', NEW.transaction_label
+                        ),
+                        NEW.parameters,
+                        my_static_parameters,
+                        NEW.session_values
+                    ]
+                );
 
     IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
         RAISE DEBUG '@extschema@: work processing - final query is %', my_query;
     END IF;
 
-    EXECUTE my_set_uid_function;
+    EXECUTE my_set_uid_query;
     EXECUTE my_query;
 
     PERFORM p.proname
@@ -861,6 +1220,38 @@ CREATE TRIGGER tr_handle_new_work_queue_item
     AFTER INSERT ON @extschema@.tb_work_queue
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_handle_new_work_queue_item();
 
+CREATE FUNCTION @extschema@.fn_set_work_queue_host()
+RETURNS TRIGGER AS
+ $_$
+BEGIN
+    -- Extracted once here so that claims can filter and order on the indexed column
+    SELECT CASE WHEN u.uri !~ '^(unix|fifo|file)://'
+                THEN lower( substring( u.uri FROM '^(?:[a-zA-Z][a-zA-Z0-9+.-]*://)?(?:[^/?#@]*@)?([^/?#:]+)' ) )
+                 END
+      INTO NEW.host
+      FROM (
+               SELECT regexp_replace(
+                          a.uri,
+                          '__BASE_URL__',
+                          COALESCE(
+                              NEW.session_values->>'@extschema@.base_url',
+                              current_setting( '@extschema@.base_url', TRUE ),
+                              'localhost'
+                          )
+                      ) AS uri
+                 FROM @extschema@.tb_action a
+                WHERE a.action = NEW.action
+           ) u;
+
+    RETURN NEW;
+END
+ $_$
+    LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
+
+CREATE TRIGGER tr_set_work_queue_host
+    BEFORE INSERT ON @extschema@.tb_work_queue
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_set_work_queue_host();
+
 CREATE FUNCTION @extschema@.fn_validate_function()
 RETURNS TRIGGER AS
  $_$
@@ -895,6 +1286,61 @@ CREATE TRIGGER tr_validate_when_function
     BEFORE INSERT OR UPDATE OF when_function ON @extschema@.tb_event_table_work_item
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_validate_function();
 
+CREATE FUNCTION @extschema@.fn_validate_when_condition()
+RETURNS TRIGGER AS
+ $_$
+DECLARE
+    my_schema_name  VARCHAR;
+    my_table_name   VARCHAR;
+BEGIN
+    IF( NEW.when_condition IS NULL ) THEN
+        RETURN NEW;
+    END IF;
+
+    -- Trigger WHEN clauses cannot contain subqueries
+    IF( NEW.when_condition ~* '(;|\mselect\M)' ) THEN
+        RAISE EXCEPTION 'when_condition must be a simple row predicate: %', NEW.when_condition;
+    END IF;
+
+    IF( NEW.when_condition ~* '\mOLD\.' AND ( NEW.op IS NULL OR 'I' = ANY( NEW.op ) ) ) THEN
+        RAISE EXCEPTION 'when_condition cannot reference OLD on a work item that fires on INSERT';
+    END IF;
+
+    IF( NEW.when_condition ~* '\mNEW\.' AND ( NEW.op IS NULL OR 'D' = ANY( NEW.op ) ) ) THEN
+        RAISE EXCEPTION 'when_condition cannot reference NEW on a work item that fires on DELETE';
+    END IF;
+
+    SELECT et.schema_name,
+           et.table_name
+      INTO my_schema_name,
+           my_table_name
+      FROM @extschema@.tb_event_table et
+     WHERE et.event_table = NEW.source_event_table;
+
+    -- Plan the predicate against the source table's row type, this raises on
+    -- unknown columns and non-boolean expressions
+    EXECUTE format(
+                'SELECT 1 FROM %I.%I new, %I.%I old WHERE ( %s ) AND FALSE',
+                my_schema_name,
+                my_table_name,
+                my_schema_name,
+                my_table_name,
+                NEW.when_condition
+            );
+
+    IF( COALESCE( current_setting( '@extschema@.debug', TRUE )::BOOLEAN, FALSE ) IS TRUE ) THEN
+        RAISE DEBUG '@extschema@: when condition validated';
+    END IF;
+
+    RETURN NEW;
+END
+ $_$
+    LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
+
+CREATE TRIGGER tr_validate_when_condition
+    BEFORE INSERT OR UPDATE OF when_condition, op, source_event_table ON @extschema@.tb_event_table_work_item
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_validate_when_condition();
+
 CREATE FUNCTION @extschema@.fn_validate_work_item_reference()
 RETURNS TRIGGER AS
  $_$
@@ -919,10 +1365,321 @@ CREATE TRIGGER tr_event_table_triggering_sanity_check
     AFTER INSERT OR UPDATE OF source_event_table ON @extschema@.tb_event_table_work_item
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.fn_validate_work_item_reference();
 
+CREATE FUNCTION @extschema@.fn_refill_rate_bucket
+(
+    in_bucket   VARCHAR,
+    in_rate     NUMERIC,
+    in_burst    INTEGER
+)
+RETURNS DOUBLE PRECISION AS
+ $_$
+    INSERT INTO @extschema@.tb_rate_bucket AS rb
+                (
+                    bucket,
+                    tokens
+                )
+         VALUES
+                (
+                    in_bucket,
+                    in_burst
+                )
+    ON CONFLICT ( bucket ) DO UPDATE
+            SET tokens = least(
+                             in_burst,
+                             rb.tokens + extract( EPOCH FROM clock_timestamp() - rb.refilled ) * in_rate
+                         ),
+                refilled = clock_timestamp()
+      RETURNING tokens;
+ $_$
+    LANGUAGE SQL VOLATILE PARALLEL UNSAFE;
+
+CREATE FUNCTION @extschema@.fn_take_rate_tokens
+(
+    in_action           INTEGER,
+    in_host             VARCHAR,
+    OUT action_wait_ms  INTEGER,
+    OUT host_wait_ms    INTEGER
+)
+RETURNS RECORD AS
+ $_$
+DECLARE
+    my_action_rate      NUMERIC;
+    my_action_burst     INTEGER;
+    my_action_tokens    DOUBLE PRECISION;
+    my_host_rate        NUMERIC;
+    my_host_burst       INTEGER;
+    my_host_tokens      DOUBLE PRECISION;
+BEGIN
+    -- Both buckets are checked before either is debited, so a call throttled by one limit does not use up the other
+    action_wait_ms := 0;
+    host_wait_ms   := 0;
+
+    SELECT a.rate_limit_per_sec,
+           COALESCE( a.burst, 1 )
+      INTO my_action_rate,
+           my_action_burst
+      FROM @extschema@.tb_action a
+     WHERE a.action = in_action;
+
+    SELECT rh.rate_limit_per_sec,
+           COALESCE( rh.burst, 1 )
+      INTO my_host_rate,
+           my_host_burst
+      FROM @extschema@.tb_remote_host rh
+     WHERE rh.host = in_host;
+
+    IF( my_action_rate IS NOT NULL ) THEN
+        my_action_tokens := @extschema@.fn_refill_rate_bucket( 'action:' || in_action, my_action_rate, my_action_burst );
+
+        IF( my_action_tokens < 1 ) THEN
+            action_wait_ms := ceil( ( 1 - my_action_tokens ) / my_action_rate * 1000 );
+        END IF;
+    END IF;
+
+    IF( my_host_rate IS NOT NULL ) THEN
+        my_host_tokens := @extschema@.fn_refill_rate_bucket( 'host:' || in_host, my_host_rate, my_host_burst );
+
+        IF( my_host_tokens < 1 ) THEN
+            host_wait_ms := ceil( ( 1 - my_host_tokens ) / my_host_rate * 1000 );
+        END IF;
+    END IF;
+
+    IF( action_wait_ms = 0 AND host_wait_ms = 0 ) THEN
+        UPDATE @extschema@.tb_rate_bucket
+           SET tokens = tokens - 1
+         WHERE ( my_action_rate IS NOT NULL AND bucket = 'action:' || in_action )
+            OR ( my_host_rate IS NOT NULL AND bucket = 'host:' || in_host );
+    END IF;
+
+    RETURN;
+END
+ $_$
+    LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
+
+CREATE FUNCTION @extschema@.fn_schedule_retry
+(
+    in_queue        VARCHAR,
+    in_ctid         TID,
+    in_error        TEXT,
+    in_leased_by    VARCHAR DEFAULT NULL
+)
+RETURNS INTEGER AS
+ $_$
+DECLARE
+    my_table            VARCHAR;
+    my_attempts         INTEGER;
+    my_item             JSONB;
+    my_delay_ms         INTEGER;
+    my_max_attempts     INTEGER;
+    my_base_ms          INTEGER;
+    my_max_ms           INTEGER;
+    my_lease_filter     TEXT;
+    my_xmin             XID;
+    my_row_count        INTEGER;
+BEGIN
+    IF( in_queue NOT IN( 'event', 'work' ) ) THEN
+        RAISE EXCEPTION 'Unknown queue %', in_queue;
+    END IF;
+
+    my_table        := '@extschema@.tb_' || in_queue || '_queue';
+    my_max_attempts := COALESCE( NULLIF( current_setting( '@extschema@.retry_max_attempts', TRUE ), '' )::INTEGER, 10 );
+    my_base_ms      := COALESCE( NULLIF( current_setting( '@extschema@.retry_base_ms', TRUE ), '' )::INTEGER, 1000 );
+    my_max_ms       := COALESCE( NULLIF( current_setting( '@extschema@.retry_max_ms', TRUE ), '' )::INTEGER, 3600000 );
+
+    /*
+     * The item was released when its transaction rolled back, or its call ran outside of one,
+     * so another daemon may hold it by now. A leased work queue item is only changed while the
+     * lease is still in_leased_by's; any other work queue item only while nobody leases it.
+     */
+    my_lease_filter := CASE WHEN in_queue <> 'work'
+                            THEN ''
+                            WHEN in_leased_by IS NULL
+                            THEN ' AND ( q.leased_until IS NULL OR q.leased_until <= clock_timestamp() )'
+                            ELSE ' AND q.leased_by = $2'
+                             END;
+
+    EXECUTE format(
+        'SELECT q.attempts + 1, '
+        '       to_jsonb( q ) - ''attempts'' - ''last_error'' - ''next_attempt_at'', '
+        '       q.xmin '
+        '  FROM %s q '
+        ' WHERE q.ctid = $1 '
+        '       %s '
+        '   FOR UPDATE SKIP LOCKED',
+        my_table,
+        my_lease_filter
+    )
+       INTO my_attempts,
+            my_item,
+            my_xmin
+      USING in_ctid,
+            in_leased_by;
+
+    IF( my_attempts IS NULL ) THEN
+        RETURN NULL;
+    END IF;
+
+    IF( my_attempts >= my_max_attempts ) THEN
+        -- ctid and xmin together identify the row version locked above, a reused ctid has another xmin
+        EXECUTE format( 'DELETE FROM %s WHERE ctid = $1 AND xmin = $2', my_table )
+          USING in_ctid,
+                my_xmin;
+
+        GET DIAGNOSTICS my_row_count = ROW_COUNT;
+
+        IF( my_row_count = 0 ) THEN
+            RETURN NULL;
+        END IF;
+
+        INSERT INTO @extschema@.tb_dead_letter
+                    (
+                        queue,
+                        item,
+                        attempts,
+                        last_error
+                    )
+             VALUES
+                    (
+                        in_queue,
+                        my_item,
+                        my_attempts,
+                        in_error
+                    );
+
+        RETURN -1;
+    END IF;
+
+    -- Exponential backoff with equal jitter: half of the delay is fixed, half is random
+    my_delay_ms := least( my_max_ms, my_base_ms * power( 2, least( my_attempts - 1, 30 ) ) );
+    my_delay_ms := my_delay_ms / 2 + floor( random() * ( my_delay_ms / 2 + 1 ) );
+
+    -- Failed remote calls give up their work queue lease so the retry is not held back by it
+    EXECUTE format(
+        'UPDATE %s '
+        '   SET attempts = $2, '
+        '       last_error = $3, '
+        '       next_attempt_at = clock_timestamp() + $4 * INTERVAL ''1 millisecond'' '
+        '       %s '
+        ' WHERE ctid = $1 '
+        '   AND xmin = $5',
+        my_table,
+        CASE WHEN in_queue = 'work' THEN ', leased_until = NULL, leased_by = NULL' ELSE '' END
+    )
+      USING in_ctid,
+            my_attempts,
+            in_error,
+            my_delay_ms,
+            my_xmin;
+
+    RETURN my_delay_ms;
+END
+ $_$
+    LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
+
+CREATE FUNCTION @extschema@.fn_claim_work_queue_items
+(
+    in_open_hosts           TEXT[],
+    in_throttled_hosts      TEXT[],
+    in_throttled_actions    INTEGER[],
+    in_host_schedule        TEXT[],
+    in_limit                INTEGER,
+    in_spool_only           BOOLEAN
+)
+RETURNS TID[] AS
+ $_$
+DECLARE
+    my_host             TEXT;
+    my_items            TID[];
+    my_limit            INTEGER;
+BEGIN
+    my_items := ARRAY[]::TID[];
+    my_limit := COALESCE( in_limit, 1 );
+
+    /*
+     * Queued hosts are found by skipping through ix_work_queue_host_recorded
+     * one host at a time, so a claim costs an index probe per host rather
+     * than a scan of the backlog. Hosts this daemon has not served yet come
+     * first, then the rest in schedule order. Items without a host ('') have
+     * their own place in the schedule once served.
+     */
+    FOR my_host IN(
+                      WITH RECURSIVE hosts( host ) AS
+                      (
+                          (
+                              SELECT COALESCE( wq.host, '' )
+                                FROM @extschema@.tb_work_queue wq
+                            ORDER BY COALESCE( wq.host, '' )
+                               LIMIT 1
+                          )
+                           UNION ALL
+                          SELECT (
+                                     SELECT COALESCE( wq.host, '' )
+                                       FROM @extschema@.tb_work_queue wq
+                                      WHERE COALESCE( wq.host, '' ) > h.host
+                                   ORDER BY COALESCE( wq.host, '' )
+                                      LIMIT 1
+                                 )
+                            FROM hosts h
+                           WHERE h.host IS NOT NULL
+                      )
+                      SELECT h.host
+                        FROM hosts h
+                       WHERE h.host IS NOT NULL
+                         AND ( in_open_hosts IS NULL OR h.host <> ALL( in_open_hosts ) )
+                         AND ( in_throttled_hosts IS NULL OR h.host <> ALL( in_throttled_hosts ) )
+                         AND (
+                                 NOT COALESCE( in_spool_only, FALSE )
+                              OR NOT EXISTS(
+                                         SELECT 1
+                                           FROM @extschema@.tb_remote_host rh
+                                          WHERE rh.host = h.host
+                                     )
+                             )
+                    ORDER BY array_position( in_host_schedule, h.host ) NULLS FIRST,
+                             h.host
+                  ) LOOP
+        my_items := my_items || ARRAY(
+                                    SELECT wq.ctid
+                                      FROM @extschema@.tb_work_queue wq
+                                INNER JOIN @extschema@.tb_action a
+                                        ON a.action = wq.action
+                                 LEFT JOIN @extschema@.tb_remote_host rh
+                                        ON rh.host = wq.host
+                                     WHERE COALESCE( wq.host, '' ) = my_host
+                                       AND ( wq.next_attempt_at IS NULL OR wq.next_attempt_at <= clock_timestamp() )
+                                       AND ( wq.leased_until IS NULL OR wq.leased_until <= clock_timestamp() )
+                                       AND ( in_throttled_actions IS NULL OR wq.action <> ALL( in_throttled_actions ) )
+                                       AND (
+                                               NOT COALESCE( in_spool_only, FALSE )
+                                            OR (
+                                                   a.query IS NULL
+                                               AND a.function IS NULL
+                                               AND a.rate_limit_per_sec IS NULL
+                                               AND rh.host IS NULL
+                                               )
+                                           )
+                                  ORDER BY COALESCE( wq.host, '' ),
+                                           wq.recorded DESC
+                                     LIMIT my_limit - cardinality( my_items )
+                                       FOR UPDATE OF wq SKIP LOCKED
+                                );
+
+        EXIT WHEN cardinality( my_items ) >= my_limit;
+    END LOOP;
+
+    RETURN my_items;
+END
+ $_$
+    LANGUAGE 'plpgsql' VOLATILE PARALLEL UNSAFE;
+
 GRANT ALL ON @extschema@.tb_event_queue TO public;
 GRANT ALL ON @extschema@.tb_work_queue TO public;
+GRANT ALL ON @extschema@.tb_dead_letter TO public;
+GRANT USAGE, SELECT ON SEQUENCE @extschema@.sq_pk_dead_letter TO public;
 GRANT SELECT ON @extschema@.tb_event_table_work_item TO public;
 GRANT SELECT ON @extschema@.tb_action TO public;
+GRANT SELECT ON @extschema@.tb_remote_host TO public;
+GRANT ALL ON @extschema@.tb_rate_bucket TO public;
 GRANT SELECT ON @extschema@.tb_setting TO public;
 GRANT SELECT ON @extschema@.tb_event_table TO public;
 GRANT ALL ON @extschema@.tb_event_table_work_item_instance TO public;
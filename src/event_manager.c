@@ -26,12 +26,19 @@
 #include <sys/types.h>
 #include <time.h>
 #include <signal.h>
+#include <pthread.h>
 
 #include <curl/curl.h>
 #include "event_manager.h"
 #include "lib/util.h"
 #include "lib/strings.h"
 #include "lib/query_helper.h"
+#include "lib/compression.h"
+#include "lib/host_state.h"
+#include "lib/rate_limit.h"
+#include "lib/spool.h"
+#include "lib/local_sink.h"
+#include "lib/function_call.h"
 #include "lib/jsmn/jsmn.h"
 
 /* Constants */
@@ -47,9 +54,54 @@
 #define GET_UID_GUC_NAME "get_uid_function"
 #define ASYNC_GUC_NAME "execute_asynchronously"
 
-// Regular Expression Settings
-#define MAX_REGEX_GROUPS 1
-#define MAX_REGEX_MATCHES 100
+// Deadline propagated to remote endpoints, in milliseconds remaining
+#define DEADLINE_HEADER "X-Request-Deadline-Ms"
+
+// Response policies
+#define RESPONSE_POLICY_DISCARD 0
+#define RESPONSE_POLICY_HEAD 1
+#define RESPONSE_POLICY_STORE 2
+
+// Host concurrency slots
+#define HOST_SLOT_NONE -1
+#define HOST_SLOT_ERROR -2
+#define HOST_SLOT_MIN_WAIT_MS 10
+
+// Work queue leases, owner is host:pid
+#define LEASE_OWNER_SIZE 256
+
+// Indexes into action_fields, also the field order of spooled records
+#define ACTION_FIELD_PARAMETERS 0
+#define ACTION_FIELD_UID 1
+#define ACTION_FIELD_RECORDED 2
+#define ACTION_FIELD_SESSION_VALUES 3
+#define ACTION_FIELD_URI 4
+#define ACTION_FIELD_HOST 5
+#define ACTION_FIELD_ACTION 6
+#define ACTION_FIELD_STATIC_PARAMETERS 7
+#define ACTION_FIELD_TRANSACTION_LABEL 8
+#define ACTION_FIELD_METHOD 9
+#define ACTION_FIELD_QUERY 10
+#define ACTION_FIELD_BODY_FORMAT 11
+#define ACTION_FIELD_JSON_BODY 12
+#define ACTION_FIELD_USE_SSL 13
+#define ACTION_FIELD_CONNECT_TIMEOUT_MS 14
+#define ACTION_FIELD_TIMEOUT_MS 15
+#define ACTION_FIELD_HEDGE_PERCENTILE 16
+#define ACTION_FIELD_RESPONSE_POLICY 17
+#define ACTION_FIELD_RESPONSE_LIMIT 18
+#define ACTION_FIELD_BODY_COMPRESSION 19
+#define ACTION_FIELD_COMPRESS_MIN_SIZE 20
+#define ACTION_FIELD_ATTEMPTS 21
+#define ACTION_FIELD_FUNCTION 22
+#define ACTION_FIELD_COUNT 23
+// Fields kept in spool records. Function actions are never spooled, so the
+// fields after ACTION_FIELD_ATTEMPTS are left out of the record layout
+#define ACTION_FIELD_SPOOLED 22
+
+// Hedged requests
+#define HEDGE_POLL_MS 100
+#define HEDGE_BUDGET_WINDOW 10000
 
 // SQL States
 #define SQL_STATE_TERMINATED_BY_ADMINISTRATOR "57P01"
@@ -61,8 +113,74 @@ char *   ext_schema          = NULL;
 bool     cyanaudit_installed = false;
 bool     enable_curl         = false;
 CURL *   curl_handle         = NULL;
+CURLSH * curl_share          = NULL;
+CURLM *  curl_multi          = NULL;
+long     low_speed_limit     = 1;
+long     low_speed_time      = 30;
+bool     fail_on_http_error  = false;
 bool     tx_in_progress      = false;
 
+// Marks work queue items leased by this process
+char lease_owner[LEASE_OWNER_SIZE] = {0};
+
+// Dequeued work queue columns an action is built from
+const char * action_fields[ACTION_FIELD_COUNT] = {
+    "parameters",
+    "uid",
+    "recorded",
+    "session_values",
+    "uri",
+    "host",
+    "action",
+    "static_parameters",
+    "transaction_label",
+    "method",
+    "query",
+    "body_format",
+    "json_body",
+    "use_ssl",
+    "connect_timeout_ms",
+    "timeout_ms",
+    "hedge_percentile",
+    "response_policy",
+    "response_limit",
+    "body_compression",
+    "compress_min_size",
+    "attempts",
+    "function"
+};
+
+// Local journal that remote calls are delivered from, with -S
+struct spool work_spool       = {0};
+int          spool_batch_size = 100;
+
+// While set, local sink lines are flushed once per spool batch, and the
+// spool records they came from are acknowledged after that flush
+bool                  sink_flush_deferred = false;
+struct string_builder spooled_sink_acks   = {0};
+
+// Hedged requests sent, against all remote calls, for the hedging budget
+double hedge_budget = 0.05;
+long   hedge_calls  = 0;
+long   hedges_sent  = 0;
+
+// Per queue item allocations, released after each item is handled
+struct arena handler_arena = {0};
+
+// Remote call URL / body, reused across calls
+struct string_builder request_buffer    = {0};
+struct string_builder compressed_buffer = {0};
+struct string_builder response_buffer   = {0};
+struct string_builder open_hosts_buffer = {0};
+struct string_builder throttled_hosts   = {0};
+struct string_builder throttled_actions = {0};
+struct string_builder host_schedule     = {0};
+struct string_builder hedge_buffer      = {0};
+struct string_builder spooled_ctids     = {0};
+
+// Guards for the DNS, TLS session and connection caches in curl_share
+pthread_mutex_t curl_share_locks[CURL_LOCK_DATA_LAST];
+
 // Flags
 sig_atomic_t got_sighup  = false;
 sig_atomic_t got_sigterm = false;
@@ -283,7 +401,7 @@ void _queue_loop( const char * channel, int (*dequeue_function)(void) )
         "Processing queue entries prior to entering main loop"
     );
 
-    while( (*dequeue_function)() > 0 )
+    while( _handle_queue_item( dequeue_function ) > 0 )
     {
         processed_count++;
     }
@@ -338,7 +456,10 @@ void _queue_loop( const char * channel, int (*dequeue_function)(void) )
         sigset_t signal_set;
 #endif
         int sock;
+        int ready;
+        long wait_ms;
         fd_set input_mask;
+        struct timeval wait_timeout;
 
         if( got_sigterm )
         {
@@ -364,7 +485,20 @@ void _queue_loop( const char * channel, int (*dequeue_function)(void) )
 #ifdef BLOCKING_SELECT
         sigprocmask( SIG_BLOCK, &signal_set, NULL );
 #endif
-        if( select( sock + 1, &input_mask, NULL, NULL, NULL ) < 0 )
+        wait_ms = _next_wake_ms( dequeue_function );
+
+        wait_timeout.tv_sec  = wait_ms / 1000;
+        wait_timeout.tv_usec = ( wait_ms % 1000 ) * 1000;
+
+        ready = select(
+            sock + 1,
+            &input_mask,
+            NULL,
+            NULL,
+            wait_ms < 0 ? NULL : &wait_timeout
+        );
+
+        if( ready < 0 )
         {
 #ifdef BLOCKING_SELECT
             sigprocmask( SIG_UNBLOCK, &signal_set, NULL );
@@ -381,6 +515,22 @@ void _queue_loop( const char * channel, int (*dequeue_function)(void) )
         sigprocmask( SIG_UNBLOCK, &signal_set, NULL );
 #endif
 
+        if( ready == 0 )
+        {
+            while( _handle_queue_item( dequeue_function ) > 0 )
+            {
+                processed_count++;
+            }
+
+            _log(
+                LOG_LEVEL_DEBUG,
+                "Processed %d queue entries after wait timeout",
+                processed_count
+            );
+            processed_count = 0;
+            continue;
+        }
+
         _log(
             LOG_LEVEL_DEBUG,
             "Handling notify"
@@ -401,7 +551,7 @@ void _queue_loop( const char * channel, int (*dequeue_function)(void) )
 
             // Get queue item
             PQfreemem( notify );
-            while( (*dequeue_function)() > 0 )
+            while( _handle_queue_item( dequeue_function ) > 0 )
             {
                 processed_count++;
             }
@@ -427,6 +577,68 @@ void _queue_loop( const char * channel, int (*dequeue_function)(void) )
     return;
 }
 
+/*
+ * long _next_wake_ms( int (*dequeue_function)(void) )
+ *     Items for hosts with open circuit breakers, for throttled actions and
+ *     hosts, and items waiting to be retried stay in the queue without a
+ *     NOTIFY. Finds how long the queue loop may sleep before one of them is
+ *     due.
+ *
+ * Arguments:
+ *     - int (*dequeue_function)(void): Handler of the queue being listened to.
+ * Return:
+ *     long: Milliseconds until the earliest breaker trial, throttle expiry
+ *           or retry, -1 when nothing is pending.
+ * Error conditions:
+ *     None
+ */
+long _next_wake_ms( int (*dequeue_function)(void) )
+{
+    long wait_ms     = 0;
+    long throttle_ms = 0;
+    long retry_ms    = 0;
+
+    wait_ms     = _next_breaker_timeout_ms();
+    throttle_ms = _next_throttle_timeout_ms();
+    retry_ms    = _next_retry_timeout_ms( dequeue_function );
+
+    if( throttle_ms >= 0 && ( wait_ms < 0 || throttle_ms < wait_ms ) )
+    {
+        wait_ms = throttle_ms;
+    }
+
+    if( retry_ms >= 0 && ( wait_ms < 0 || retry_ms < wait_ms ) )
+    {
+        wait_ms = retry_ms;
+    }
+
+    return wait_ms;
+}
+
+/*
+ * int _handle_queue_item( int (*dequeue_function)(void) )
+ *     Runs the dequeue_function for a single queue item, then releases
+ *     everything the item allocated from handler_arena in one step.
+ *
+ * Arguments:
+ *     - int (*dequeue_function)(void): pointer to the queue handler.
+ * Return:
+ *     int: Return value of the dequeue_function.
+ * Error conditions:
+ *     None
+ */
+int _handle_queue_item( int (*dequeue_function)(void) )
+{
+    int rows_processed = 0;
+
+    // Failed items are retried with the first error their attempt logged
+    _clear_recorded_error();
+    rows_processed = (*dequeue_function)();
+    _arena_reset( &handler_arena );
+
+    return rows_processed;
+}
+
 /*
  *  These functions encapsulate the critical section of asynchronous mode that
  *  dequeues and executes arbitrary queries
@@ -440,7 +652,7 @@ void _queue_loop( const char * channel, int (*dequeue_function)(void) )
  *     None
  * Return:
  *     int rows_processed: 1 when a queue entry is successfully processed,
- *                         0 otherwise.
+ *                         or its failure is recorded for retry, 0 otherwise.
  * Error Conditions:
  *     - Emits error when a transaction fails to BEGIN, COMMIT or
  *       ROLLBACK (when necessary)
@@ -479,6 +691,10 @@ int event_queue_handler( void )
     char * new                   = NULL;
     char * session_values        = NULL;
 
+    struct json_object * old_json            = NULL;
+    struct json_object * new_json            = NULL;
+    struct json_object * session_values_json = NULL;
+
     char * parameters = NULL;
     char * params[9]  = {NULL};
     int    i          = 0;
@@ -538,8 +754,49 @@ int event_queue_handler( void )
     new                    = get_column_value( 0, result, "new" );
     session_values         = get_column_value( 0, result, "session_values" );
 
-    set_session_gucs( session_values );
-    work_item_query_obj = _new_query( work_item_query );
+    // Failed items are retried by ctid once result has been cleared
+    ctid = _arena_strndup( &handler_arena, ctid, strlen( ctid ) );
+
+    // Each payload is parsed once and shared by every consumer below
+    old_json            = _parse_json_object( &handler_arena, old );
+    new_json            = _parse_json_object( &handler_arena, new );
+    session_values_json = _parse_json_object( &handler_arena, session_values );
+
+    if(
+            ( old != NULL && old_json == NULL )
+         || ( new != NULL && new_json == NULL )
+         || ( session_values != NULL && session_values_json == NULL )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to parse event queue item payload"
+        );
+        _rollback_transaction();
+        PQclear( result );
+        return _retry_queue_item( "event", ctid, NULL );
+    }
+
+    set_session_gucs( session_values_json );
+    work_item_query_obj = _new_query_from_template(
+        &handler_arena,
+        _get_query_template(
+            QUERY_TEMPLATE_WORK_ITEM,
+            event_table_work_item,
+            work_item_query
+        )
+    );
+
+    if( work_item_query_obj == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to initialize work item query struct"
+        );
+        _rollback_transaction();
+        PQclear( result );
+        return _retry_queue_item( "event", ctid, NULL );
+    }
 
     _add_parameter_to_query(
         work_item_query_obj,
@@ -573,33 +830,43 @@ int event_queue_handler( void )
 
     _add_json_parameter_to_query(
         work_item_query_obj,
-        new,
+        new_json,
         "NEW."
     );
 
     _add_json_parameter_to_query(
         work_item_query_obj,
-        old,
+        old_json,
         "OLD."
     );
 
+    if( op != NULL && strcmp( op, "U" ) == 0 )
+    {
+        // Compact UPDATE payloads only carry the OLD values that changed,
+        //  unchanged columns fall back to their NEW value
+        _add_json_parameter_to_query(
+            work_item_query_obj,
+            new_json,
+            "OLD."
+        );
+    }
+
     _add_json_parameter_to_query(
         work_item_query_obj,
-        session_values,
+        session_values_json,
         ( char * ) NULL
     );
 
-    _finalize_query( work_item_query_obj );
 
-    if( work_item_query_obj == NULL )
+    if( !_finalize_query( work_item_query_obj ) )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "regex replace operation on work_item_query failed"
+            "Parameterization of work_item_query failed"
         );
         _rollback_transaction();
         PQclear( result );
-        return 0;
+        return _retry_queue_item( "event", ctid, NULL );
     }
 
     _log( LOG_LEVEL_DEBUG, "WORK ITEM QUERY: " );
@@ -610,7 +877,6 @@ int event_queue_handler( void )
         work_item_query_obj->_bind_count
     );
 
-    _free_query( work_item_query_obj );
 
     if( work_item_result == NULL )
     {
@@ -621,7 +887,7 @@ int event_queue_handler( void )
 
         PQclear( result );
         _rollback_transaction();
-        return 0;
+        return _retry_queue_item( "event", ctid, NULL );
     }
 
     params[1] = uid;
@@ -650,8 +916,9 @@ int event_queue_handler( void )
             );
 
             PQclear( result );
+            PQclear( work_item_result );
             _rollback_transaction();
-            return 0;
+            return _retry_queue_item( "event", ctid, NULL );
         }
 
         PQclear( insert_result );
@@ -676,7 +943,7 @@ int event_queue_handler( void )
     );
 
     // Clear GUCs prior to freeing result handle
-    clear_session_gucs( session_values );
+    clear_session_gucs( session_values_json );
     PQclear( result );
     PQclear( work_item_result );
 
@@ -687,7 +954,7 @@ int event_queue_handler( void )
             "Failed to dequeue event queue item"
         );
         _rollback_transaction();
-        return 0;
+        return _retry_queue_item( "event", ctid, NULL );
     }
 
     PQclear( delete_result );
@@ -712,7 +979,8 @@ int event_queue_handler( void )
  * Arguments:
  *     None
  * Return:
- *     int rows_processed: number of queue entries processed, 0 otherwise.
+ *     int rows_processed: number of queue entries processed or scheduled
+ *                         for retry, 0 otherwise.
  * Error Conditions:
  *     - Emits error when a transaction fails to BEGIN, COMMIT or ROLLBACK
  *       (when necessary).
@@ -723,16 +991,24 @@ int event_queue_handler( void )
  *              - action execution
  *              - Deletion of dequeued queue item
  *              - commit of transaction (if applicable)
+ *     - Emits warning when a remote call outlives its lease.
  */
 int work_queue_handler( void )
 {
     PGresult * result        = NULL;
     PGresult * delete_result = NULL;
 
-    bool   action_result = false;
-    int    row_count     = 0;
-    int    i             = 0;
-    char * params[7]     = {NULL};
+    bool   action_result     = false;
+    bool   leased            = false;
+    int    row_count         = 0;
+    int    i                 = 0;
+    int    host_slot         = HOST_SLOT_NONE;
+    int    tokens            = 0;
+    char * host              = NULL;
+    char * params[7]         = {NULL};
+    char * dequeue_params[6] = {NULL};
+
+    struct host_state * state = NULL;
 
     _log(
         LOG_LEVEL_DEBUG,
@@ -749,10 +1025,12 @@ int work_queue_handler( void )
         return 0;
     }
 
+    _work_queue_filters( dequeue_params );
+
     result = _execute_query(
         ( char * ) get_work_queue_item,
-        NULL,
-        0
+        dequeue_params,
+        6
     );
 
     if( result == NULL )
@@ -785,6 +1063,82 @@ int work_queue_handler( void )
         params[4] = get_column_value( i, result, "action" );
         params[5] = get_column_value( i, result, "session_values" );
         params[6] = get_column_value( i, result, "ctid" );
+        host      = get_column_value( i, result, "host" );
+
+        /*
+         * Tokens are taken in the dequeue transaction, so they are spent
+         * on this item or given back by its rollback. Remote calls commit
+         * before the call, so the buckets stay locked only while leasing.
+         */
+        if( strcmp( get_column_value( i, result, "rate_limited" ), "t" ) == 0 )
+        {
+            tokens = _take_rate_tokens( params[4], host );
+
+            if( tokens <= 0 )
+            {
+                _rollback_transaction();
+                PQclear( result );
+                return tokens == 0 ? 1 : 0;
+            }
+        }
+
+        /*
+         * Calls in flight to a host, across all daemons, are bounded by
+         * its adaptive concurrency limit. When every slot is taken the
+         * host is set aside for about the length of a call.
+         */
+        if( host != NULL && is_column_null( i, result, "query" ) )
+        {
+            state     = _get_host_state( host );
+            host_slot = _acquire_host_slot( host, _concurrency_limit( state ) );
+
+            if( host_slot < 0 )
+            {
+                _rollback_transaction();
+
+                if( host_slot == HOST_SLOT_NONE )
+                {
+                    _throttle(
+                        RATE_LIMIT_HOST,
+                        host,
+                        state != NULL && state->latency_ms > HOST_SLOT_MIN_WAIT_MS
+                            ? ( long ) state->latency_ms
+                            : HOST_SLOT_MIN_WAIT_MS
+                    );
+                }
+
+                PQclear( result );
+                return host_slot == HOST_SLOT_NONE ? 1 : 0;
+            }
+        }
+
+        /*
+         * Remote calls are made outside of any transaction. The item is
+         * leased and the dequeue transaction committed before the call,
+         * then the item is acknowledged by deleting it afterwards. Expired
+         * leases, from calls that never finished, are dequeued again.
+         */
+        if( host != NULL && is_column_null( i, result, "query" ) )
+        {
+            params[6] = _lease_work_queue_item(
+                params[6],
+                get_column_value( i, result, "timeout_ms" )
+            );
+
+            if( params[6] == NULL || !_commit_transaction() )
+            {
+                if( params[6] == NULL )
+                {
+                    _rollback_transaction();
+                }
+
+                _release_host_slot( host, host_slot );
+                PQclear( result );
+                return 0;
+            }
+
+            leased = true;
+        }
 
         /* Get detailed information about action, get parameter list */
         _log(
@@ -796,9 +1150,19 @@ int work_queue_handler( void )
 
         if( action_result == false )
         {
+            if( !leased )
+            {
+                _rollback_transaction();
+            }
+
+            _release_host_slot( host, host_slot );
+            action_result = _retry_queue_item(
+                "work",
+                params[6],
+                leased ? lease_owner : NULL
+            );
             PQclear( result );
-            _rollback_transaction();
-            return 0;
+            return action_result ? 1 : 0;
         }
 
         /* Flush queue item */
@@ -815,17 +1179,35 @@ int work_queue_handler( void )
                 "Failed to flush work queue item"
             );
 
+            if( !leased )
+            {
+                _rollback_transaction();
+            }
+
+            _release_host_slot( host, host_slot );
+            action_result = _retry_queue_item(
+                "work",
+                params[6],
+                leased ? lease_owner : NULL
+            );
             PQclear( result );
-            _rollback_transaction();
-            return 0;
+            return action_result ? 1 : 0;
+        }
+
+        if( leased && strcmp( PQcmdTuples( delete_result ), "0" ) == 0 )
+        {
+            _log(
+                LOG_LEVEL_WARNING,
+                "Lease on work queue item for action %s expired during its call,"
+                " the action may run again",
+                params[4]
+            );
         }
 
         PQclear( delete_result );
     }
 
-    PQclear( result );
-
-    if( _commit_transaction() == false )
+    if( !leased && _commit_transaction() == false )
     {
         _log(
             LOG_LEVEL_ERROR,
@@ -836,436 +1218,1916 @@ int work_queue_handler( void )
         _rollback_transaction();
     }
 
+    _release_host_slot( host, host_slot );
+    PQclear( result );
+
     return 1;
 }
 
 /*
- * char * get_column_value( int row, PGresult * result, char * column_name )
- *    libpq wrapper for PQgetvalue for code simplification.
+ * void _work_queue_filters( char ** dequeue_params )
+ *     Sets the first four parameters of get_work_queue_item from the local
+ *     breaker, rate limit and host scheduling state.
  *
  * Arguments:
- *     - int row:            the row number to get the column value from.
- *     - PGresult * result:  The libpq result handle of a previously executed
- *                           query where the results are present.
- *     - char * column_name: the name of the column which contains the value
- *                           indexed by row.
+ *     - char ** dequeue_params: Parameter list for get_work_queue_item.
  * Return:
- *     char * column_value:  The string representation of the value of the column.
- *                           NULL results are returned as ANSI C NULL.
+ *     None
  * Error Conditions:
- *     None - may emit libpq errors or warnings
+ *     None
  */
-char * get_column_value( int row, PGresult * result, char * column_name )
+void _work_queue_filters( char ** dequeue_params )
 {
-    if( is_column_null( row, result, column_name ) )
+    /*
+     * Leave items for hosts with open circuit breakers, and for rate
+     * limited actions and hosts that are out of tokens, in the queue
+     */
+    if( _open_hosts_array( &open_hosts_buffer ) > 0 )
     {
-        return NULL;
+        dequeue_params[0] = open_hosts_buffer.data;
     }
 
-    return PQgetvalue(
-        result,
-        row,
-        PQfnumber(
-            result,
-            column_name
-        )
-    );
-}
+    if( _throttled_array( RATE_LIMIT_HOST, &throttled_hosts ) > 0 )
+    {
+        dequeue_params[1] = throttled_hosts.data;
+    }
 
-/*
- * bool is_column_null( int row, PGresult * result, char * column_name )
- *     checks the specified row/column for NULL
- *
- * Arguments:
- *    - int row:            The row number of the value to check.
- *    - PGresult * result:  The libpq result handle of a previously executed query.
- *    - char * column_name: the name of the column which contains the
- *                          to-be-checked value indexed by row.
- * Return:
- *    - bool is_null:       true if the row/column value is null, false otherwise.
- * Error Conditions:
- *    None - may emit libpq errors or warnings
- */
-bool is_column_null( int row, PGresult * result, char * column_name )
-{
-    if(
-        PQgetisnull(
-            result,
-            row,
-            PQfnumber(
-                result,
-                column_name
-            )
-        ) == 1 )
+    if( _throttled_array( RATE_LIMIT_ACTION, &throttled_actions ) > 0 )
     {
-        return true;
+        dequeue_params[2] = throttled_actions.data;
     }
 
-    return false;
+    // Round robin between hosts, hosts over their share of time go last
+    if( _host_schedule_array( &host_schedule ) > 0 )
+    {
+        dequeue_params[3] = host_schedule.data;
+    }
+
+    return;
 }
 
 /*
- * static size_t _curl_write_callback(
- *     void * contents,
- *     size_t size,
- *     size_t n_mem_b,
- *     void * user_p
- * )
- *     callback handler which stores CuRL results into the curl_response
- *     buffer struct.
+ * int spool_queue_handler( void )
+ *     Work queue handler used with a spool file (-S). Remote calls are
+ *     moved from tb_work_queue into the spool a batch at a time, in one
+ *     transaction, and then delivered from the spool. Items the spool does
+ *     not take are handled by work_queue_handler().
  *
  * Arguments:
- *     - void * contents:  Response contents from curl call.
- *     - size_t size:      Response contents size (length).
- *     - size_t n_mem_b:   Number of bytes of the response.
- *     - void * user_p:    Pointer to buffer struct.
+ *     None
  * Return:
- *     - size_t real_size: Size in allocated bytes of the buffer size increase.
+ *     int rows_processed: number of queue entries spooled or processed,
+ *                         0 otherwise.
  * Error Conditions:
- *     - Emits error on failure to allocate memory for buffer.
+ *     - Emits error when a batch cannot be spooled or delivered.
  */
-static size_t _curl_write_callback(
-    void * contents,
-    size_t size,
-    size_t n_mem_b,
-    void * user_p
-)
+int spool_queue_handler( void )
 {
-    size_t real_size                     = 0;
-    struct curl_response * response_page = NULL;
+    int spooled = 0;
 
-    response_page = (struct curl_response *) user_p;
+    spooled = _spool_work_queue_items();
 
-    real_size = size * n_mem_b;
-
-    response_page->pointer = realloc(
-        response_page->pointer,
-        response_page->size + real_size + 1
-    );
+    // Also delivers records recovered from a previous run
+    _deliver_spooled_items();
 
-    if( response_page->pointer == NULL )
+    if( spooled < 0 )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to allocate enough memory for URI call"
-        );
-
         return 0;
     }
 
-    memcpy(
-        &( response_page->pointer[ response_page->size ] ),
-        contents,
-        real_size
-    );
-
-    response_page->size += real_size;
-    response_page->pointer[response_page->size] = 0;
+    if( spooled > 0 )
+    {
+        return spooled;
+    }
 
-    return real_size;
+    // Query actions, and rate limited actions and hosts, are not spooled
+    return work_queue_handler();
 }
 
 /*
- * bool execute_remote_uri_call( struct action_result * )
- *     Uses CuRL to execute a remote POST, PUT, or GET request over HTTP/HTTPS
+ * int _spool_work_queue_items( void )
+ *     Moves up to spool_batch_size remote call items from tb_work_queue into
+ *     the spool. Records are synced to disk before the items are deleted,
+ *     so a crash may deliver an item twice but never loses one.
  *
  * Arguments:
- *     struct action_result * action: All available information on the action to
- *                                    be executed.
+ *     None
  * Return:
- *     - bool is_success:             True if the call happened without error,
- *                                    false otherwise.
+ *     int: Number of items spooled, -1 on failure.
  * Error Conditions:
- *     - Emits error upon failure to allocate memory.
- *     - Emits error when unsupported method passed as argument.
- *     - Can emit CuRL errors / warnings.
+ *     - Emits error when a transaction fails to BEGIN, COMMIT or ROLLBACK.
+ *     - Emits error on failure to dequeue, spool or delete the items.
  */
-bool execute_remote_uri_call( struct action_result * action )
+int _spool_work_queue_items( void )
 {
-    struct curl_response write_buffer = {0};
-    CURLcode response                 = {0};
-    char * remote_call                = NULL;
-    char * param_list                 = NULL;
-    int malloc_size                   = 2;
-
-    param_list = ( char * ) calloc( malloc_size, sizeof( char ) );
+    PGresult * result            = NULL;
+    PGresult * delete_result     = NULL;
+    char *     dequeue_params[6] = {NULL};
+    char *     params[1]         = {NULL};
+    char       batch_size[16]    = {0};
+    uint64_t   mark              = 0;
+    bool       ok                = true;
+    int        row_count         = 0;
+    int        spooled           = 0;
+    int        i                 = 0;
+    int        j                 = 0;
+
+    char * values[ACTION_FIELD_COUNT] = {NULL};
 
-    if( param_list == NULL )
+    if( !_begin_transaction() )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "Unable to allocate memory for parameters"
+            "Failed to start spool transaction"
         );
 
-        return false;
+        return -1;
     }
 
-    if( strcmp( action->method, "GET" ) == 0 )
-    {
-        strcpy( param_list, "?" );
-    }
+    _work_queue_filters( dequeue_params );
+    snprintf( batch_size, sizeof( batch_size ), "%d", spool_batch_size );
+    dequeue_params[4] = batch_size;
+    dequeue_params[5] = "t";
 
-    _add_json_parameters_to_param_list(
-        curl_handle,
-        param_list,
-        action->parameters,
-        &malloc_size
+    result = _execute_query(
+        ( char * ) get_work_queue_item,
+        dequeue_params,
+        6
     );
 
-    if( action->static_parameters != NULL )
+    if( result == NULL )
     {
-        malloc_size++;
-        param_list = ( char * ) realloc( param_list, malloc_size );
-
-        if( param_list == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Unable to allocate memory for simple string "
-                "concatenation operation :("
-            );
-            return false;
-        }
+        _log(
+            LOG_LEVEL_ERROR,
+            "Work queue dequeue operation failed"
+        );
 
-        strcat( param_list, "&" );
+        _rollback_transaction();
+        return -1;
+    }
+
+    row_count = PQntuples( result );
+
+    if( row_count == 0 )
+    {
+        _rollback_transaction();
+        PQclear( result );
+        return 0;
+    }
+
+    mark = _spool_mark( &work_spool );
+    _string_builder_reset( &spooled_ctids );
+    ok = _string_builder_append_char( &spooled_ctids, '{' );
+
+    for( i = 0; ok && i < row_count; i++ )
+    {
+        for( j = 0; j < ACTION_FIELD_SPOOLED; j++ )
+        {
+            values[j] = get_column_value( i, result, ( char * ) action_fields[j] );
+        }
+
+        // A half-open host gets a single trial call, its other items stay queued
+        if( _spooled_trial_taken( result, i ) )
+        {
+            continue;
+        }
+
+        ok = _spool_append( &work_spool, values, ACTION_FIELD_SPOOLED )
+          && ( spooled == 0 || _string_builder_append_char( &spooled_ctids, ',' ) )
+          && _string_builder_append_array_element(
+                 &spooled_ctids,
+                 get_column_value( i, result, "ctid" )
+             );
+
+        // A failed append ends the batch, which is then rolled back
+        if( ok )
+        {
+            spooled++;
+        }
+    }
+
+    PQclear( result );
+
+    ok = ok
+      && _string_builder_append_char( &spooled_ctids, '}' )
+      && _spool_sync( &work_spool );
+
+    if( ok )
+    {
+        params[0]     = spooled_ctids.data;
+        delete_result = _execute_query(
+            ( char * ) delete_spooled_items,
+            params,
+            1
+        );
+        ok            = delete_result != NULL;
+    }
+
+    if( delete_result != NULL )
+    {
+        PQclear( delete_result );
+    }
+
+    if( !ok || !_commit_transaction() )
+    {
+        /*
+         * A COMMIT lost with the connection may still have deleted the
+         * items, so their records are kept: if it did not, the items are
+         * delivered twice rather than lost.
+         */
+        if( ok && PQstatus( conn ) != CONNECTION_OK )
+        {
+            _log(
+                LOG_LEVEL_WARNING,
+                "Outcome of spooling %d work queue items is unknown, keeping their records",
+                spooled
+            );
+
+            // The connection's transaction ended with it
+            tx_in_progress = false;
+            return spooled;
+        }
+
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to move %d work queue items to the spool",
+            spooled
+        );
+
+        if( tx_in_progress )
+        {
+            _rollback_transaction();
+        }
+
+        _spool_rewind( &work_spool, mark );
+        _spool_sync( &work_spool );
+        return -1;
+    }
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Spooled %d work queue items",
+        spooled
+    );
+
+    return spooled;
+}
+
+/*
+ * bool _spooled_trial_taken( PGresult * result, int row )
+ *     Checks whether a dequeued row is for a half-open host that an
+ *     earlier row of the same batch already holds the trial call for.
+ *
+ * Arguments:
+ *     - PGresult * result: Batch dequeued for the spool.
+ *     - int row:           Row to check.
+ * Return:
+ *     bool:                true when the row should be left in the queue.
+ * Error Conditions:
+ *     None
+ */
+bool _spooled_trial_taken( PGresult * result, int row )
+{
+    struct host_state * state = NULL;
+    char *              host  = NULL;
+    char *              other = NULL;
+    int                 i     = 0;
+
+    host = get_column_value( row, result, "host" );
+
+    if( host == NULL )
+    {
+        return false;
+    }
+
+    state = _get_host_state( host );
+
+    if( state == NULL || state->breaker != BREAKER_HALF_OPEN )
+    {
+        return false;
+    }
+
+    for( i = 0; i < row; i++ )
+    {
+        other = get_column_value( i, result, "host" );
+
+        if( other != NULL && strcmp( other, host ) == 0 )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * int _deliver_spooled_items( void )
+ *     Makes the remote calls of every pending spool record. Records are
+ *     acknowledged in the mapping as they are delivered and synced once at
+ *     the end, so a crash mid-batch repeats at most that batch's calls.
+ *     Failed calls are handed back to tb_work_queue to be retried. Records
+ *     for hosts with open breakers, throttled hosts and hosts without a
+ *     free concurrency slot are left pending. Local sink lines are written
+ *     once for the batch, and their records are only acknowledged after
+ *     that write succeeds.
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     int: Number of records delivered or handed back.
+ * Error Conditions:
+ *     - Emits error, and leaves the rest of the spool for the next pass,
+ *       when a failed item cannot be returned to tb_work_queue.
+ */
+int _deliver_spooled_items( void )
+{
+    char *              values[ACTION_FIELD_COUNT] = {NULL};
+    struct host_state * state                      = NULL;
+    char *              host                       = NULL;
+    int                 host_slot                  = HOST_SLOT_NONE;
+    uint64_t *          sink_offsets               = NULL;
+    uint64_t            cursor                     = 0;
+    uint64_t            offset                     = 0;
+    bool                executed                   = false;
+    bool                written                    = true;
+    int                 sink_count                 = 0;
+    int                 delivered                  = 0;
+    int                 i                          = 0;
+
+    _string_builder_reset( &spooled_sink_acks );
+    sink_flush_deferred = true;
+
+    while( ( offset = _spool_next( &work_spool, &cursor, values, ACTION_FIELD_SPOOLED ) ) != 0 )
+    {
+        // Values point into the mapping, which must not be modified
+        for( i = 0; i < ACTION_FIELD_SPOOLED; i++ )
+        {
+            if( values[i] != NULL )
+            {
+                values[i] = _arena_strndup( &handler_arena, values[i], strlen( values[i] ) );
+            }
+        }
+
+        host      = values[ACTION_FIELD_HOST];
+        host_slot = HOST_SLOT_NONE;
+
+        /*
+         * Records wait for their host's breaker, throttle and concurrency
+         * limit as queued items do. Those that cannot be called yet stay
+         * pending for a later pass.
+         */
+        if( host != NULL )
+        {
+            state = _get_host_state( host );
+
+            if(
+                   ( state != NULL && state->breaker == BREAKER_OPEN )
+                || _is_throttled( RATE_LIMIT_HOST, host )
+              )
+            {
+                _arena_reset( &handler_arena );
+                continue;
+            }
+
+            host_slot = _acquire_host_slot( host, _concurrency_limit( state ) );
+
+            if( host_slot == HOST_SLOT_ERROR )
+            {
+                break;
+            }
+
+            if( host_slot == HOST_SLOT_NONE )
+            {
+                _throttle(
+                    RATE_LIMIT_HOST,
+                    host,
+                    state != NULL && state->latency_ms > HOST_SLOT_MIN_WAIT_MS
+                        ? ( long ) state->latency_ms
+                        : HOST_SLOT_MIN_WAIT_MS
+                );
+
+                _arena_reset( &handler_arena );
+                continue;
+            }
+        }
+
+        _clear_recorded_error();
+        executed = _execute_action_values( values );
+        _release_host_slot( host, host_slot );
+
+        if( !executed && !_requeue_spooled_item( values ) )
+        {
+            break;
+        }
+
+        if( executed && _local_sink_kind( values[ACTION_FIELD_URI] ) != SINK_NONE )
+        {
+            // The line is only buffered, the record stays pending until it is written
+            if( !_string_builder_append( &spooled_sink_acks, ( char * ) &offset, sizeof( offset ) ) )
+            {
+                break;
+            }
+        }
+        else
+        {
+            _spool_ack( &work_spool, offset );
+        }
+
+        _arena_reset( &handler_arena );
+        delivered++;
+    }
+
+    sink_flush_deferred = false;
+    sink_offsets        = ( uint64_t * ) spooled_sink_acks.data;
+    sink_count          = ( int ) ( spooled_sink_acks.length / sizeof( uint64_t ) );
+
+    if( sink_count > 0 )
+    {
+        _clear_recorded_error();
+        written = _flush_local_sinks();
+
+        if( !written )
+        {
+            _discard_local_sinks();
+        }
+    }
+
+    for( i = 0; i < sink_count; i++ )
+    {
+        cursor = sink_offsets[i];
+
+        if(
+               !written
+            && (
+                   _spool_next( &work_spool, &cursor, values, ACTION_FIELD_SPOOLED ) != sink_offsets[i]
+                || !_requeue_spooled_item( values )
+               )
+          )
+        {
+            // Left pending, to be delivered again on the next pass
+            break;
+        }
+
+        _spool_ack( &work_spool, sink_offsets[i] );
+    }
+
+    if( delivered > 0 )
+    {
+        _spool_sync( &work_spool );
+    }
+
+    return delivered;
+}
+
+/*
+ * bool _requeue_spooled_item( char ** values )
+ *     Returns a spooled item whose call failed to tb_work_queue, recording
+ *     the failed attempt so it is retried with backoff, or dead lettered.
+ *
+ * Arguments:
+ *     - char ** values: Fields of the spooled record.
+ * Return:
+ *     bool:             true when the item is back in tb_work_queue.
+ * Error Conditions:
+ *     - Emits error on failure to insert the item or schedule its retry.
+ */
+bool _requeue_spooled_item( char ** values )
+{
+    PGresult * result    = NULL;
+    char *     params[7] = {NULL};
+    int        retried   = 0;
+
+    params[0] = values[ACTION_FIELD_PARAMETERS];
+    params[1] = values[ACTION_FIELD_UID];
+    params[2] = values[ACTION_FIELD_RECORDED];
+    params[3] = values[ACTION_FIELD_TRANSACTION_LABEL];
+    params[4] = values[ACTION_FIELD_ACTION];
+    params[5] = values[ACTION_FIELD_SESSION_VALUES];
+    params[6] = values[ACTION_FIELD_ATTEMPTS];
+
+    if( !_begin_transaction() )
+    {
+        return false;
+    }
+
+    result = _execute_query(
+        ( char * ) requeue_spooled_item,
+        params,
+        7
+    );
+
+    if( result == NULL || PQntuples( result ) <= 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to return spooled item for action %s to the work queue",
+            params[4]
+        );
+
+        if( result != NULL )
+        {
+            PQclear( result );
+        }
+
+        _rollback_transaction();
+        return false;
+    }
+
+    retried = _retry_queue_item( "work", get_column_value( 0, result, "ctid" ), NULL );
+    PQclear( result );
+
+    if( !retried )
+    {
+        _rollback_transaction();
+        return false;
+    }
+
+    return _commit_transaction();
+}
+
+/*
+ * int _acquire_host_slot( char * host, int limit )
+ *     Takes one of a host's concurrency slots. Slots are session level
+ *     advisory locks, so they are shared by every daemon and outlive the
+ *     dequeue transaction until released.
+ *
+ * Arguments:
+ *     char * host: Host about to be called.
+ *     int limit:   Host's current concurrency limit.
+ * Return:
+ *     int:         Slot number, HOST_SLOT_NONE when all slots are taken,
+ *                  HOST_SLOT_ERROR on failure.
+ * Error Conditions:
+ *     - Emits error on failure to query for a slot.
+ */
+int _acquire_host_slot( char * host, int limit )
+{
+    PGresult * result           = NULL;
+    char *     params[2]        = {NULL};
+    char       limit_string[12] = {0};
+    int        slot             = HOST_SLOT_NONE;
+
+    snprintf( limit_string, sizeof( limit_string ), "%d", limit );
+    params[0] = host;
+    params[1] = limit_string;
+
+    result = _execute_query(
+        ( char * ) acquire_host_slot,
+        params,
+        2
+    );
+
+    if( result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to acquire a concurrency slot for %s",
+            host
+        );
+
+        return HOST_SLOT_ERROR;
+    }
+
+    if( PQntuples( result ) > 0 )
+    {
+        slot = atoi( get_column_value( 0, result, "slot" ) );
+    }
+    else
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "All %d concurrency slots for %s are in use",
+            limit,
+            host
+        );
+    }
+
+    PQclear( result );
+    return slot;
+}
+
+/*
+ * void _release_host_slot( char * host, int slot )
+ *     Releases a slot taken by _acquire_host_slot()
+ *
+ * Arguments:
+ *     char * host: Host the slot belongs to.
+ *     int slot:    Slot number, nothing is done for HOST_SLOT_NONE.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     - Emits warning on failure to release the slot.
+ */
+void _release_host_slot( char * host, int slot )
+{
+    PGresult * result          = NULL;
+    char *     params[2]       = {NULL};
+    char       slot_string[12] = {0};
+
+    if( slot < 0 )
+    {
+        return;
+    }
+
+    snprintf( slot_string, sizeof( slot_string ), "%d", slot );
+    params[0] = host;
+    params[1] = slot_string;
+
+    result = _execute_query(
+        ( char * ) release_host_slot,
+        params,
+        2
+    );
+
+    if( result == NULL )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to release concurrency slot %d for %s",
+            slot,
+            host
+        );
+
+        return;
+    }
+
+    PQclear( result );
+    return;
+}
+
+/*
+ * int _take_rate_tokens( char * action, char * host )
+ *     Takes a token from the action's and host's rate limit buckets, which
+ *     are shared with other daemons through tb_rate_bucket, for a dequeued
+ *     item. The tokens are only spent if the current transaction commits.
+ *     When either bucket is empty, neither is debited and the empty one is
+ *     throttled until it refills.
+ *
+ * Arguments:
+ *     char * action: Action number of the dequeued item.
+ *     char * host:   Host of the dequeued item, NULL for query actions.
+ * Return:
+ *     int:           1 if tokens were taken, 0 if the item was throttled,
+ *                    -1 on failure.
+ * Error Conditions:
+ *     - Emits error on failure to query fn_take_rate_tokens().
+ */
+int _take_rate_tokens( char * action, char * host )
+{
+    PGresult * result         = NULL;
+    char *     params[2]      = {NULL};
+    long       action_wait_ms = 0;
+    long       host_wait_ms   = 0;
+
+    params[0] = action;
+    params[1] = host;
+
+    result = _execute_query(
+        ( char * ) take_rate_tokens,
+        params,
+        2
+    );
+
+    if( result == NULL || PQntuples( result ) <= 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to take rate limit tokens for action %s",
+            action
+        );
+
+        if( result != NULL )
+        {
+            PQclear( result );
+        }
+
+        return -1;
+    }
+
+    action_wait_ms = atol( get_column_value( 0, result, "action_wait_ms" ) );
+    host_wait_ms   = atol( get_column_value( 0, result, "host_wait_ms" ) );
+    PQclear( result );
+
+    if( action_wait_ms > 0 )
+    {
+        _throttle( RATE_LIMIT_ACTION, action, action_wait_ms );
+    }
+
+    if( host_wait_ms > 0 )
+    {
+        _throttle( RATE_LIMIT_HOST, host, host_wait_ms );
+    }
+
+    return action_wait_ms == 0 && host_wait_ms == 0 ? 1 : 0;
+}
+
+/*
+ * char * _lease_work_queue_item( char * ctid, char * timeout_ms )
+ *     Leases a dequeued work queue item to this process for the length of
+ *     its remote call, plus lease_grace_ms. Once the dequeue transaction
+ *     commits the item is skipped by other daemons until the lease expires,
+ *     without a transaction or row lock held open during the call.
+ *
+ * Arguments:
+ *     char * ctid:       ctid of the item, locked by the dequeue transaction.
+ *     char * timeout_ms: Total timeout of the item's remote call.
+ * Return:
+ *     char *:            ctid of the leased item, allocated from
+ *                        handler_arena, or NULL on failure.
+ * Error Conditions:
+ *     - Emits error on failure to update the item.
+ */
+char * _lease_work_queue_item( char * ctid, char * timeout_ms )
+{
+    PGresult * result      = NULL;
+    char *     params[3]   = {NULL};
+    char *     leased_ctid = NULL;
+
+    params[0] = ctid;
+    params[1] = timeout_ms;
+    params[2] = lease_owner;
+
+    result = _execute_query(
+        ( char * ) lease_work_queue_item,
+        params,
+        3
+    );
+
+    if( result == NULL || PQntuples( result ) <= 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to lease work queue item %s",
+            ctid
+        );
+
+        if( result != NULL )
+        {
+            PQclear( result );
+        }
+
+        return NULL;
+    }
+
+    // Updating the item moved it, the ack and any retry use its new ctid
+    leased_ctid = get_column_value( 0, result, "ctid" );
+    leased_ctid = _arena_strndup( &handler_arena, leased_ctid, strlen( leased_ctid ) );
+    PQclear( result );
+
+    return leased_ctid;
+}
+
+/*
+ * int _retry_queue_item( const char * queue, char * ctid, char * leased_by )
+ *     Records a failed attempt at a queue item, after its transaction was
+ *     rolled back. fn_schedule_retry() holds the item back with exponential
+ *     backoff, or moves it to tb_dead_letter once it runs out of attempts.
+ *     A leased item is left alone if its lease passed to another daemon.
+ *
+ * Arguments:
+ *     const char * queue: 'event' or 'work'.
+ *     char * ctid:        ctid of the failed item.
+ *     char * leased_by:   Lease owner of a leased work queue item, NULL
+ *                         when the item was not leased.
+ * Return:
+ *     int:                1 when the failure was recorded, so the queue
+ *                         can keep draining past the item, 0 otherwise.
+ * Error Conditions:
+ *     - Emits error on failure to query fn_schedule_retry().
+ *     - Emits warning when an item is retried or dead lettered.
+ */
+int _retry_queue_item( const char * queue, char * ctid, char * leased_by )
+{
+    PGresult * result    = NULL;
+    char *     params[4] = {NULL};
+    long       retry_ms  = 0;
+
+    params[0] = ( char * ) queue;
+    params[1] = ctid;
+    params[2] = ( char * ) _recorded_error();
+    params[3] = leased_by;
+
+    result = _execute_query(
+        ( char * ) schedule_retry,
+        params,
+        4
+    );
+
+    if( result == NULL || PQntuples( result ) <= 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to schedule retry of %s queue item %s",
+            queue,
+            ctid
+        );
+
+        if( result != NULL )
+        {
+            PQclear( result );
+        }
+
+        return 0;
+    }
+
+    if( is_column_null( 0, result, "retry_ms" ) )
+    {
+        // Another daemon holds the item or its lease, or it has been removed
+        _log(
+            LOG_LEVEL_DEBUG,
+            "%s queue item %s is no longer queued",
+            queue,
+            ctid
+        );
+
+        PQclear( result );
+        return 1;
+    }
+
+    retry_ms = atol( get_column_value( 0, result, "retry_ms" ) );
+    PQclear( result );
+
+    if( retry_ms < 0 )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Moved %s queue item %s to the dead letter table",
+            queue,
+            ctid
+        );
+    }
+    else
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Retrying %s queue item %s in %ldms",
+            queue,
+            ctid,
+            retry_ms
+        );
+    }
+
+    return 1;
+}
+
+/*
+ * long _next_retry_timeout_ms( int (*dequeue_function)(void) )
+ *     Time until the next failed item of a queue is due to be retried
+ *
+ * Arguments:
+ *     - int (*dequeue_function)(void): Handler of the queue.
+ * Return:
+ *     long: Milliseconds until the earliest retry, -1 when no item is
+ *           waiting or on failure.
+ * Error Conditions:
+ *     - Emits error on failure to query the queue.
+ */
+long _next_retry_timeout_ms( int (*dequeue_function)(void) )
+{
+    PGresult * result   = NULL;
+    long       retry_ms = -1;
+
+    result = _execute_query(
+        ( char * ) ( dequeue_function == &event_queue_handler ? next_event_retry : next_work_retry ),
+        NULL,
+        0
+    );
+
+    if( result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to find the next queue item retry"
+        );
+
+        return -1;
+    }
+
+    if( PQntuples( result ) > 0 && !is_column_null( 0, result, "retry_ms" ) )
+    {
+        // The item may have come due since the query started
+        retry_ms = atol( get_column_value( 0, result, "retry_ms" ) );
+        retry_ms = retry_ms < 0 ? 0 : retry_ms;
+    }
+
+    PQclear( result );
+
+    return retry_ms;
+}
+
+/*
+ * char * get_column_value( int row, PGresult * result, char * column_name )
+ *    libpq wrapper for PQgetvalue for code simplification.
+ *
+ * Arguments:
+ *     - int row:            the row number to get the column value from.
+ *     - PGresult * result:  The libpq result handle of a previously executed
+ *                           query where the results are present.
+ *     - char * column_name: the name of the column which contains the value
+ *                           indexed by row.
+ * Return:
+ *     char * column_value:  The string representation of the value of the column.
+ *                           NULL results are returned as ANSI C NULL.
+ * Error Conditions:
+ *     None - may emit libpq errors or warnings
+ */
+char * get_column_value( int row, PGresult * result, char * column_name )
+{
+    if( is_column_null( row, result, column_name ) )
+    {
+        return NULL;
+    }
+
+    return PQgetvalue(
+        result,
+        row,
+        PQfnumber(
+            result,
+            column_name
+        )
+    );
+}
+
+/*
+ * bool is_column_null( int row, PGresult * result, char * column_name )
+ *     checks the specified row/column for NULL
+ *
+ * Arguments:
+ *    - int row:            The row number of the value to check.
+ *    - PGresult * result:  The libpq result handle of a previously executed query.
+ *    - char * column_name: the name of the column which contains the
+ *                          to-be-checked value indexed by row.
+ * Return:
+ *    - bool is_null:       true if the row/column value is null, false otherwise.
+ * Error Conditions:
+ *    None - may emit libpq errors or warnings
+ */
+bool is_column_null( int row, PGresult * result, char * column_name )
+{
+    if(
+        PQgetisnull(
+            result,
+            row,
+            PQfnumber(
+                result,
+                column_name
+            )
+        ) == 1 )
+    {
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * static size_t _curl_write_callback(
+ *     void * contents,
+ *     size_t size,
+ *     size_t n_mem_b,
+ *     void * user_p
+ * )
+ *     callback handler which stores CuRL results into the curl_response
+ *     buffer, according to the action's response policy:
+ *         discard: nothing is buffered.
+ *         head:    the first limit bytes are kept, the rest is drained.
+ *         store:   the body is kept, aborting the transfer past limit.
+ *
+ * Arguments:
+ *     - void * contents:  Response contents from curl call.
+ *     - size_t size:      Response contents size (length).
+ *     - size_t n_mem_b:   Number of bytes of the response.
+ *     - void * user_p:    Pointer to curl_response struct.
+ * Return:
+ *     - size_t real_size: Number of bytes consumed. Anything else aborts
+ *                         the transfer.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory for buffer.
+ *     - Emits error when a stored response exceeds its limit.
+ */
+static size_t _curl_write_callback(
+    void * contents,
+    size_t size,
+    size_t n_mem_b,
+    void * user_p
+)
+{
+    size_t real_size                 = 0;
+    size_t room                      = 0;
+    struct curl_response * response  = NULL;
+
+    response  = ( struct curl_response * ) user_p;
+    real_size = size * n_mem_b;
+
+    if( response->policy == RESPONSE_POLICY_DISCARD )
+    {
+        return real_size;
+    }
+
+    room = response->limit > response->buffer->length
+         ? response->limit - response->buffer->length
+         : 0;
+
+    if( real_size > room )
+    {
+        response->truncated = true;
+
+        if( response->policy == RESPONSE_POLICY_STORE )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Response exceeded limit of %zu bytes",
+                response->limit
+            );
+
+            return 0;
+        }
+    }
+
+    if(
+           room > 0
+        && !_string_builder_append(
+                response->buffer,
+                ( const char * ) contents,
+                real_size < room ? real_size : room
+            )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate enough memory for URI call"
+        );
+
+        return 0;
+    }
+
+    return real_size;
+}
+
+/*
+ * bool execute_local_sink_call( struct action_result * action )
+ *     Writes an action's merged session values, static parameters and
+ *     parameters, as a line of JSON, to its unix://, fifo:// or file:// URI.
+ *     The line is written, and synced for files, before the item is
+ *     acknowledged. Spooled items are instead written once per batch, by
+ *     _deliver_spooled_items().
+ *
+ * Arguments:
+ *     struct action_result * action: Action to deliver.
+ * Return:
+ *     bool is_success:               true if the line was written, or
+ *                                    buffered for a spool batch.
+ * Error Conditions:
+ *     - Emits error when the action has no JSON body.
+ *     - Emits error when the sink cannot be written.
+ */
+bool execute_local_sink_call( struct action_result * action )
+{
+    if( action->json_body == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "No parameters to write to local sink %s",
+            action->uri
+        );
+
+        return false;
+    }
+
+    if( !_local_sink_write( action->uri, action->json_body, strlen( action->json_body ) ) )
+    {
+        return false;
+    }
+
+    if( sink_flush_deferred )
+    {
+        return true;
+    }
+
+    if( !_flush_local_sinks() )
+    {
+        _discard_local_sinks();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * bool execute_remote_uri_call( struct action_result * )
+ *     Uses CuRL to execute a remote POST, PUT, or GET request over HTTP/HTTPS
+ *
+ * Arguments:
+ *     struct action_result * action: All available information on the action to
+ *                                    be executed.
+ * Return:
+ *     - bool is_success:             True if the call happened without error,
+ *                                    false otherwise.
+ * Error Conditions:
+ *     - Emits error upon failure to allocate memory.
+ *     - Emits error when unsupported method passed as argument.
+ *     - Can emit CuRL errors / warnings.
+ */
+bool execute_remote_uri_call( struct action_result * action )
+{
+    struct curl_response write_buffer = {0};
+    long status_code                  = 0;
+    CURLcode response                 = {0};
+    size_t list_start                 = 0;
+    bool json_body                    = false;
+    struct string_builder * body      = &request_buffer;
+    struct curl_slist * headers       = NULL;
+    int compression                   = COMPRESSION_NONE;
+    bool performed                    = false;
+    double total_time                 = 0;
+    long hedge_after_ms               = -1;
+    struct host_state * host          = NULL;
+
+    _string_builder_reset( &request_buffer );
+    _set_deadline( &action->deadline, action->timeout_ms );
+
+    json_body = action->body_format != NULL
+             && strcmp( action->body_format, "json" ) == 0
+             && strcmp( action->method, "GET" ) != 0;
+
+    // GET requests carry the parameter list in the URL, PUT / POST in the body
+    if( strcmp( action->method, "GET" ) == 0 )
+    {
+        if(
+               !_string_builder_append( &request_buffer, action->uri, strlen( action->uri ) )
+            || !_string_builder_append_char( &request_buffer, '?' )
+          )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Unable to allocate memory for remote call"
+            );
+
+            return false;
+        }
+
+        list_start = request_buffer.length;
+    }
+
+    if( json_body )
+    {
+        // Merged server side, sent as-is with no per-value escaping
+        if(
+               action->json_body == NULL
+            || !_string_builder_append(
+                    &request_buffer,
+                    action->json_body,
+                    strlen( action->json_body )
+                )
+          )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to build JSON request body"
+            );
+            return false;
+        }
+    }
+    else if(
+           !_add_json_parameters_to_param_list(
+                &request_buffer,
+                list_start,
+                action->parameters_json
+            )
+        || !_add_json_parameters_to_param_list(
+                &request_buffer,
+                list_start,
+                action->static_parameters_json
+            )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to substitute parameters in URI parameter list"
+        );
+        return false;
+    }
+
+    if(
+           !json_body
+        && !_add_json_parameters_to_param_list(
+                &request_buffer,
+                list_start,
+                action->session_values_json
+            )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to substitute session_values in URI parameter list"
+        );
+        return false;
+    }
+
+    // An empty parameter list still needs a (blank) buffer to send
+    if( request_buffer.data == NULL && !_string_builder_reserve( &request_buffer, 0 ) )
+    {
+        return false;
+    }
 
-        _add_json_parameters_to_param_list(
-            curl_handle,
-            param_list,
-            action->static_parameters,
-            &malloc_size
+    if( !enable_curl )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Could not make remote API call: %s, curl is disabled",
+            action->uri
         );
 
-        if( param_list == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to substitute parameters in URI parameter list"
-            );
-            return false;
-        }
+        return false;
     }
 
-    if( action->session_values != NULL )
+    //Get: CURLOPT_HTTPGET
+    //Post: CURLOPT_POST
+    //Put: CURLOPT_POST with a PUT custom request, so the body is sent from
+    //     CURLOPT_POSTFIELDS rather than a read callback
+    curl_easy_setopt( curl_handle, CURLOPT_CUSTOMREQUEST, NULL );
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Curl is enabled, setting method to %s",
+        action->method
+    );
+
+    if( strcmp( action->method, "GET" ) == 0 )
     {
-        malloc_size++;
-        param_list = ( char * ) realloc( param_list, malloc_size );
+        _log( LOG_LEVEL_DEBUG, "Setting GET method" );
+        response = curl_easy_setopt( curl_handle, CURLOPT_HTTPGET, 1 );
+    }
+    else if( strcmp( action->method, "PUT" ) == 0 )
+    {
+        _log( LOG_LEVEL_DEBUG, "Setting PUT method" );
+        response = curl_easy_setopt( curl_handle, CURLOPT_POST, 1 );
 
-        if( param_list == NULL )
+        if( response == CURLE_OK )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Unable to allocate memory for simple string"
-                "concatenation operation :("
-            );
-            return false;
+            response = curl_easy_setopt( curl_handle, CURLOPT_CUSTOMREQUEST, "PUT" );
         }
+    }
+    else if( strcmp( action->method, "POST" ) == 0 )
+    {
+        _log( LOG_LEVEL_DEBUG, "Setting POST method" );
+        response = curl_easy_setopt( curl_handle, CURLOPT_POST, 1 );
+    }
+    else
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Unsupported method: %s",
+            action->method
+        );
+
+        return false;
+    }
+
+    if( response != CURLE_OK )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to set curl method: %s",
+            curl_easy_strerror( response )
+        );
+        return false;
+    }
 
-        strcat( param_list, "&" );
+    if( strcmp( action->method, "GET" ) == 0 )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Making remote call to URI: %s",
+            request_buffer.data
+        );
 
-        _add_json_parameters_to_param_list(
+        response = curl_easy_setopt(
             curl_handle,
-            param_list,
-            action->session_values,
-            &malloc_size
+            CURLOPT_URL,
+            request_buffer.data
         );
+    }
+    else
+    {
+        if( json_body )
+        {
+            headers = curl_slist_append( headers, "Content-Type: application/json" );
+        }
 
-        if( param_list == NULL )
+        compression = _compression_method( action->body_compression );
+
+        if(
+               compression != COMPRESSION_NONE
+            && request_buffer.length >= ( size_t ) action->compress_min_size
+          )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to substitute session_values in URI parameter list"
-            );
-            return false;
+            if(
+                _compress_buffer(
+                    compression,
+                    request_buffer.data,
+                    request_buffer.length,
+                    &compressed_buffer
+                )
+              )
+            {
+                _log(
+                    LOG_LEVEL_INFO,
+                    "Compressed %s body for action %s: %zu -> %zu bytes (%.1f%%)",
+                    action->body_compression,
+                    action->action,
+                    request_buffer.length,
+                    compressed_buffer.length,
+                    100.0 * compressed_buffer.length / request_buffer.length
+                );
+
+                body    = &compressed_buffer;
+                headers = curl_slist_append(
+                    headers,
+                    _compression_encoding( compression )
+                );
+            }
+            else
+            {
+                _log(
+                    LOG_LEVEL_WARNING,
+                    "Failed to compress body for action %s, sending uncompressed",
+                    action->action
+                );
+            }
         }
+
+        // Set post fields for PUT / POST
+        curl_easy_setopt(
+            curl_handle,
+            CURLOPT_POSTFIELDSIZE,
+            ( long ) body->length
+        );
+
+        curl_easy_setopt(
+            curl_handle,
+            CURLOPT_POSTFIELDS,
+            body->data
+        );
+
+        response = curl_easy_setopt(
+            curl_handle,
+            CURLOPT_URL,
+            action->uri
+        );
     }
 
-    if( enable_curl )
+    if( !_prepare_curl_request( curl_handle, action, &headers ) )
+    {
+        curl_slist_free_all( headers );
+        return false;
+    }
+
+    // Always set, so headers from a previous call are cleared
+    curl_easy_setopt( curl_handle, CURLOPT_HTTPHEADER, headers );
+
+    if( action->use_ssl )
+    {
+        response = curl_easy_setopt(
+            curl_handle,
+            CURLOPT_USE_SSL,
+            CURLUSESSL_TRY
+        );
+    }
+
+    // Initialize buffer
+    _string_builder_reset( &response_buffer );
+    write_buffer.buffer = &response_buffer;
+    write_buffer.policy = _response_policy( action->response_policy );
+    write_buffer.limit  = ( size_t ) action->response_limit;
+
+    _log( LOG_LEVEL_DEBUG, "Setting writer callback" );
+    response = curl_easy_setopt(
+        curl_handle,
+        CURLOPT_WRITEFUNCTION,
+        _curl_write_callback
+    );
+
+    response = curl_easy_setopt(
+        curl_handle,
+        CURLOPT_WRITEDATA,
+        ( void * ) &write_buffer
+    );
+
+    host           = _get_host_state( action->host );
+    hedge_after_ms = _hedge_delay_ms( action, host );
+
+    if( response == CURLE_OK )
     {
-        //Get: CURLOPT_HTTPGET
-        //Post: CURLOPT_POST
-        //Put: CURLOPT_PUT
         _log(
             LOG_LEVEL_DEBUG,
-            "Curl is enabled, setting method to %s",
-            action->method
+            "Making %s call with param list %s",
+            action->method,
+            request_buffer.data + list_start
         );
 
-        if( strcmp( action->method, "GET" ) == 0 )
-        {
-            _log( LOG_LEVEL_DEBUG, "Setting GET method" );
-            response = curl_easy_setopt( curl_handle, CURLOPT_HTTPGET, 1 );
-        }
-        else if( strcmp( action->method, "PUT" ) == 0 )
+        if( hedge_after_ms >= 0 )
         {
-            _log( LOG_LEVEL_DEBUG, "Setting PUT method" );
-            response = curl_easy_setopt( curl_handle, CURLOPT_PUT, 1 );
+            response = _perform_hedged(
+                action,
+                headers,
+                hedge_after_ms,
+                &write_buffer,
+                &status_code,
+                &total_time
+            );
         }
-        else if( strcmp( action->method, "POST" ) == 0 )
+        else
         {
-            _log( LOG_LEVEL_DEBUG, "Setting POST method" );
-            response = curl_easy_setopt( curl_handle, CURLOPT_POST, 1 );
+            response = curl_easy_perform( curl_handle );
+            curl_easy_getinfo( curl_handle, CURLINFO_RESPONSE_CODE, &status_code );
+            curl_easy_getinfo( curl_handle, CURLINFO_TOTAL_TIME, &total_time );
         }
-        else
+
+        performed = true;
+        hedge_calls++;
+    }
+
+    curl_easy_setopt( curl_handle, CURLOPT_HTTPHEADER, NULL );
+    curl_slist_free_all( headers );
+
+    /*
+     * Transport errors and server errors count against the host's breaker,
+     * timeouts and overload responses shrink its concurrency limit, and
+     * the call's duration counts towards the host's share of daemon time
+     */
+    if( performed )
+    {
+        _record_host_result(
+            host,
+            response == CURLE_OK && status_code < 500,
+            ( long ) ( total_time * 1000 )
+        );
+
+        _adjust_concurrency(
+            host,
+               response == CURLE_OPERATION_TIMEDOUT
+            || status_code == 429
+            || status_code == 503,
+            ( long ) ( total_time * 1000 )
+        );
+
+        _record_host_busy( host, ( long ) ( total_time * 1000 ) );
+    }
+
+    if( response != CURLE_OK )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed %s %s: %s",
+            action->method,
+            action->uri,
+            curl_easy_strerror( response )
+        );
+
+        return false;
+    }
+
+    // The status line is parsed by curl, independent of the body
+    if( status_code >= 400 && fail_on_http_error )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed %s %s: HTTP %ld, response: '%s'%s",
+            action->method,
+            action->uri,
+            status_code,
+            response_buffer.data == NULL ? "" : response_buffer.data,
+            write_buffer.truncated ? " (truncated)" : ""
+        );
+
+        return false;
+    }
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Got HTTP %ld response: '%s'%s",
+        status_code,
+        response_buffer.data == NULL ? "" : response_buffer.data,
+        write_buffer.truncated ? " (truncated)" : ""
+    );
+
+    return true;
+}
+
+/*
+ * long _hedge_delay_ms( struct action_result * action, struct host_state * host )
+ *     Decides whether a call should be hedged, and after how long
+ *
+ * Arguments:
+ *     struct action_result * action: Action about to be called. Only
+ *                                    idempotent actions with a
+ *                                    hedge_percentile are hedged.
+ *     struct host_state * host:      Destination host.
+ * Return:
+ *     long: Milliseconds after which a duplicate request is sent, -1 when
+ *           the call should not be hedged.
+ * Error Conditions:
+ *     None
+ */
+long _hedge_delay_ms( struct action_result * action, struct host_state * host )
+{
+    long percentile_ms = 0;
+
+    if( action->hedge_percentile <= 0 || host == NULL )
+    {
+        return -1;
+    }
+
+    // Budget counts are halved periodically so they reflect recent calls
+    if( hedge_calls >= HEDGE_BUDGET_WINDOW )
+    {
+        hedge_calls = hedge_calls / 2;
+        hedges_sent = hedges_sent / 2;
+    }
+
+    if( hedges_sent + 1 > hedge_budget * ( hedge_calls + 1 ) )
+    {
+        return -1;
+    }
+
+    percentile_ms = _latency_percentile_ms( host, action->hedge_percentile );
+
+    if( percentile_ms < 0 || percentile_ms >= _remaining_ms( &action->deadline ) )
+    {
+        return -1;
+    }
+
+    return percentile_ms;
+}
+
+/*
+ * CURLcode _perform_hedged(
+ *     struct action_result * action,
+ *     struct curl_slist * headers,
+ *     long hedge_after_ms,
+ *     struct curl_response * write_buffer,
+ *     long * status_code,
+ *     double * total_time
+ * )
+ *     Performs the request prepared on curl_handle through curl_multi. If it
+ *     has not completed after hedge_after_ms, a duplicate is sent on a copy
+ *     of the handle; the first successful response is used and the other
+ *     transfer is cancelled. The winning response ends up in the buffer of
+ *     write_buffer either way. The copy is prepared again, so it carries
+ *     the time left before the deadline when it is sent.
+ *
+ * Arguments:
+ *     struct action_result * action:       Action being called.
+ *     struct curl_slist * headers:         Request headers of curl_handle.
+ *     long hedge_after_ms:                 Delay before the duplicate.
+ *     struct curl_response * write_buffer: Response buffer of curl_handle.
+ *     long * status_code:                  Set to the winning HTTP status.
+ *     double * total_time:                 Set to the call's duration, in
+ *                                          seconds.
+ * Return:
+ *     CURLcode:                            Result of the winning transfer.
+ * Error Conditions:
+ *     - Emits error on curl multi interface failures.
+ *     - Falls back to a single transfer when the duplicate cannot be made.
+ */
+CURLcode _perform_hedged(
+    struct action_result * action,
+    struct curl_slist * headers,
+    long hedge_after_ms,
+    struct curl_response * write_buffer,
+    long * status_code,
+    double * total_time
+)
+{
+    CURL *                hedge_handle    = NULL;
+    CURL *                winner          = NULL;
+    struct curl_slist *   hedge_headers   = NULL;
+    struct curl_slist *   header          = NULL;
+    CURL *                failed          = NULL;
+    CURLMsg *             message         = NULL;
+    CURLMcode             multi_response  = CURLM_OK;
+    CURLcode              response        = CURLE_OK;
+    CURLcode              failed_response = CURLE_OK;
+    struct curl_response  hedge_write     = {0};
+    struct string_builder swap            = {0};
+    struct timeval        started         = {0};
+    struct timeval        hedge_at        = {0};
+    struct timeval        now             = {0};
+    bool                  hedged          = false;
+    long                  wait_ms         = 0;
+    int                   running         = 0;
+    int                   queued          = 0;
+
+    if( curl_multi == NULL && ( curl_multi = curl_multi_init() ) == NULL )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to create curl multi handle, sending request unhedged"
+        );
+
+        response = curl_easy_perform( curl_handle );
+        curl_easy_getinfo( curl_handle, CURLINFO_RESPONSE_CODE, status_code );
+        curl_easy_getinfo( curl_handle, CURLINFO_TOTAL_TIME, total_time );
+        return response;
+    }
+
+    gettimeofday( &started, NULL );
+    _set_deadline( &hedge_at, ( int ) hedge_after_ms );
+    curl_multi_add_handle( curl_multi, curl_handle );
+
+    while( winner == NULL )
+    {
+        multi_response = curl_multi_perform( curl_multi, &running );
+
+        if( multi_response != CURLM_OK )
         {
             _log(
                 LOG_LEVEL_ERROR,
-                "Unsupported method: %s",
-                action->method
+                "Hedged request failed: %s",
+                curl_multi_strerror( multi_response )
             );
 
-            return false;
+            response = CURLE_SEND_ERROR;
+            break;
         }
 
-        if( response != CURLE_OK )
+        while( ( message = curl_multi_info_read( curl_multi, &queued ) ) != NULL )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to set curl method: %s",
-                curl_easy_strerror( response )
-            );
-            return false;
+            if( message->msg != CURLMSG_DONE )
+            {
+                continue;
+            }
+
+            if( message->data.result == CURLE_OK )
+            {
+                winner   = message->easy_handle;
+                response = CURLE_OK;
+                break;
+            }
+
+            failed          = message->easy_handle;
+            failed_response = message->data.result;
         }
 
-        // Initialize buffer
-        write_buffer.pointer = malloc( 1 );
-        write_buffer.size = 0;
+        // A failure only stands once nothing else is in flight
+        if( winner == NULL && running == 0 && failed != NULL )
+        {
+            winner   = failed;
+            response = failed_response;
+        }
 
-        if( strcmp( action->method, "GET" ) == 0 )
+        if( winner != NULL )
         {
-            _log( LOG_LEVEL_DEBUG, "Setting URL to remote_call" );
-            remote_call = ( char * ) calloc(
-                ( strlen( action->uri ) + strlen( param_list ) + 1 ),
-                sizeof( char )
-            );
+            break;
+        }
+
+        if( !hedged && _remaining_ms( &hedge_at ) <= 0 )
+        {
+            hedged       = true;
+            hedge_handle = curl_easy_duphandle( curl_handle );
 
-            if( remote_call == NULL )
+            if( hedge_handle == NULL )
             {
                 _log(
-                    LOG_LEVEL_ERROR,
-                    "Unable to prep final remote call string"
+                    LOG_LEVEL_WARNING,
+                    "Failed to copy curl handle for hedged request"
                 );
-                free( param_list );
-                free( write_buffer.pointer );
-                return false;
             }
+            else
+            {
+                // The copy shares curl_handle's headers, whose deadline is stale by now
+                for( header = headers; header != NULL; header = header->next )
+                {
+                    if( strncmp( header->data, DEADLINE_HEADER ":", strlen( DEADLINE_HEADER ":" ) ) != 0 )
+                    {
+                        hedge_headers = curl_slist_append( hedge_headers, header->data );
+                    }
+                }
+
+                if( _prepare_curl_request( hedge_handle, action, &hedge_headers ) )
+                {
+                    _string_builder_reset( &hedge_buffer );
+                    hedge_write.buffer = &hedge_buffer;
+                    hedge_write.policy = write_buffer->policy;
+                    hedge_write.limit  = write_buffer->limit;
+
+                    curl_easy_setopt( hedge_handle, CURLOPT_WRITEDATA, ( void * ) &hedge_write );
+                    curl_easy_setopt( hedge_handle, CURLOPT_HTTPHEADER, hedge_headers );
+
+                    curl_multi_add_handle( curl_multi, hedge_handle );
+                    hedges_sent++;
+
+                    _log(
+                        LOG_LEVEL_DEBUG,
+                        "No response from %s after %ldms, sending hedged request",
+                        action->uri,
+                        hedge_after_ms
+                    );
+
+                    continue;
+                }
+
+                // Past the deadline, the original request is left to time out
+                curl_easy_cleanup( hedge_handle );
+                hedge_handle = NULL;
+            }
+        }
 
-            strcpy( remote_call, action->uri );
-            strcat( remote_call, param_list );
+        wait_ms = hedged ? HEDGE_POLL_MS : _remaining_ms( &hedge_at );
 
-            _log(
-                LOG_LEVEL_DEBUG,
-                "Making remote call to URI: %s",
-                remote_call
-            );
-        }
-        else
+        if( wait_ms < 0 || wait_ms > HEDGE_POLL_MS )
         {
-            // Set post fields for PUT / POST
-            remote_call = action->uri;
-            curl_easy_setopt(
-                curl_handle,
-                CURLOPT_POSTFIELDS,
-                param_list
-            );
+            wait_ms = HEDGE_POLL_MS;
         }
 
-        if( action->use_ssl )
-        {
-            response = curl_easy_setopt(
-                curl_handle,
-                CURLOPT_USE_SSL,
-                CURLUSESSL_TRY
-            );
-        }
+        curl_multi_wait( curl_multi, NULL, 0, ( int ) wait_ms, NULL );
+    }
 
-        response = curl_easy_setopt(
-            curl_handle,
-            CURLOPT_URL,
-            remote_call
-        );
+    gettimeofday( &now, NULL );
+    *total_time = ( now.tv_sec - started.tv_sec )
+                + ( now.tv_usec - started.tv_usec ) / 1000000.0;
 
-        _log( LOG_LEVEL_DEBUG, "Setting writer callback" );
-        response = curl_easy_setopt(
-            curl_handle,
-            CURLOPT_WRITEFUNCTION,
-            _curl_write_callback
-        );
+    if( winner != NULL )
+    {
+        curl_easy_getinfo( winner, CURLINFO_RESPONSE_CODE, status_code );
+    }
 
-        response = curl_easy_setopt(
-            curl_handle,
-            CURLOPT_WRITEDATA,
-            ( void * ) &write_buffer
+    if( winner != NULL && winner == hedge_handle )
+    {
+        swap                    = response_buffer;
+        response_buffer         = hedge_buffer;
+        hedge_buffer            = swap;
+        write_buffer->truncated = hedge_write.truncated;
+
+        _log(
+            LOG_LEVEL_INFO,
+            "Hedged request to %s answered first",
+            action->uri
         );
+    }
 
-        if( response == CURLE_OK )
-        {
-            _log(
-                LOG_LEVEL_DEBUG,
-                "Making %s call with param list %s",
-                action->method,
-                param_list
-            );
-            response = curl_easy_perform( curl_handle );
-        }
+    // Removing a handle cancels its transfer if still running
+    curl_multi_remove_handle( curl_multi, curl_handle );
+
+    if( hedge_handle != NULL )
+    {
+        curl_multi_remove_handle( curl_multi, hedge_handle );
+        curl_easy_cleanup( hedge_handle );
+    }
+
+    curl_slist_free_all( hedge_headers );
+
+    return response;
+}
 
-        free( param_list );
+/*
+ * int _response_policy( char * policy )
+ *     Maps a tb_action.response_policy value to a RESPONSE_POLICY_* constant
+ *
+ * Arguments:
+ *     char * policy: 'discard', 'head' or 'store'.
+ * Return:
+ *     int: RESPONSE_POLICY_* constant, RESPONSE_POLICY_HEAD when unknown.
+ * Error Conditions:
+ *     None
+ */
+int _response_policy( char * policy )
+{
+    if( policy == NULL )
+    {
+        return RESPONSE_POLICY_HEAD;
+    }
 
-        if( response != CURLE_OK )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed %s %s: %s",
-                action->method,
-                remote_call,
-                curl_easy_strerror( response )
-            );
+    if( strcmp( policy, "discard" ) == 0 )
+    {
+        return RESPONSE_POLICY_DISCARD;
+    }
 
-            free( write_buffer.pointer );
-            if( strcmp( action->method, "GET" ) == 0 )
-            {
-                free( remote_call );
-            }
-            return false;
-        }
+    if( strcmp( policy, "store" ) == 0 )
+    {
+        return RESPONSE_POLICY_STORE;
+    }
 
-        _log(
-            LOG_LEVEL_DEBUG,
-            "Got response: '%s'",
-            write_buffer.pointer
-        );
+    return RESPONSE_POLICY_HEAD;
+}
 
-        free( write_buffer.pointer );
+/*
+ * bool _prepare_curl_request(
+ *     CURL * handle,
+ *     struct action_result * action,
+ *     struct curl_slist ** headers
+ * )
+ *     Applies an action's timeouts to a handle about to be performed, and
+ *     adds the remaining time before its deadline as a request header so
+ *     downstream services can shed work they cannot finish in time. Every
+ *     handle performing a remote call must be prepared with this.
+ *
+ * Arguments:
+ *     CURL * handle:                 Handle to prepare.
+ *     struct action_result * action: Action being executed, with its deadline
+ *                                    set by _set_deadline().
+ *     struct curl_slist ** headers:  Request header list, appended to.
+ * Return:
+ *     bool:                          false if the deadline has already
+ *                                    passed.
+ * Error Conditions:
+ *     - Emits error when the deadline has passed.
+ */
+bool _prepare_curl_request(
+    CURL * handle,
+    struct action_result * action,
+    struct curl_slist ** headers
+)
+{
+    long remaining_ms = 0;
+    char deadline_header[64] = {0};
 
-        if( strcmp( action->method, "GET" ) == 0 )
-        {
-            free( remote_call );
-        }
+    remaining_ms = _remaining_ms( &action->deadline );
 
-        return true;
-    }
-    else
+    if( remaining_ms <= 0 )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "Could not make remote API call: %s, curl is disabled",
-            remote_call
+            "Deadline passed before %s %s could be sent",
+            action->method,
+            action->uri
         );
 
-        if( strcmp( action->method, "GET" ) == 0 )
-        {
-            free( remote_call );
-        }
-
         return false;
     }
 
-    if( strcmp( action->method, "GET" ) == 0 )
+    curl_easy_setopt(
+        handle,
+        CURLOPT_CONNECTTIMEOUT_MS,
+        action->connect_timeout_ms < remaining_ms
+            ? ( long ) action->connect_timeout_ms
+            : remaining_ms
+    );
+
+    curl_easy_setopt( handle, CURLOPT_TIMEOUT_MS, remaining_ms );
+    curl_easy_setopt( handle, CURLOPT_LOW_SPEED_LIMIT, low_speed_limit );
+    curl_easy_setopt( handle, CURLOPT_LOW_SPEED_TIME, low_speed_time );
+
+    snprintf(
+        deadline_header,
+        sizeof( deadline_header ),
+        DEADLINE_HEADER ": %ld",
+        remaining_ms
+    );
+
+    *headers = curl_slist_append( *headers, deadline_header );
+
+    return true;
+}
+
+/*
+ * void _set_deadline( struct timeval * deadline, int timeout_ms )
+ *     Sets deadline to timeout_ms milliseconds from now
+ *
+ * Arguments:
+ *     struct timeval * deadline: Deadline to set.
+ *     int timeout_ms:            Milliseconds until the deadline.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _set_deadline( struct timeval * deadline, int timeout_ms )
+{
+    gettimeofday( deadline, NULL );
+
+    deadline->tv_sec  = deadline->tv_sec + timeout_ms / 1000;
+    deadline->tv_usec = deadline->tv_usec + ( timeout_ms % 1000 ) * 1000;
+
+    if( deadline->tv_usec >= 1000000 )
     {
-        free( remote_call );
+        deadline->tv_sec++;
+        deadline->tv_usec = deadline->tv_usec - 1000000;
     }
 
-    return true;
+    return;
+}
+
+/*
+ * long _remaining_ms( struct timeval * deadline )
+ *     Milliseconds left until deadline
+ *
+ * Arguments:
+ *     struct timeval * deadline: Deadline set by _set_deadline().
+ * Return:
+ *     long: Milliseconds remaining, zero or negative once passed.
+ * Error Conditions:
+ *     None
+ */
+long _remaining_ms( struct timeval * deadline )
+{
+    struct timeval now = {0};
+
+    gettimeofday( &now, NULL );
+
+    return ( deadline->tv_sec - now.tv_sec ) * 1000
+         + ( deadline->tv_usec - now.tv_usec ) / 1000;
 }
 
 /*
@@ -1287,7 +3149,14 @@ bool execute_action_query( struct action_result * action )
     PGresult * action_result;
     struct query * action_query;
 
-    action_query = _new_query( action->query );
+    action_query = _new_query_from_template(
+        &handler_arena,
+        _get_query_template(
+            QUERY_TEMPLATE_ACTION,
+            action->action,
+            action->query
+        )
+    );
 
     if( action_query == NULL )
     {
@@ -1298,7 +3167,7 @@ bool execute_action_query( struct action_result * action )
         return false;
     }
 
-    set_session_gucs( action->session_values );
+    set_session_gucs( action->session_values_json );
     _add_parameter_to_query(
         action_query,
         "uid",
@@ -1321,28 +3190,23 @@ bool execute_action_query( struct action_result * action )
 
     _add_json_parameter_to_query(
         action_query,
-        action->parameters,
+        action->parameters_json,
         ( char * ) NULL
     );
 
     _add_json_parameter_to_query(
         action_query,
-        action->static_parameters,
+        action->static_parameters_json,
         ( char * ) NULL
     );
 
     _add_json_parameter_to_query(
         action_query,
-        action->session_values,
+        action->session_values_json,
         ( char * ) NULL
     );
 
-    _finalize_query( action_query );
-
-    // Set UID
-    set_uid( action->uid, action->session_values );
-
-    if( action_query == NULL )
+    if( !_finalize_query( action_query ) )
     {
         _log(
             LOG_LEVEL_ERROR,
@@ -1351,6 +3215,9 @@ bool execute_action_query( struct action_result * action )
         return false;
     }
 
+    // Set UID
+    set_uid( action->uid, action->session_values_json );
+
     // Execute query_copy
     _log(
         LOG_LEVEL_DEBUG,
@@ -1358,29 +3225,349 @@ bool execute_action_query( struct action_result * action )
         action_query->query_string
     );
 
-    _log( LOG_LEVEL_DEBUG, "ACTION QUERY: " );
-    _debug_struct( action_query );
+    _log( LOG_LEVEL_DEBUG, "ACTION QUERY: " );
+    _debug_struct( action_query );
+
+    action_result = _execute_query(
+        action_query->query_string,
+        action_query->_bind_list,
+        action_query->_bind_count
+    );
+
+
+    if( action_result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to perform action query"
+        );
+
+        return false;
+    }
+
+    clear_session_gucs( action->session_values_json );
+    PQclear( action_result );
+    return true;
+}
+
+/*
+ * struct function_call * _prepare_function_call( char * function )
+ *     Returns the prepared call for a function action, reading the
+ *     function's input arguments from the catalog and preparing its call the
+ *     first time it is used in this session.
+ *
+ * Arguments:
+ *     char * function:        Function OID, as text.
+ * Return:
+ *     struct function_call *: Prepared call, or NULL on failure.
+ * Error Conditions:
+ *     - Emits error when the function is not in the catalog.
+ *     - Emits error on failure to prepare the call.
+ */
+struct function_call * _prepare_function_call( char * function )
+{
+    struct function_call * call           = NULL;
+    PGresult *             result         = NULL;
+    PGresult *             prepare_result = NULL;
+    char *                 params[1]      = {NULL};
+    int                    arg_count      = 0;
+    int                    i              = 0;
+    bool                   ok             = false;
+
+    call = _get_function_call( function );
+
+    if( call != NULL && call->backend_pid == PQbackendPID( conn ) )
+    {
+        return call;
+    }
+
+    params[0] = function;
+    result    = _execute_query(
+        ( char * ) get_function_arguments,
+        params,
+        1
+    );
+
+    if( result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to look up arguments of function %s",
+            function
+        );
+
+        return NULL;
+    }
+
+    if( PQntuples( result ) == 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Function %s is not in catalog",
+            function
+        );
+
+        PQclear( result );
+        return NULL;
+    }
+
+    // A function without input arguments returns a single row of NULLs
+    if( !is_column_null( 0, result, "arg_type" ) )
+    {
+        arg_count = PQntuples( result );
+    }
+
+    call = _new_function_call( function, arg_count );
+    ok   = ( call != NULL );
+
+    for( i = 0; ok && i < arg_count; i++ )
+    {
+        ok = _set_function_argument(
+            call,
+            i,
+            get_column_value( i, result, "arg_name" ),
+            ( Oid ) strtoul( get_column_value( i, result, "arg_type" ), NULL, 10 )
+        );
+    }
+
+    if( ok )
+    {
+        prepare_result = PQprepare(
+            conn,
+            call->statement,
+            get_column_value( 0, result, "call" ),
+            arg_count,
+            call->arg_types
+        );
+
+        if( PQresultStatus( prepare_result ) != PGRES_COMMAND_OK )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to prepare call of function %s: %s",
+                function,
+                PQerrorMessage( conn )
+            );
+
+            ok = false;
+        }
+
+        PQclear( prepare_result );
+    }
+
+    PQclear( result );
+
+    if( !ok )
+    {
+        return NULL;
+    }
+
+    call->backend_pid = PQbackendPID( conn );
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Prepared %s for function %s with %d arguments",
+        call->statement,
+        function,
+        arg_count
+    );
+
+    return call;
+}
+
+/*
+ * Finds the value for a named function argument, from the same sources and
+ * in the same order as action query bindpoints. String members passed to
+ * json or jsonb arguments are quoted again, so they stay JSON strings.
+ * Sets value to NULL when there is none, and returns false on failure.
+ */
+bool _function_argument_value(
+    struct action_result * action,
+    char * name,
+    Oid type,
+    char ** value
+)
+{
+    struct json_object * sources[3] = {NULL};
+    struct json_member * member     = NULL;
+    char *               quoted     = NULL;
+    int                  i          = 0;
+
+    *value = NULL;
+
+    if( name == NULL )
+    {
+        return true;
+    }
+
+    if( strcmp( name, "uid" ) == 0 )
+    {
+        *value = action->uid;
+        return true;
+    }
+
+    if( strcmp( name, "recorded" ) == 0 )
+    {
+        *value = action->recorded;
+        return true;
+    }
+
+    if( strcmp( name, "transaction_label" ) == 0 )
+    {
+        *value = action->transaction_label;
+        return true;
+    }
+
+    sources[0] = action->parameters_json;
+    sources[1] = action->static_parameters_json;
+    sources[2] = action->session_values_json;
+
+    for( i = 0; i < 3; i++ )
+    {
+        if( sources[i] == NULL )
+        {
+            continue;
+        }
+
+        member = _json_object_get( sources[i], name, strlen( name ) );
+
+        if( member == NULL )
+        {
+            continue;
+        }
+
+        if(
+               member->type != JSMN_STRING
+            || ( type != FUNCTION_JSONOID && type != FUNCTION_JSONBOID )
+          )
+        {
+            *value = member->is_null ? NULL : member->value;
+            return true;
+        }
+
+        // The value is still escaped as it was in the JSON document
+        quoted = ( char * ) _arena_alloc( &handler_arena, member->value_length + 3 );
+
+        if( quoted == NULL )
+        {
+            return false;
+        }
+
+        quoted[0] = '"';
+        memcpy( quoted + 1, member->value, member->value_length );
+        quoted[member->value_length + 1] = '"';
+        quoted[member->value_length + 2] = '\0';
+
+        *value = quoted;
+        return true;
+    }
+
+    return true;
+}
+
+/*
+ * bool execute_action_function( struct action_result * )
+ *     Executes a function action through its prepared call, passing each
+ *     input argument the value with its name.
+ *
+ * Arguments:
+ *     struct action_result *: All available information related to the action to
+ *                             be executed.
+ * Return:
+ *     bool is_success:        true if the function call completed
+ *                             successfully, false otherwise.
+ * Error Conditions:
+ *     - Emits error on failure to prepare the call.
+ *     - Emits error on failure to allocate memory.
+ *     - Emits error when the function call fails.
+ */
+bool execute_action_function( struct action_result * action )
+{
+    struct function_call * call    = NULL;
+    PGresult *             result  = NULL;
+    char **                values  = NULL;
+    char *                 value   = NULL;
+    int *                  lengths = NULL;
+    int *                  formats = NULL;
+    int                    i       = 0;
+
+    call = _prepare_function_call( action->function );
+
+    if( call == NULL )
+    {
+        return false;
+    }
+
+    if( call->arg_count > 0 )
+    {
+        values  = ( char ** ) _arena_alloc( &handler_arena, sizeof( char * ) * call->arg_count );
+        lengths = ( int * ) _arena_alloc( &handler_arena, sizeof( int ) * call->arg_count );
+        formats = ( int * ) _arena_alloc( &handler_arena, sizeof( int ) * call->arg_count );
+
+        if( values == NULL || lengths == NULL || formats == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate memory for function arguments"
+            );
+
+            return false;
+        }
+    }
+
+    for( i = 0; i < call->arg_count; i++ )
+    {
+        if(
+            !_function_argument_value(
+                action,
+                call->arg_names[i],
+                call->arg_types[i],
+                &value
+            )
+         || !_encode_function_argument(
+                &handler_arena,
+                call->arg_types[i],
+                value,
+                &values[i],
+                &lengths[i],
+                &formats[i]
+            )
+          )
+        {
+            return false;
+        }
+    }
+
+    set_session_gucs( action->session_values_json );
 
-    action_result = _execute_query(
-        action_query->query_string,
-        action_query->_bind_list,
-        action_query->_bind_count
-    );
+    // Set UID
+    set_uid( action->uid, action->session_values_json );
 
-    _free_query( action_query );
+    result = PQexecPrepared(
+        conn,
+        call->statement,
+        call->arg_count,
+        ( const char * const * ) values,
+        lengths,
+        formats,
+        0
+    );
 
-    if( action_result == NULL )
+    if( PQresultStatus( result ) != PGRES_TUPLES_OK )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "Failed to perform action query"
+            "Function action %s failed: %s",
+            action->action,
+            PQerrorMessage( conn )
         );
 
+        PQclear( result );
         return false;
     }
 
-    clear_session_gucs( action->session_values );
-    PQclear( action_result );
+    clear_session_gucs( action->session_values_json );
+    PQclear( result );
     return true;
 }
 
@@ -1400,45 +3587,120 @@ bool execute_action_query( struct action_result * action )
  *     - Emits error from URI or query subroutines upon failure.
  */
 bool execute_action( PGresult * result, int row )
+{
+    char * values[ACTION_FIELD_COUNT] = {NULL};
+    int    i                          = 0;
+
+    for( i = 0; i < ACTION_FIELD_COUNT; i++ )
+    {
+        values[i] = get_column_value( row, result, ( char * ) action_fields[i] );
+    }
+
+    return _execute_action_values( values );
+}
+
+/*
+ * bool _execute_action_values( char ** values )
+ *     Builds an action from the columns listed in action_fields, either
+ *     from a dequeued row or a spooled record, and dispatches it to the URI
+ *     or query execution subroutines.
+ *
+ * Arguments:
+ *     - char ** values:    ACTION_FIELD_COUNT column values, NULL for SQL
+ *                          NULL.
+ * Return:
+ *     bool is_success:     true indicates successful completion of the action,
+ *                          false otherwise.
+ * Error Conditions
+ *     - Emits error on failure to parse the item's JSON payloads.
+ *     - Emits error from URI or query subroutines upon failure.
+ */
+bool _execute_action_values( char ** values )
 {
     bool   execute_action_result = false;
     struct action_result action  = {0};
     struct action_result * action_ptr = NULL;
     char * use_ssl = NULL;
+    struct timeval started = {0};
+    struct timeval now     = {0};
 
     action_ptr               = &action;
-    action.parameters        = get_column_value( row, result, "parameters" );
-    action.uid               = get_column_value( row, result, "uid" );
-    action.recorded          = get_column_value( row, result, "recorded" );
-    action.session_values    = get_column_value( row, result, "session_values" );
-    action.uri               = get_column_value( row, result, "uri" );
-
-    if( is_column_null( row, result, "static_parameters" ) == false )
+    action.parameters        = values[ACTION_FIELD_PARAMETERS];
+    action.uid               = values[ACTION_FIELD_UID];
+    action.recorded          = values[ACTION_FIELD_RECORDED];
+    action.session_values    = values[ACTION_FIELD_SESSION_VALUES];
+    action.uri               = values[ACTION_FIELD_URI];
+    action.host              = values[ACTION_FIELD_HOST];
+    action.action            = values[ACTION_FIELD_ACTION];
+    action.static_parameters = values[ACTION_FIELD_STATIC_PARAMETERS];
+    action.transaction_label = values[ACTION_FIELD_TRANSACTION_LABEL];
+
+    action.method      = values[ACTION_FIELD_METHOD];
+    action.query       = values[ACTION_FIELD_QUERY];
+    action.function    = values[ACTION_FIELD_FUNCTION];
+    action.body_format = values[ACTION_FIELD_BODY_FORMAT];
+    action.json_body   = values[ACTION_FIELD_JSON_BODY];
+    use_ssl            = values[ACTION_FIELD_USE_SSL];
+
+    action.connect_timeout_ms = atoi( values[ACTION_FIELD_CONNECT_TIMEOUT_MS] );
+    action.timeout_ms         = atoi( values[ACTION_FIELD_TIMEOUT_MS] );
+
+    if( values[ACTION_FIELD_HEDGE_PERCENTILE] != NULL )
     {
-        action.static_parameters = get_column_value(
-            row,
-            result,
-            "static_parameters"
-        );
+        action.hedge_percentile = atoi( values[ACTION_FIELD_HEDGE_PERCENTILE] );
     }
 
-    action.transaction_label = get_column_value(
-        row,
-        result,
-        "transaction_label"
-    );
+    action.response_policy = values[ACTION_FIELD_RESPONSE_POLICY];
+    action.response_limit  = atoi( values[ACTION_FIELD_RESPONSE_LIMIT] );
 
-    action.method = get_column_value( row, result, "method" );
-    action.query  = get_column_value( row, result, "query" );
-    use_ssl       = get_column_value( row, result, "use_ssl" );
+    if( values[ACTION_FIELD_BODY_COMPRESSION] != NULL )
+    {
+        action.body_compression  = values[ACTION_FIELD_BODY_COMPRESSION];
+        action.compress_min_size = atoi( values[ACTION_FIELD_COMPRESS_MIN_SIZE] );
+    }
 
-    if( strcmp( use_ssl, "t" ) == 0 || strcmp( use_ssl, "T" ) == 0 )
+    if( use_ssl != NULL && ( strcmp( use_ssl, "t" ) == 0 || strcmp( use_ssl, "T" ) == 0 ) )
     {
         action.use_ssl = true;
     }
 
-    // Determine if action is query or URI based, send to correct handler
-    if( is_column_null( 0, result, "query" ) == false )
+    // Each payload is parsed once and shared by GUC, uid and binding code
+    action.parameters_json        = _parse_json_object( &handler_arena, action.parameters );
+    action.static_parameters_json = _parse_json_object( &handler_arena, action.static_parameters );
+    action.session_values_json    = _parse_json_object( &handler_arena, action.session_values );
+
+    if(
+            ( action.parameters != NULL && action.parameters_json == NULL )
+         || ( action.static_parameters != NULL && action.static_parameters_json == NULL )
+         || ( action.session_values != NULL && action.session_values_json == NULL )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to parse work queue item payload"
+        );
+
+        return false;
+    }
+
+    gettimeofday( &started, NULL );
+
+    // Determine if action is function, query or URI based, send to correct handler
+    if( action.function != NULL )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Executing action function"
+        );
+
+        execute_action_result = execute_action_function( action_ptr );
+
+        if( execute_action_result == true && cyanaudit_installed == true )
+        {
+            _cyanaudit_integration( action.transaction_label );
+        }
+    }
+    else if( action.query != NULL )
     {
         _log(
             LOG_LEVEL_DEBUG,
@@ -1452,7 +3714,16 @@ bool execute_action( PGresult * result, int row )
             _cyanaudit_integration( action.transaction_label );
         }
     }
-    else if( is_column_null( 0, result, "uri" ) == false )
+    else if( action.uri != NULL && _local_sink_kind( action.uri ) != SINK_NONE )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Writing to local sink"
+        );
+
+        execute_action_result = execute_local_sink_call( action_ptr );
+    }
+    else if( action.uri != NULL )
     {
         _log(
             LOG_LEVEL_DEBUG,
@@ -1471,6 +3742,21 @@ bool execute_action( PGresult * result, int row )
         execute_action_result = false;
     }
 
+    /*
+     * Remote calls account their time against their host. Items without
+     * one share a slot in the host round robin, so a backlog of them is
+     * claimed in turn with remote hosts rather than ahead of all of them.
+     */
+    if( action.host == NULL )
+    {
+        gettimeofday( &now, NULL );
+        _record_host_busy(
+            _get_host_state( LOCAL_WORK_HOST ),
+            ( now.tv_sec - started.tv_sec ) * 1000
+          + ( now.tv_usec - started.tv_usec ) / 1000
+        );
+    }
+
     return execute_action_result;
 }
 
@@ -1646,15 +3932,17 @@ bool _begin_transaction( void )
 }
 
 /*
- * bool set_uid( char * uid, char * session_values )
+ * bool set_uid( char * uid, struct json_object * session_values )
  *     Makes a call to the function specified in event_manager.set_uid_function,
  *     binding in the uid to ?uid? and the originating transaction GUC values
  *     specified in event_manager.session_gucs to their respective names.
  *
  * Arguments:
- *     - char * uid:            String representation of the integer user ID
- *     - char * session_values: JSONB object containing the key-value pairs of
- *                              GUCs and their values.
+ *     - char * uid:                          String representation of the
+ *                                            integer user ID
+ *     - struct json_object * session_values: Parsed JSONB object containing
+ *                                            the key-value pairs of GUCs and
+ *                                            their values.
  * Return:
  *     bool is_success:         Returns true on successful invokation of the
  *                              set_uid_function, false otherwise.
@@ -1662,7 +3950,7 @@ bool _begin_transaction( void )
  *     - Emits error on failure to allocate string memory.
  *     - Emits error on failure to execute SQL function.
  */
-bool set_uid( char * uid, char * session_values )
+bool set_uid( char * uid, struct json_object * session_values )
 {
     PGresult *     uid_function_result = NULL;
     struct query * set_uid_query_obj   = NULL;
@@ -1673,109 +3961,401 @@ bool set_uid( char * uid, char * session_values )
 
     params[0] = SET_UID_GUC_NAME;
 
-    uid_function_result = _execute_query(
-        ( char * ) _uid_function,
-        params,
-        1
+    uid_function_result = _execute_query(
+        ( char * ) _uid_function,
+        params,
+        1
+    );
+
+    if( uid_function_result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to get set uid function"
+        );
+
+        return false;
+    }
+
+    if( is_column_null( 0, uid_function_result, "uid_function" ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Set UID function result is NULL"
+        );
+
+        PQclear( uid_function_result );
+        return false;
+    }
+
+    uid_function_name = get_column_value(
+        0,
+        uid_function_result,
+        "uid_function"
+    );
+
+    set_uid_query = ( char * ) _arena_alloc(
+        &handler_arena,
+        strlen( uid_function_name ) + 8
+    );
+
+    if( set_uid_query == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for set uid operation"
+        );
+
+        PQclear( uid_function_result );
+        return false;
+    }
+
+    strcpy( set_uid_query, "SELECT " );
+    strcat( set_uid_query, uid_function_name );
+
+    set_uid_query_obj = _new_query_from_template(
+        &handler_arena,
+        _get_query_template(
+            QUERY_TEMPLATE_SET_UID,
+            SET_UID_GUC_NAME,
+            set_uid_query
+        )
+    );
+
+    if( set_uid_query_obj == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to create query object for set uid function"
+        );
+
+        PQclear( uid_function_result );
+        return false;
+    }
+
+    _add_parameter_to_query(
+        set_uid_query_obj,
+        "uid",
+        uid
+    );
+
+    _add_json_parameter_to_query(
+        set_uid_query_obj,
+        session_values,
+        ( char * ) NULL
+    );
+
+    if( !_finalize_query( set_uid_query_obj ) )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to parameterize set uid function"
+        );
+
+        PQclear( uid_function_result );
+        return false;
+    }
+
+    PQclear( uid_function_result );
+    // Re-use handle
+    uid_function_result = _execute_query(
+        set_uid_query_obj->query_string,
+        set_uid_query_obj->_bind_list,
+        set_uid_query_obj->_bind_count
+    );
+
+
+    if( uid_function_result == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to set UID"
+        );
+
+        return false;
+    }
+
+    PQclear( uid_function_result );
+    return true;
+}
+
+// Signal Handlers
+
+/*
+ * bool _init_curl_share( void )
+ *     Creates curl_share, which lets every easy handle share one DNS cache,
+ *     TLS session cache and connection cache. Access is serialized by
+ *     curl_share_locks, one mutex per kind of shared data.
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     bool: true if curl_share is ready to be attached to handles.
+ * Error Conditions:
+ *     - Emits warning when the share cannot be created, in which case each
+ *       handle keeps its own caches.
+ */
+bool _init_curl_share( void )
+{
+    CURLSHcode response = CURLSHE_OK;
+    int        i        = 0;
+
+    for( i = 0; i < CURL_LOCK_DATA_LAST; i++ )
+    {
+        pthread_mutex_init( &curl_share_locks[i], NULL );
+    }
+
+    curl_share = curl_share_init();
+
+    if( curl_share == NULL )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to create curl share, DNS / TLS caches will not be shared"
+        );
+
+        return false;
+    }
+
+    curl_share_setopt( curl_share, CURLSHOPT_LOCKFUNC, _curl_share_lock );
+    curl_share_setopt( curl_share, CURLSHOPT_UNLOCKFUNC, _curl_share_unlock );
+
+    response = curl_share_setopt( curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS );
+
+    if( response == CURLSHE_OK )
+    {
+        response = curl_share_setopt(
+            curl_share,
+            CURLSHOPT_SHARE,
+            CURL_LOCK_DATA_SSL_SESSION
+        );
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x073900
+    // Connection cache sharing needs curl 7.57.0
+    if( response == CURLSHE_OK )
+    {
+        response = curl_share_setopt(
+            curl_share,
+            CURLSHOPT_SHARE,
+            CURL_LOCK_DATA_CONNECT
+        );
+    }
+#endif
+
+    if( response != CURLSHE_OK )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Failed to configure curl share: %s",
+            curl_share_strerror( response )
+        );
+
+        curl_share_cleanup( curl_share );
+        curl_share = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * static void _curl_share_lock(
+ *     CURL * handle,
+ *     curl_lock_data data,
+ *     curl_lock_access access,
+ *     void * user_p
+ * )
+ *     CURLSHOPT_LOCKFUNC callback, locks the mutex guarding data
+ */
+static void _curl_share_lock(
+    CURL * handle,
+    curl_lock_data data,
+    curl_lock_access access,
+    void * user_p
+)
+{
+    pthread_mutex_lock( &curl_share_locks[data] );
+    return;
+}
+
+/*
+ * static void _curl_share_unlock(
+ *     CURL * handle,
+ *     curl_lock_data data,
+ *     void * user_p
+ * )
+ *     CURLSHOPT_UNLOCKFUNC callback, unlocks the mutex guarding data
+ */
+static void _curl_share_unlock(
+    CURL * handle,
+    curl_lock_data data,
+    void * user_p
+)
+{
+    pthread_mutex_unlock( &curl_share_locks[data] );
+    return;
+}
+
+/*
+ * void _apply_curl_settings( void )
+ *     Applies the extension's curl settings (DNS cache lifetime and TLS
+ *     session reuse) to curl_handle, reads the low speed limits that
+ *     _prepare_curl_request() applies to each request, and configures the
+ *     per-host circuit breakers, concurrency limits and scheduling shares,
+ *     and the hedged request budget.
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     None
+ * Error Conditions:
+ *     - Emits warning when the settings cannot be read, leaving curl's
+ *       defaults in place.
+ */
+void _apply_curl_settings( void )
+{
+    PGresult *                  result            = NULL;
+    char *                      dns_cache_timeout = NULL;
+    char *                      ssl_session_reuse = NULL;
+    struct breaker_settings     breakers          = {0};
+    struct concurrency_settings limits            = {0};
+
+    result = _execute_query(
+        ( char * ) curl_settings_query,
+        NULL,
+        0
     );
 
-    if( uid_function_result == NULL )
+    if( result == NULL || PQntuples( result ) <= 0 )
     {
         _log(
-            LOG_LEVEL_ERROR,
-            "Failed to get set uid function"
+            LOG_LEVEL_WARNING,
+            "Failed to read curl settings, using defaults"
         );
 
-        return false;
-    }
-
-    if( is_column_null( 0, uid_function_result, "uid_function" ) )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Set UID function result is NULL"
-        );
+        if( result != NULL )
+        {
+            PQclear( result );
+        }
 
-        PQclear( uid_function_result );
-        return false;
+        return;
     }
 
-    uid_function_name = get_column_value(
-        0,
-        uid_function_result,
-        "uid_function"
+    dns_cache_timeout = get_column_value( 0, result, "dns_cache_timeout" );
+    ssl_session_reuse = get_column_value( 0, result, "ssl_session_reuse" );
+    low_speed_limit   = atol( get_column_value( 0, result, "low_speed_limit" ) );
+    low_speed_time    = atol( get_column_value( 0, result, "low_speed_time" ) );
+
+    breakers.failure_rate = atof( get_column_value( 0, result, "breaker_failure_rate" ) );
+    breakers.min_requests = atoi( get_column_value( 0, result, "breaker_min_requests" ) );
+    breakers.window_ms    = atol( get_column_value( 0, result, "breaker_window_ms" ) );
+    breakers.open_ms      = atol( get_column_value( 0, result, "breaker_open_ms" ) );
+    breakers.slow_call_ms = atol( get_column_value( 0, result, "breaker_slow_call_ms" ) );
+    _configure_breakers( &breakers );
+
+    limits.max_limit         = atoi( get_column_value( 0, result, "concurrency_max" ) );
+    limits.latency_tolerance = atof( get_column_value( 0, result, "concurrency_latency_tolerance" ) );
+    limits.backoff           = atof( get_column_value( 0, result, "concurrency_backoff" ) );
+    _configure_concurrency( &limits );
+    _configure_host_share( atof( get_column_value( 0, result, "max_host_share" ) ) );
+    hedge_budget = atof( get_column_value( 0, result, "hedge_budget_percent" ) ) / 100;
+    spool_batch_size = atoi( get_column_value( 0, result, "spool_batch_size" ) );
+    _configure_local_sinks( atol( get_column_value( 0, result, "sink_rotate_bytes" ) ) );
+    fail_on_http_error = strcmp( get_column_value( 0, result, "fail_on_http_error" ), "t" ) == 0;
+
+    curl_easy_setopt(
+        curl_handle,
+        CURLOPT_DNS_CACHE_TIMEOUT,
+        atol( dns_cache_timeout )
     );
 
-    set_uid_query = ( char * ) calloc(
-        ( strlen( uid_function_name ) + 8 ),
-        sizeof( char )
+    curl_easy_setopt(
+        curl_handle,
+        CURLOPT_SSL_SESSIONID_CACHE,
+        ( long ) ( strcmp( ssl_session_reuse, "t" ) == 0 )
     );
 
-    if( set_uid_query == NULL )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to allocate memory for set uid operation"
-        );
-    }
-
-    strcpy( set_uid_query, "SELECT " );
-    strcat( set_uid_query, uid_function_name );
-
-    set_uid_query_obj = _new_query( set_uid_query );
-    free( set_uid_query );
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Curl DNS cache timeout: %ss, TLS session reuse: %s, "
+        "low speed limit: %ld bytes/s over %lds",
+        dns_cache_timeout,
+        ssl_session_reuse,
+        low_speed_limit,
+        low_speed_time
+    );
 
-    _add_parameter_to_query(
-        set_uid_query_obj,
-        "uid",
-        uid
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Circuit breakers open at %.0f%% failures of at least %d requests "
+        "per %ldms, retry after %ldms, slow call threshold %ldms",
+        breakers.failure_rate * 100,
+        breakers.min_requests,
+        breakers.window_ms,
+        breakers.open_ms,
+        breakers.slow_call_ms
     );
 
-    _add_json_parameter_to_query(
-        set_uid_query_obj,
-        session_values,
-        ( char * ) NULL
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Host concurrency limits up to %d, growing while latency is within "
+        "%.1fx of baseline, backing off by %.2f when overloaded",
+        limits.max_limit,
+        limits.latency_tolerance,
+        limits.backoff
     );
 
-    _finalize_query( set_uid_query_obj );
+    PQclear( result );
+    return;
+}
+
+/*
+ * void _cleanup_curl( void )
+ *     Releases curl_multi, curl_handle and curl_share, when curl is enabled
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _cleanup_curl( void )
+{
+    int i = 0;
 
-    if( set_uid_query_obj == NULL )
+    if( !enable_curl )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to create query object for set uid function"
-        );
-
-        PQclear( uid_function_result );
-        return false;
+        return;
     }
 
-    PQclear( uid_function_result );
-    // Re-use handle
-    uid_function_result = _execute_query(
-        set_uid_query_obj->query_string,
-        set_uid_query_obj->_bind_list,
-        set_uid_query_obj->_bind_count
-    );
+    if( curl_multi != NULL )
+    {
+        curl_multi_cleanup( curl_multi );
+        curl_multi = NULL;
+    }
 
-    _free_query( set_uid_query_obj );
+    // Handles must be detached from the share before it is released
+    curl_easy_cleanup( curl_handle );
+    curl_handle = NULL;
 
-    if( uid_function_result == NULL )
+    if( curl_share != NULL )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to set UID"
-        );
+        curl_share_cleanup( curl_share );
+        curl_share = NULL;
 
-        return false;
+        for( i = 0; i < CURL_LOCK_DATA_LAST; i++ )
+        {
+            pthread_mutex_destroy( &curl_share_locks[i] );
+        }
     }
 
-    PQclear( uid_function_result );
-    return true;
+    curl_global_cleanup();
+    enable_curl = false;
+    return;
 }
 
-// Signal Handlers
-
 /*
  * void __sigterm( int sig )
  *     SIGTERM signal handler
@@ -1795,11 +4375,9 @@ void __sigterm( int sig )
     );
 
     free( conninfo );
-    if( enable_curl )
-    {
-        curl_easy_cleanup( curl_handle );
-        curl_global_cleanup();
-    }
+    _cleanup_curl();
+    _close_local_sinks();
+    _spool_close( &work_spool );
 
     if( tx_in_progress )
     {
@@ -1853,6 +4431,8 @@ int main( int argc, char ** argv )
     int random_ind = 4; // determined by dice roll
     int row_count  = 0;
 
+    char hostname[LEASE_OWNER_SIZE] = {0};
+
     //Crapily seed PRNG for backoff of connection attempts on DB failure
     srand( random_ind * time(0) );
     curl_handle = curl_easy_init();
@@ -1866,6 +4446,14 @@ int main( int argc, char ** argv )
             CURLOPT_USERAGENT,
             ( char * ) user_agent
         );
+
+        // Accept any response encoding curl was built to decode
+        curl_easy_setopt( curl_handle, CURLOPT_ACCEPT_ENCODING, "" );
+
+        if( _init_curl_share() )
+        {
+            curl_easy_setopt( curl_handle, CURLOPT_SHARE, curl_share );
+        }
     }
     else
     {
@@ -1877,10 +4465,15 @@ int main( int argc, char ** argv )
         enable_curl = false;
     }
 
+    _arena_init( &handler_arena, ARENA_BLOCK_SIZE );
+
     // Setup Signal Handlers
     signal ( SIGHUP, __sighup );
     signal ( SIGTERM, __sigterm );
 
+    // Local sink readers going away surface as write errors instead
+    signal ( SIGPIPE, SIG_IGN );
+
     params[0] = EXTENSION_NAME;
 
     _parse_args( argc, argv );
@@ -1938,8 +4531,33 @@ int main( int argc, char ** argv )
 
     PQclear( cyanaudit_result );
 
+    if( enable_curl )
+    {
+        _apply_curl_settings();
+    }
+
+    if( gethostname( hostname, sizeof( hostname ) - 1 ) != 0 )
+    {
+        strcpy( hostname, "localhost" );
+    }
+
+    snprintf( lease_owner, sizeof( lease_owner ), "%.200s:%d", hostname, ( int ) getpid() );
+
     // Entry for other subs here
-    if( work_listener )
+    if( work_listener && spool_path != NULL )
+    {
+        if( !_spool_open( &work_spool, spool_path ) )
+        {
+            _log(
+                LOG_LEVEL_FATAL,
+                "Failed to open spool %s",
+                spool_path
+            );
+        }
+
+        _queue_loop( WORK_QUEUE_CHANNEL, &spool_queue_handler );
+    }
+    else if( work_listener )
     {
         _queue_loop( WORK_QUEUE_CHANNEL, &work_queue_handler );
     }
@@ -1955,169 +4573,71 @@ int main( int argc, char ** argv )
     }
 
     free( conninfo );
-
-    if( enable_curl )
-    {
-        curl_easy_cleanup( curl_handle );
-        curl_global_cleanup();
-    }
+    _arena_destroy( &handler_arena );
+    _string_builder_free( &request_buffer );
+    _string_builder_free( &compressed_buffer );
+    _string_builder_free( &response_buffer );
+    _string_builder_free( &open_hosts_buffer );
+    _string_builder_free( &throttled_hosts );
+    _string_builder_free( &throttled_actions );
+    _string_builder_free( &host_schedule );
+    _string_builder_free( &hedge_buffer );
+    _string_builder_free( &spooled_ctids );
+    _string_builder_free( &spooled_sink_acks );
+    _close_local_sinks();
+    _spool_close( &work_spool );
+
+    _cleanup_curl();
 
     return 0;
 }
 
 /*
- * void set_session_gucs( char * session_gucs )
+ * void set_session_gucs( struct json_object * session_gucs )
  *     Set the current session's GUCs based on stored values in the
  *     session_gucs JSON
  *
  * Arguments:
- *     char * session_gucs: JSON structure of key (GUC name) and value
- *                          (GUC value) pairs used to set the GUC in a
- *                          new session.
+ *     struct json_object * session_gucs: Parsed JSON structure of key (GUC
+ *                                        name) and value (GUC value) pairs
+ *                                        used to set the GUC in a new
+ *                                        session.
  * Return:
  *     None
  * Error Conditions:
- *     - Emits error on failure to parse JSON
- *     - Emits error on invalid input JSON (ARRAY, SCALAR)
  *     - Emits error on failure to set GUC via SQL commands.
  *
  */
-void set_session_gucs( char * session_gucs )
+void set_session_gucs( struct json_object * session_gucs )
 {
-    PGresult *  result           = NULL;
-    jsmntok_t * json_tokens      = NULL;
-    jsmntok_t   json_key_token   = {0};
-    jsmntok_t   json_value_token = {0};
-    char *      key              = NULL;
-    char *      value            = NULL;
-    char *      params[2]        = {NULL};
-    int         i                = 0;
-    int         max_tokens       = 0;
-
-    if( session_gucs == NULL || strlen( session_gucs ) == 0 )
-    {
-        return;
-    }
-
-    json_tokens = json_tokenise( session_gucs, &max_tokens );
-
-    if( json_tokens == NULL )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to parse session GUC strings"
-        );
-        return;
-    }
-
-    if( json_tokens[0].type != JSMN_OBJECT )
+    PGresult *           result    = NULL;
+    struct json_member * member    = NULL;
+    char *               key       = NULL;
+    char *               value     = NULL;
+    char *               params[2] = {NULL};
+    int                  i         = 0;
+
+    if( session_gucs == NULL )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Root element of session GUCs structure is not an object"
-        );
-
-        free( json_tokens );
         return;
     }
 
-    if( max_tokens < 3 )
+    if( session_gucs->member_count == 0 )
     {
         _log(
             LOG_LEVEL_WARNING,
             "Received empty JSON object for session_gucs"
         );
-        free( json_tokens );
         return;
     }
 
-    i = 1;
-    for(;;)
+    for( i = 0; i < session_gucs->member_count; i++ )
     {
-        json_key_token = json_tokens[i];
-
-        if( json_key_token.type != JSMN_STRING )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Expected string key in JSON structure for session_gucs "
-                "(got %d at index %d)",
-                json_key_token.type,
-                i
-            );
-
-            free( json_tokens );
-            return;
-        }
-
-        key = ( char * ) calloc(
-            ( json_key_token.end - json_key_token.start + 1 ),
-            sizeof( char )
-        );
-
-        if( key == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for JSON key string"
-            );
-
-            free( json_tokens );
-            return;
-        }
-
-        strncat(
-            key,
-            ( char * ) ( session_gucs + json_key_token.start ),
-            json_key_token.end - json_key_token.start
-        );
-
-        key[json_key_token.end - json_key_token.start] = '\0';
-        i++;
-
-        if( i >= max_tokens )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Reached unexpected end of JSON object"
-            );
-            free( key );
-            free( json_tokens );
-            return;
-        }
-
-        json_value_token = json_tokens[i];
-
-        value = ( char * ) calloc(
-            ( json_value_token.end - json_value_token.start + 1 ),
-            sizeof( char )
-        );
-
-        if( value == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for JSON value string"
-            );
-
-            free( key );
-            free( json_tokens );
-            return;
-        }
-
-        strncpy(
-            value,
-            ( char * ) ( session_gucs + json_value_token.start ),
-            json_value_token.end - json_value_token.start
-        );
-
-        value[json_value_token.end - json_value_token.start] = '\0';
+        member = &session_gucs->members[i];
 
-        if( strcmp( value, "null" ) == 0 || strcmp( value, "NULL" ) == 0 )
-        {
-            free( value );
-            value = NULL;
-        }
+        // Members are NUL terminated within the parsed object
+        key   = member->key;
+        value = member->is_null ? NULL : member->value;
 
         params[0] = key;
         params[1] = value;
@@ -2135,141 +4655,49 @@ void set_session_gucs( char * session_gucs )
             );
 
             _rollback_transaction();
-            free( key );
-            if( value != NULL )
-            {
-                free( value );
-            }
-            free( json_tokens );
             return;
         }
 
         PQclear( result );
         _log( LOG_LEVEL_DEBUG, "Found session_guc kv pair: %s:%s", key, value );
-        free( key );
-        if( value != NULL )
-        {
-            free( value );
-        }
-
-        if( i >= ( max_tokens - 1 ) )
-        {
-            break;
-        }
-
-        i++;
     }
 
-    free( json_tokens );
     return;
 }
 
 /*
- * void clear_session_gucs( char * session_gucs )
+ * void clear_session_gucs( struct json_object * session_gucs )
  *     Clears the GUC names present in the session_guc JSON, returning the
  *     session to a base state.
  *
  * Arguments:
- *     char * session_gucs: JSON object containing key (GUC names) and value
- *                          (GUC value) pairs used to clear the GUCs.
+ *     struct json_object * session_gucs: Parsed JSON object containing key
+ *                                        (GUC names) and value (GUC value)
+ *                                        pairs used to clear the GUCs.
  * Return:
  *     None
  * Error Conditions:
- *     - Emits error on failure to parse JSON.
- *     - Emits error on receipt of invalid JSON structure (ARRAY,SCALAR).
  *     - Emits error on failure to clear GUC via SQL commands.
  */
 
-void clear_session_gucs( char * session_gucs )
+void clear_session_gucs( struct json_object * session_gucs )
 {
-    PGresult *  result           = NULL;
-    jsmntok_t * json_tokens      = NULL;
-    jsmntok_t   json_key_token   = {0};
-    char *      key              = NULL;
-    char *      params[1]        = {NULL};
-    int         i                = 0;
-    int         max_tokens       = 0;
-
-    if( session_gucs == NULL || strlen( session_gucs ) == 0 )
-    {
-        return;
-    }
-
-    json_tokens = json_tokenise( session_gucs, &max_tokens );
-
-    if( json_tokens == NULL )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to parse session GUC strings"
-        );
-        return;
-    }
-
-    if( json_tokens[0].type != JSMN_OBJECT )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Root element of session GUCs structure is not an object"
-        );
+    PGresult *           result    = NULL;
+    struct json_member * member    = NULL;
+    char *               key       = NULL;
+    char *               params[1] = {NULL};
+    int                  i         = 0;
 
-        free( json_tokens );
-        return;
-    }
-
-    if( max_tokens < 3 )
+    if( session_gucs == NULL )
     {
-        _log(
-            LOG_LEVEL_WARNING,
-            "Received empty JSON object for session_gucs"
-        );
-        free( json_tokens );
         return;
     }
 
-    i = 1;
-    for(;;)
+    for( i = 0; i < session_gucs->member_count; i++ )
     {
-        json_key_token = json_tokens[i];
-
-        if( json_key_token.type != JSMN_STRING )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Expected string key in JSON structure for session_gucs"
-                " (got %d at index %d)",
-                json_key_token.type,
-                i
-            );
-
-            free( json_tokens );
-            return;
-        }
-
-        key = ( char * ) calloc(
-            ( json_key_token.end - json_key_token.start + 1 ),
-            sizeof( char )
-        );
-
-        if( key == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for JSON key string"
-            );
-
-            free( json_tokens );
-            return;
-        }
-
-        strncat(
-            key,
-            ( char * ) ( session_gucs + json_key_token.start ),
-            json_key_token.end - json_key_token.start
-        );
+        member = &session_gucs->members[i];
 
-        key[json_key_token.end - json_key_token.start] = '\0';
-        i = i + 2;
+        key = member->key;
 
         params[0] = key;
         _log(
@@ -2290,22 +4718,12 @@ void clear_session_gucs( char * session_gucs )
                 LOG_LEVEL_ERROR,
                 "Failed to execute set_guc query"
             );
-            free( json_tokens );
-            free( key );
             _rollback_transaction();
             return;
         }
 
         PQclear( result );
-        free( key );
-
-        if( i >= ( max_tokens - 1 ) )
-        {
-            break;
-        }
-
     }
 
-    free( json_tokens );
     return;
 }
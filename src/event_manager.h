@@ -13,37 +13,90 @@
 
 #ifndef EVENT_MANAGER_H
 #define EVENT_MANAGER_H
+#include <sys/time.h>
 #include <libpq-fe.h>
+#include <curl/curl.h>
+#include "lib/query_helper.h"
+#include "lib/host_state.h"
+#include "lib/function_call.h"
 
 // Structures
 struct curl_response {
-    char * pointer;
-    size_t size;
+    struct string_builder * buffer;
+    int policy;
+    size_t limit;
+    bool truncated;
 };
 
 struct action_result {
+    char * action;
     char * query;
+    char * function;
     char * uri;
+    char * host;
     char * method;
     bool use_ssl;
+    char * body_format;
+    char * json_body;
+    char * body_compression;
+    int compress_min_size;
+    char * response_policy;
+    int response_limit;
+    int connect_timeout_ms;
+    int timeout_ms;
+    int hedge_percentile;
+    struct timeval deadline;
     char * parameters;
     char * static_parameters;
     char * session_values;
     char * uid;
     char * transaction_label;
     char * recorded;
+    struct json_object * parameters_json;
+    struct json_object * static_parameters_json;
+    struct json_object * session_values_json;
 };
 
 /* Function Prototypes */
 // Main functions
 void _queue_loop( const char *, int (*)(void) );
+int _handle_queue_item( int (*)(void) );
 int work_queue_handler( void );
+void _work_queue_filters( char ** );
+int spool_queue_handler( void );
+int _spool_work_queue_items( void );
+bool _spooled_trial_taken( PGresult *, int );
+int _deliver_spooled_items( void );
+bool _requeue_spooled_item( char ** );
+int _take_rate_tokens( char *, char * );
+char * _lease_work_queue_item( char *, char * );
+int _retry_queue_item( const char *, char *, char * );
+long _next_retry_timeout_ms( int (*)(void) );
+long _next_wake_ms( int (*)(void) );
+int _acquire_host_slot( char *, int );
+void _release_host_slot( char *, int );
 int event_queue_handler( void );
 bool execute_action( PGresult *, int );
+bool _execute_action_values( char ** );
 bool execute_action_query( struct action_result * );
+struct function_call * _prepare_function_call( char * );
+bool _function_argument_value( struct action_result *, char *, Oid, char ** );
+bool execute_action_function( struct action_result * );
+bool execute_local_sink_call( struct action_result * );
 bool execute_remote_uri_call( struct action_result * );
-bool set_uid( char *, char * );
+int _response_policy( char * );
+bool _prepare_curl_request( CURL *, struct action_result *, struct curl_slist ** );
+long _hedge_delay_ms( struct action_result *, struct host_state * );
+CURLcode _perform_hedged( struct action_result *, struct curl_slist *, long, struct curl_response *, long *, double * );
+void _set_deadline( struct timeval *, int );
+long _remaining_ms( struct timeval * );
+bool set_uid( char *, struct json_object * );
 static size_t _curl_write_callback( void *, size_t, size_t, void * );
+bool _init_curl_share( void );
+static void _curl_share_lock( CURL *, curl_lock_data, curl_lock_access, void * );
+static void _curl_share_unlock( CURL *, curl_lock_data, void * );
+void _apply_curl_settings( void );
+void _cleanup_curl( void );
 
 // Helper functions
 PGresult * _execute_query( char *, char **, int );
@@ -52,8 +105,8 @@ bool is_column_null( int, PGresult *, char * );
 bool _rollback_transaction( void );
 bool _commit_transaction( void );
 bool _begin_transaction( void );
-void set_session_gucs( char * );
-void clear_session_gucs( char * );
+void set_session_gucs( struct json_object * );
+void clear_session_gucs( struct json_object * );
 
 // Integration functions
 void _cyanaudit_integration( char * );
@@ -0,0 +1,341 @@
+/*------------------------------------------------------------------------
+ *
+ * event_manager_bind.c
+ *     Server-side bindpoint substitution used by synchronous processing
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        event_manager_bind.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+
+#include "catalog/pg_type.h"
+#include "lib/stringinfo.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/jsonb.h"
+
+#if PG_VERSION_NUM < 110000
+#define DatumGetJsonbP( d ) DatumGetJsonb( d )
+#endif
+
+#ifdef PG_MODULE_MAGIC
+PG_MODULE_MAGIC;
+#endif
+
+PG_FUNCTION_INFO_V1( fn_bind_query );
+
+/* Structures */
+typedef struct bind_source {
+    JsonbContainer * container;
+    char *           prefix;
+    int              prefix_length;
+} bind_source;
+
+/* Prototypes */
+Datum fn_bind_query( PG_FUNCTION_ARGS );
+static JsonbValue * _find_bind_value( bind_source *, int, char *, int );
+static char * _bind_value_to_cstring( JsonbValue * );
+static bool _is_unbound_bindpoint( char *, int );
+
+/*
+ *  Datum fn_bind_query( PG_FUNCTION_ARGS )
+ *      Replaces ?key? bindpoints in a query with quote_nullable()'d values
+ *      from an array of JSONB objects, in a single pass over the query.
+ *
+ *  Arguments:
+ *      TEXT    query:      Query containing ?key? bindpoints
+ *      JSONB[] parameters: Objects to bind from. When a key exists in
+ *                          more than one object, the first object wins
+ *      TEXT[]  prefixes:   Optional prefix (e.g. 'OLD.') that must lead a
+ *                          bindpoint for it to be looked up in the
+ *                          parameter object at the same position
+ *  Return:
+ *      TEXT query with bound values. Bindpoints of the form
+ *      ?[OLD.|NEW.]word? that were not bound are replaced with NULL.
+ *  Notes:
+ *      Keys are looked up directly in the JSONB object containers, which
+ *      are stored sorted, so each bindpoint costs a binary search rather
+ *      than a regular expression pass over the whole query per key.
+ */
+Datum fn_bind_query( PG_FUNCTION_ARGS )
+{
+    text *          query_text      = NULL;
+    char *          query           = NULL;
+    int             query_length    = 0;
+    ArrayType *     parameters      = NULL;
+    ArrayType *     prefixes        = NULL;
+    Datum *         parameter_datums = NULL;
+    bool *          parameter_nulls = NULL;
+    int             parameter_count = 0;
+    Datum *         prefix_datums   = NULL;
+    bool *          prefix_nulls    = NULL;
+    int             prefix_count    = 0;
+    bind_source *   sources         = NULL;
+    int             source_count    = 0;
+    StringInfoData  result;
+    JsonbValue *    value           = NULL;
+    char *          value_string    = NULL;
+    char *          name            = NULL;
+    int             name_length     = 0;
+    int             copied          = 0;
+    int             i               = 0;
+    int             j               = 0;
+    Jsonb *         jsonb           = NULL;
+
+    if( PG_ARGISNULL( 0 ) )
+    {
+        PG_RETURN_NULL();
+    }
+
+    query_text   = PG_GETARG_TEXT_PP( 0 );
+    query        = VARDATA_ANY( query_text );
+    query_length = VARSIZE_ANY_EXHDR( query_text );
+
+    if( !PG_ARGISNULL( 1 ) )
+    {
+        parameters = PG_GETARG_ARRAYTYPE_P( 1 );
+        deconstruct_array(
+            parameters,
+            JSONBOID,
+            -1,
+            false,
+            'i',
+            &parameter_datums,
+            &parameter_nulls,
+            &parameter_count
+        );
+    }
+
+    if( PG_NARGS() > 2 && !PG_ARGISNULL( 2 ) )
+    {
+        prefixes = PG_GETARG_ARRAYTYPE_P( 2 );
+        deconstruct_array(
+            prefixes,
+            TEXTOID,
+            -1,
+            false,
+            'i',
+            &prefix_datums,
+            &prefix_nulls,
+            &prefix_count
+        );
+    }
+
+    if( parameter_count > 0 )
+    {
+        sources = ( bind_source * ) palloc0( sizeof( bind_source ) * parameter_count );
+    }
+
+    for( i = 0; i < parameter_count; i++ )
+    {
+        if( parameter_nulls[i] )
+        {
+            continue;
+        }
+
+        jsonb = DatumGetJsonbP( parameter_datums[i] );
+
+        if( !JB_ROOT_IS_OBJECT( jsonb ) )
+        {
+            continue;
+        }
+
+        sources[source_count].container = &jsonb->root;
+
+        if( i < prefix_count && !prefix_nulls[i] )
+        {
+            sources[source_count].prefix        = TextDatumGetCString( prefix_datums[i] );
+            sources[source_count].prefix_length = strlen( sources[source_count].prefix );
+        }
+
+        source_count++;
+    }
+
+    initStringInfo( &result );
+    enlargeStringInfo( &result, query_length );
+
+    i = 0;
+    while( i < query_length )
+    {
+        if( query[i] != '?' )
+        {
+            i++;
+            continue;
+        }
+
+        // Candidate bindpoint runs to the next '?', and cannot span whitespace
+        for( j = i + 1; j < query_length; j++ )
+        {
+            if( query[j] == '?' || isspace( ( unsigned char ) query[j] ) )
+            {
+                break;
+            }
+        }
+
+        if( j >= query_length || query[j] != '?' || j == i + 1 )
+        {
+            i++;
+            continue;
+        }
+
+        name        = query + i + 1;
+        name_length = j - i - 1;
+        value       = _find_bind_value( sources, source_count, name, name_length );
+
+        if( value == NULL && !_is_unbound_bindpoint( name, name_length ) )
+        {
+            // Not a bindpoint - the closing '?' may open the next one
+            i++;
+            continue;
+        }
+
+        appendBinaryStringInfo( &result, query + copied, i - copied );
+
+        value_string = ( value == NULL ) ? NULL : _bind_value_to_cstring( value );
+
+        if( value_string == NULL )
+        {
+            appendStringInfoString( &result, "NULL" );
+        }
+        else
+        {
+            appendStringInfoString( &result, quote_literal_cstr( value_string ) );
+            pfree( value_string );
+        }
+
+        i      = j + 1;
+        copied = i;
+    }
+
+    appendBinaryStringInfo( &result, query + copied, query_length - copied );
+
+    PG_RETURN_TEXT_P( cstring_to_text_with_len( result.data, result.len ) );
+}
+
+/*
+ *  static JsonbValue * _find_bind_value( bind_source * sources, int source_count, char * name, int name_length )
+ *      Finds the value bound to a bindpoint name
+ *
+ *  Arguments:
+ *      bind_source * sources:      Parameter objects, in precedence order
+ *      int           source_count: Number of entries in sources
+ *      char *        name:         Bindpoint name (not NUL terminated)
+ *      int           name_length:  Length of name
+ *  Return:
+ *      JsonbValue * from the first source containing the key, or NULL
+ */
+static JsonbValue * _find_bind_value( bind_source * sources, int source_count, char * name, int name_length )
+{
+    JsonbValue   key;
+    JsonbValue * value = NULL;
+    int          i     = 0;
+
+    key.type = jbvString;
+
+    for( i = 0; i < source_count; i++ )
+    {
+        if( sources[i].prefix_length > 0 )
+        {
+            if(
+                    name_length <= sources[i].prefix_length
+                 || strncmp( name, sources[i].prefix, sources[i].prefix_length ) != 0
+              )
+            {
+                continue;
+            }
+
+            key.val.string.val = name + sources[i].prefix_length;
+            key.val.string.len = name_length - sources[i].prefix_length;
+        }
+        else
+        {
+            key.val.string.val = name;
+            key.val.string.len = name_length;
+        }
+
+        value = findJsonbValueFromContainer( sources[i].container, JB_FOBJECT, &key );
+
+        if( value != NULL )
+        {
+            return value;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ *  static char * _bind_value_to_cstring( JsonbValue * value )
+ *      Renders a JSONB value the way jsonb_each_text() would
+ *
+ *  Arguments:
+ *      JsonbValue * value: Value to render
+ *  Return:
+ *      palloc'd string, or NULL for a JSON null
+ */
+static char * _bind_value_to_cstring( JsonbValue * value )
+{
+    switch( value->type )
+    {
+        case jbvNull:
+            return NULL;
+        case jbvString:
+            return pnstrdup( value->val.string.val, value->val.string.len );
+        case jbvNumeric:
+            return DatumGetCString(
+                DirectFunctionCall1( numeric_out, NumericGetDatum( value->val.numeric ) )
+            );
+        case jbvBool:
+            return pstrdup( value->val.boolean ? "true" : "false" );
+        case jbvBinary:
+            return JsonbToCString( NULL, value->val.binary.data, value->val.binary.len );
+        default:
+            elog( ERROR, "event_manager: unexpected jsonb value type %d", ( int ) value->type );
+    }
+
+    return NULL;
+}
+
+/*
+ *  static bool _is_unbound_bindpoint( char * name, int name_length )
+ *      Checks whether an unmatched bindpoint should be replaced with NULL,
+ *      mirroring the '\?(((OLD)|(NEW))\.)?\w+\?' sweep
+ *
+ *  Arguments:
+ *      char * name:        Bindpoint name (not NUL terminated)
+ *      int    name_length: Length of name
+ *  Return:
+ *      true if the name is [OLD.|NEW.]word
+ */
+static bool _is_unbound_bindpoint( char * name, int name_length )
+{
+    int i = 0;
+
+    if(
+            name_length > 4
+         && ( strncmp( name, "OLD.", 4 ) == 0 || strncmp( name, "NEW.", 4 ) == 0 )
+      )
+    {
+        i = 4;
+    }
+
+    for( ; i < name_length; i++ )
+    {
+        if(
+               !isalnum( ( unsigned char ) name[i] )
+            && name[i] != '_'
+            && !IS_HIGHBIT_SET( name[i] )
+          )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
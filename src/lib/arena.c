@@ -0,0 +1,238 @@
+/*------------------------------------------------------------------------
+ *
+ * arena.c
+ *     Bump allocator for memory that lives for one queue item
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        arena.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "arena.h"
+
+// Allocations are aligned for any type
+#define ARENA_ALIGNMENT ( sizeof( long double ) > sizeof( void * ) ? sizeof( long double ) : sizeof( void * ) )
+#define ARENA_ALIGN( n ) ( ( ( n ) + ARENA_ALIGNMENT - 1 ) & ~( ARENA_ALIGNMENT - 1 ) )
+#define ARENA_HEADER_SIZE ARENA_ALIGN( sizeof( struct arena_block ) )
+
+static struct arena_block * _new_arena_block( size_t );
+
+/*
+ * void _arena_init( struct arena * arena, size_t block_size )
+ *     Initializes an empty arena. No memory is allocated until first use.
+ *
+ * Arguments:
+ *     struct arena * arena: Arena to initialize.
+ *     size_t block_size:    Usable size of each block. Larger requests get
+ *                           a block of their own.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _arena_init( struct arena * arena, size_t block_size )
+{
+    arena->first      = NULL;
+    arena->current    = NULL;
+    arena->block_size = block_size;
+
+    return;
+}
+
+/*
+ * void * _arena_alloc( struct arena * arena, size_t size )
+ *     Allocates zeroed memory from the arena. The memory is released by
+ *     _arena_reset(), never individually.
+ *
+ * Arguments:
+ *     struct arena * arena: Arena to allocate from.
+ *     size_t size:          Number of bytes requested.
+ * Return:
+ *     void *:               Zeroed memory, or NULL on failure.
+ * Error Conditions:
+ *     - Emits error on failure to allocate a new block.
+ */
+void * _arena_alloc( struct arena * arena, size_t size )
+{
+    struct arena_block * block  = NULL;
+    void *               memory = NULL;
+
+    size = ARENA_ALIGN( size == 0 ? 1 : size );
+    block = arena->current;
+
+    // Move on to blocks retained from earlier items before allocating more
+    while( block != NULL && block->size - block->used < size )
+    {
+        block = block->next;
+
+        if( block != NULL )
+        {
+            block->used = 0;
+        }
+    }
+
+    if( block == NULL )
+    {
+        block = _new_arena_block( size > arena->block_size ? size : arena->block_size );
+
+        if( block == NULL )
+        {
+            return NULL;
+        }
+
+        // Chain new blocks after the current one, so reset keeps them
+        if( arena->current == NULL )
+        {
+            block->next  = arena->first;
+            arena->first = block;
+        }
+        else
+        {
+            block->next           = arena->current->next;
+            arena->current->next  = block;
+        }
+    }
+
+    arena->current = block;
+    memory         = ( char * ) block + ARENA_HEADER_SIZE + block->used;
+    block->used    = block->used + size;
+
+    memset( memory, 0, size );
+    return memory;
+}
+
+/*
+ * char * _arena_strndup( struct arena * arena, const char * string, size_t length )
+ *     Copies length bytes of a string into the arena, NUL terminated
+ *
+ * Arguments:
+ *     struct arena * arena: Arena to allocate from.
+ *     const char * string:  String to copy (need not be NUL terminated).
+ *     size_t length:        Number of bytes to copy.
+ * Return:
+ *     char *:               Copy of the string, or NULL on failure.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+char * _arena_strndup( struct arena * arena, const char * string, size_t length )
+{
+    char * copy = NULL;
+
+    copy = ( char * ) _arena_alloc( arena, length + 1 );
+
+    if( copy == NULL )
+    {
+        return NULL;
+    }
+
+    memcpy( copy, string, length );
+    return copy;
+}
+
+/*
+ * void _arena_reset( struct arena * arena )
+ *     Releases everything allocated from the arena. Blocks of block_size
+ *     are kept and reused, so steady-state processing does not call malloc
+ *     at all. Larger blocks, made for single oversized requests, are freed
+ *     so that one large item does not hold on to its memory.
+ *
+ * Arguments:
+ *     struct arena * arena: Arena to reset.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _arena_reset( struct arena * arena )
+{
+    struct arena_block ** link  = NULL;
+    struct arena_block *  block = NULL;
+
+    link = &arena->first;
+
+    while( *link != NULL )
+    {
+        block = *link;
+
+        if( block->size > arena->block_size )
+        {
+            *link = block->next;
+            free( block );
+            continue;
+        }
+
+        link = &block->next;
+    }
+
+    arena->current = arena->first;
+
+    if( arena->first != NULL )
+    {
+        arena->first->used = 0;
+    }
+
+    return;
+}
+
+/*
+ * void _arena_destroy( struct arena * arena )
+ *     Frees every block owned by the arena
+ *
+ * Arguments:
+ *     struct arena * arena: Arena to destroy.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _arena_destroy( struct arena * arena )
+{
+    struct arena_block * block = NULL;
+    struct arena_block * next  = NULL;
+
+    for( block = arena->first; block != NULL; block = next )
+    {
+        next = block->next;
+        free( block );
+    }
+
+    arena->first   = NULL;
+    arena->current = NULL;
+
+    return;
+}
+
+/*
+ * static struct arena_block * _new_arena_block( size_t size )
+ *     Allocates a block with size usable bytes
+ */
+static struct arena_block * _new_arena_block( size_t size )
+{
+    struct arena_block * block = NULL;
+
+    block = ( struct arena_block * ) malloc( ARENA_HEADER_SIZE + size );
+
+    if( block == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for arena block"
+        );
+
+        return NULL;
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
@@ -0,0 +1,38 @@
+/*------------------------------------------------------------------------
+ *
+ * arena.h
+ *     Prototypes for the per-item bump allocator
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        arena.h
+ *
+ *------------------------------------------------------------------------
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 65536
+
+struct arena_block {
+    struct arena_block * next;
+    size_t               size;
+    size_t               used;
+};
+
+struct arena {
+    struct arena_block * first;
+    struct arena_block * current;
+    size_t               block_size;
+};
+
+void _arena_init( struct arena *, size_t );
+void * _arena_alloc( struct arena *, size_t );
+char * _arena_strndup( struct arena *, const char *, size_t );
+void _arena_reset( struct arena * );
+void _arena_destroy( struct arena * );
+
+#endif
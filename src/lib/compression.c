@@ -0,0 +1,259 @@
+/*------------------------------------------------------------------------
+ *
+ * compression.c
+ *     gzip (and optionally zstd) compression of remote call bodies
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        compression.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "util.h"
+#include "string_builder.h"
+#include "compression.h"
+
+// gzip wrapper around deflate, rather than a raw zlib stream
+#define GZIP_WINDOW_BITS ( 15 + 16 )
+#define ZSTD_LEVEL 3
+
+// Compression state is kept between calls, as it is costly to set up
+static z_stream gzip_stream      = {0};
+static bool     gzip_initialized = false;
+#ifdef HAVE_ZSTD
+static ZSTD_CCtx * zstd_context  = NULL;
+#endif
+
+/*
+ * int _compression_method( const char * name )
+ *     Maps a tb_action.body_compression value to a compression method
+ *
+ * Arguments:
+ *     const char * name: 'gzip', 'zstd' or NULL.
+ * Return:
+ *     int: COMPRESSION_* constant. COMPRESSION_NONE for NULL, unknown
+ *          methods, and zstd when built without HAVE_ZSTD.
+ * Error Conditions:
+ *     - Emits warning when an unsupported method is requested.
+ */
+int _compression_method( const char * name )
+{
+    if( name == NULL || name[0] == '\0' )
+    {
+        return COMPRESSION_NONE;
+    }
+
+    if( strcmp( name, "gzip" ) == 0 )
+    {
+        return COMPRESSION_GZIP;
+    }
+
+#ifdef HAVE_ZSTD
+    if( strcmp( name, "zstd" ) == 0 )
+    {
+        return COMPRESSION_ZSTD;
+    }
+#endif
+
+    _log(
+        LOG_LEVEL_WARNING,
+        "Unsupported body compression '%s', sending uncompressed",
+        name
+    );
+
+    return COMPRESSION_NONE;
+}
+
+/*
+ * const char * _compression_encoding( int method )
+ *     Returns the Content-Encoding header for a compression method
+ *
+ * Arguments:
+ *     int method: COMPRESSION_* constant.
+ * Return:
+ *     const char *: Header line, or NULL for COMPRESSION_NONE.
+ * Error Conditions:
+ *     None
+ */
+const char * _compression_encoding( int method )
+{
+    switch( method )
+    {
+        case COMPRESSION_GZIP:
+            return "Content-Encoding: gzip";
+        case COMPRESSION_ZSTD:
+            return "Content-Encoding: zstd";
+        default:
+            return NULL;
+    }
+}
+
+/*
+ * bool _compress_buffer(
+ *     int method,
+ *     const char * data,
+ *     size_t length,
+ *     struct string_builder * output
+ * )
+ *     Compresses data into output, replacing its contents. output is sized
+ *     to the method's worst case bound up front, so compression is a
+ *     single call.
+ *
+ * Arguments:
+ *     int method:                     COMPRESSION_GZIP or COMPRESSION_ZSTD.
+ *     const char * data:              Data to compress.
+ *     size_t length:                  Length of data.
+ *     struct string_builder * output: Buffer receiving compressed data.
+ * Return:
+ *     bool:                           true on success.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ *     - Emits error on compression library failure.
+ */
+bool _compress_buffer(
+    int method,
+    const char * data,
+    size_t length,
+    struct string_builder * output
+)
+{
+    int    rc    = 0;
+    size_t bound = 0;
+
+    _string_builder_reset( output );
+
+    if( method == COMPRESSION_GZIP )
+    {
+        if( !gzip_initialized )
+        {
+            rc = deflateInit2(
+                &gzip_stream,
+                Z_DEFAULT_COMPRESSION,
+                Z_DEFLATED,
+                GZIP_WINDOW_BITS,
+                8,
+                Z_DEFAULT_STRATEGY
+            );
+
+            if( rc != Z_OK )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to initialize gzip compression: %d",
+                    rc
+                );
+
+                return false;
+            }
+
+            gzip_initialized = true;
+        }
+        else if( deflateReset( &gzip_stream ) != Z_OK )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to reset gzip compression state"
+            );
+
+            return false;
+        }
+
+        bound = deflateBound( &gzip_stream, length );
+
+        if( !_string_builder_reserve( output, bound ) )
+        {
+            return false;
+        }
+
+        gzip_stream.next_in   = ( Bytef * ) data;
+        gzip_stream.avail_in  = length;
+        gzip_stream.next_out  = ( Bytef * ) output->data;
+        gzip_stream.avail_out = bound;
+
+        rc = deflate( &gzip_stream, Z_FINISH );
+
+        if( rc != Z_STREAM_END )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "gzip compression failed: %d",
+                rc
+            );
+
+            return false;
+        }
+
+        output->length = gzip_stream.total_out;
+        output->data[output->length] = '\0';
+        return true;
+    }
+
+#ifdef HAVE_ZSTD
+    if( method == COMPRESSION_ZSTD )
+    {
+        if( zstd_context == NULL )
+        {
+            zstd_context = ZSTD_createCCtx();
+
+            if( zstd_context == NULL )
+            {
+                _log(
+                    LOG_LEVEL_ERROR,
+                    "Failed to initialize zstd compression"
+                );
+
+                return false;
+            }
+        }
+
+        bound = ZSTD_compressBound( length );
+
+        if( !_string_builder_reserve( output, bound ) )
+        {
+            return false;
+        }
+
+        bound = ZSTD_compressCCtx(
+            zstd_context,
+            output->data,
+            bound,
+            data,
+            length,
+            ZSTD_LEVEL
+        );
+
+        if( ZSTD_isError( bound ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "zstd compression failed: %s",
+                ZSTD_getErrorName( bound )
+            );
+
+            return false;
+        }
+
+        output->length = bound;
+        output->data[output->length] = '\0';
+        return true;
+    }
+#endif
+
+    _log(
+        LOG_LEVEL_ERROR,
+        "Unsupported compression method %d",
+        method
+    );
+
+    return false;
+}
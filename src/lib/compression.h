@@ -0,0 +1,27 @@
+/*------------------------------------------------------------------------
+ *
+ * compression.h
+ *     Prototypes for request body compression
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        compression.h
+ *
+ *------------------------------------------------------------------------
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+#include <stdbool.h>
+#include "string_builder.h"
+
+#define COMPRESSION_NONE 0
+#define COMPRESSION_GZIP 1
+#define COMPRESSION_ZSTD 2
+
+int _compression_method( const char * );
+const char * _compression_encoding( int );
+bool _compress_buffer( int, const char *, size_t, struct string_builder * );
+
+#endif
@@ -0,0 +1,410 @@
+/*------------------------------------------------------------------------
+ *
+ * function_call.c
+ *     Prepared statements for function actions (tb_action.function).
+ *     Each function's input argument names and types are looked up in the
+ *     catalog once, and its call is prepared once per session, so items
+ *     skip bindpoint substitution and planning. Arguments of common types
+ *     are sent in binary format.
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        function_call.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "util.h"
+#include "arena.h"
+#include "function_call.h"
+
+static struct function_call * function_calls = NULL;
+
+static void _free_function_call( struct function_call * );
+static bool _parse_integer( const char *, long long, long long, long long * );
+static void _put_big_endian( char *, uint64_t, int );
+
+/*
+ * struct function_call * _get_function_call( const char * function )
+ *     Looks up the cached call for a function
+ *
+ * Arguments:
+ *     const char * function: Function OID, as text.
+ * Return:
+ *     struct function_call *: Cached call, or NULL. NOTE: Owned by the
+ *                             cache, do not free.
+ * Error Conditions:
+ *     None
+ */
+struct function_call * _get_function_call( const char * function )
+{
+    struct function_call * call = NULL;
+
+    for( call = function_calls; call != NULL; call = call->next )
+    {
+        if( strcmp( call->function, function ) == 0 )
+        {
+            return call;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * struct function_call * _new_function_call(
+ *     const char * function,
+ *     int arg_count
+ * )
+ *     Caches a call for a function with arg_count input arguments,
+ *     replacing any previous call for it. Arguments are then described
+ *     with _set_function_argument().
+ *
+ * Arguments:
+ *     const char * function: Function OID, as text.
+ *     int arg_count:         Number of input arguments.
+ * Return:
+ *     struct function_call *: New call, or NULL on failure. NOTE: Owned by
+ *                             the cache, do not free.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+struct function_call * _new_function_call( const char * function, int arg_count )
+{
+    struct function_call * call     = NULL;
+    struct function_call * previous = NULL;
+    struct function_call * existing = NULL;
+
+    call = ( struct function_call * ) calloc( 1, sizeof( struct function_call ) );
+
+    if( call != NULL )
+    {
+        call->function  = strdup( function );
+        call->statement = ( char * ) malloc( strlen( FUNCTION_STATEMENT_PREFIX ) + strlen( function ) + 1 );
+        call->arg_count = arg_count;
+        call->arg_names = ( char ** ) calloc( arg_count + 1, sizeof( char * ) );
+        call->arg_types = ( Oid * ) calloc( arg_count + 1, sizeof( Oid ) );
+    }
+
+    if(
+           call == NULL
+        || call->function == NULL
+        || call->statement == NULL
+        || call->arg_names == NULL
+        || call->arg_types == NULL
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for function call"
+        );
+
+        if( call != NULL )
+        {
+            _free_function_call( call );
+        }
+
+        return NULL;
+    }
+
+    strcpy( call->statement, FUNCTION_STATEMENT_PREFIX );
+    strcat( call->statement, function );
+
+    for( existing = function_calls; existing != NULL; existing = existing->next )
+    {
+        if( strcmp( existing->function, function ) == 0 )
+        {
+            break;
+        }
+
+        previous = existing;
+    }
+
+    if( existing != NULL )
+    {
+        call->next = existing->next;
+
+        if( previous == NULL )
+        {
+            function_calls = call;
+        }
+        else
+        {
+            previous->next = call;
+        }
+
+        _free_function_call( existing );
+    }
+    else
+    {
+        call->next     = function_calls;
+        function_calls = call;
+    }
+
+    return call;
+}
+
+/*
+ * bool _set_function_argument(
+ *     struct function_call * call,
+ *     int index,
+ *     const char * name,
+ *     Oid type
+ * )
+ *     Describes one of a call's input arguments
+ *
+ * Arguments:
+ *     struct function_call * call: Call from _new_function_call().
+ *     int index:                   Zero based argument position.
+ *     const char * name:           Argument name, NULL or empty if unnamed.
+ *     Oid type:                    Argument type.
+ * Return:
+ *     bool:                        true on success.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+bool _set_function_argument(
+    struct function_call * call,
+    int index,
+    const char * name,
+    Oid type
+)
+{
+    call->arg_types[index] = type;
+
+    if( name == NULL || name[0] == '\0' )
+    {
+        return true;
+    }
+
+    call->arg_names[index] = strdup( name );
+
+    if( call->arg_names[index] == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for function argument name"
+        );
+
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * bool _encode_function_argument(
+ *     struct arena * arena,
+ *     Oid type,
+ *     const char * value,
+ *     char ** output,
+ *     int * length,
+ *     int * format
+ * )
+ *     Encodes an argument value for PQexecPrepared(). Booleans, integers,
+ *     floats, text and JSON types are sent in binary; values of other types,
+ *     or that do not parse as their type, are sent as text for the server
+ *     to convert or reject.
+ *
+ * Arguments:
+ *     struct arena * arena: Allocator for encoded values.
+ *     Oid type:             Argument type.
+ *     const char * value:   Text value, NULL for SQL NULL.
+ *     char ** output:       Receives the encoded value.
+ *     int * length:         Receives the encoded length.
+ *     int * format:         Receives FUNCTION_FORMAT_TEXT or
+ *                           FUNCTION_FORMAT_BINARY.
+ * Return:
+ *     bool:                 true on success.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+bool _encode_function_argument(
+    struct arena * arena,
+    Oid type,
+    const char * value,
+    char ** output,
+    int * length,
+    int * format
+)
+{
+    long long integer = 0;
+    double    number  = 0;
+    float     single  = 0;
+    uint64_t  bits    = 0;
+    uint32_t  bits32  = 0;
+    char *    end     = NULL;
+    int       bytes   = 0;
+
+    *output = ( char * ) value;
+    *length = 0;
+    *format = FUNCTION_FORMAT_TEXT;
+
+    if( value == NULL )
+    {
+        return true;
+    }
+
+    switch( type )
+    {
+        case FUNCTION_BOOLOID:
+            if( strcmp( value, "true" ) == 0 || strcmp( value, "t" ) == 0 )
+            {
+                bits = 1;
+            }
+            else if( strcmp( value, "false" ) != 0 && strcmp( value, "f" ) != 0 )
+            {
+                return true;
+            }
+
+            bytes = 1;
+            break;
+        case FUNCTION_INT2OID:
+            bytes = _parse_integer( value, INT16_MIN, INT16_MAX, &integer ) ? 2 : 0;
+            bits  = ( uint64_t ) integer;
+            break;
+        case FUNCTION_INT4OID:
+            bytes = _parse_integer( value, INT32_MIN, INT32_MAX, &integer ) ? 4 : 0;
+            bits  = ( uint64_t ) integer;
+            break;
+        case FUNCTION_INT8OID:
+            bytes = _parse_integer( value, INT64_MIN, INT64_MAX, &integer ) ? 8 : 0;
+            bits  = ( uint64_t ) integer;
+            break;
+        case FUNCTION_FLOAT4OID:
+        case FUNCTION_FLOAT8OID:
+            errno  = 0;
+            number = strtod( value, &end );
+
+            if( errno != 0 || end == value || *end != '\0' )
+            {
+                return true;
+            }
+
+            if( type == FUNCTION_FLOAT4OID )
+            {
+                single = ( float ) number;
+                memcpy( &bits32, &single, sizeof( bits32 ) );
+                bits  = bits32;
+                bytes = 4;
+            }
+            else
+            {
+                memcpy( &bits, &number, sizeof( bits ) );
+                bytes = 8;
+            }
+
+            break;
+        case FUNCTION_TEXTOID:
+        case FUNCTION_VARCHAROID:
+        case FUNCTION_BPCHAROID:
+        case FUNCTION_JSONOID:
+            // The binary form of these types is their text
+            *length = strlen( value );
+            *format = FUNCTION_FORMAT_BINARY;
+            return true;
+        case FUNCTION_JSONBOID:
+            *length = strlen( value ) + 1;
+            *output = ( char * ) _arena_alloc( arena, *length );
+
+            if( *output == NULL )
+            {
+                return false;
+            }
+
+            ( *output )[0] = FUNCTION_JSONB_VERSION;
+            memcpy( *output + 1, value, *length - 1 );
+            *format = FUNCTION_FORMAT_BINARY;
+            return true;
+        default:
+            return true;
+    }
+
+    if( bytes == 0 )
+    {
+        return true;
+    }
+
+    *output = ( char * ) _arena_alloc( arena, bytes );
+
+    if( *output == NULL )
+    {
+        return false;
+    }
+
+    _put_big_endian( *output, bits, bytes );
+    *length = bytes;
+    *format = FUNCTION_FORMAT_BINARY;
+
+    return true;
+}
+
+/*
+ * Releases a call and its arguments
+ */
+static void _free_function_call( struct function_call * call )
+{
+    int i = 0;
+
+    if( call->arg_names != NULL )
+    {
+        for( i = 0; i < call->arg_count; i++ )
+        {
+            free( call->arg_names[i] );
+        }
+    }
+
+    free( call->arg_names );
+    free( call->arg_types );
+    free( call->statement );
+    free( call->function );
+    free( call );
+
+    return;
+}
+
+/*
+ * Parses a whole string as a base 10 integer within [minimum, maximum]
+ */
+static bool _parse_integer(
+    const char * value,
+    long long minimum,
+    long long maximum,
+    long long * result
+)
+{
+    char * end = NULL;
+
+    errno   = 0;
+    *result = strtoll( value, &end, 10 );
+
+    return errno == 0
+        && end != value
+        && *end == '\0'
+        && *result >= minimum
+        && *result <= maximum;
+}
+
+/*
+ * Writes the low bytes of value in network byte order
+ */
+static void _put_big_endian( char * output, uint64_t value, int bytes )
+{
+    int i = 0;
+
+    for( i = bytes - 1; i >= 0; i-- )
+    {
+        output[i] = ( char ) ( value & 0xFF );
+        value     = value >> 8;
+    }
+
+    return;
+}
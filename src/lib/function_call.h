@@ -0,0 +1,57 @@
+/*------------------------------------------------------------------------
+ *
+ * function_call.h
+ *     Prototypes for prepared function call actions
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        function_call.h
+ *
+ *------------------------------------------------------------------------
+ */
+
+#ifndef FUNCTION_CALL_H
+#define FUNCTION_CALL_H
+#include <stdbool.h>
+#include <postgres_ext.h>
+#include "arena.h"
+
+// Built-in type OIDs (pg_type.h) with a binary encoding here. Arguments of
+// any other type are sent as text.
+#define FUNCTION_BOOLOID 16
+#define FUNCTION_INT8OID 20
+#define FUNCTION_INT2OID 21
+#define FUNCTION_INT4OID 23
+#define FUNCTION_TEXTOID 25
+#define FUNCTION_JSONOID 114
+#define FUNCTION_FLOAT4OID 700
+#define FUNCTION_FLOAT8OID 701
+#define FUNCTION_BPCHAROID 1042
+#define FUNCTION_VARCHAROID 1043
+#define FUNCTION_JSONBOID 3802
+
+#define FUNCTION_FORMAT_TEXT 0
+#define FUNCTION_FORMAT_BINARY 1
+
+// jsonb binary input is a version byte followed by the JSON text
+#define FUNCTION_JSONB_VERSION 1
+
+#define FUNCTION_STATEMENT_PREFIX "event_manager_function_"
+
+struct function_call {
+    char *                 function;     // Function OID, as text
+    char *                 statement;    // Prepared statement name
+    int                    arg_count;    // Input arguments, in call order
+    char **                arg_names;    // NULL for unnamed arguments
+    Oid *                  arg_types;
+    int                    backend_pid;  // Session the statement was prepared in
+    struct function_call * next;
+};
+
+struct function_call * _get_function_call( const char * );
+struct function_call * _new_function_call( const char *, int );
+bool _set_function_argument( struct function_call *, int, const char *, Oid );
+bool _encode_function_argument( struct arena *, Oid, const char *, char **, int *, int * );
+
+#endif
@@ -0,0 +1,747 @@
+/*------------------------------------------------------------------------
+ *
+ * host_state.c
+ *     Per-host circuit breakers, adaptive concurrency limits and fair
+ *     scheduling for remote URI actions
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        host_state.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "util.h"
+#include "string_builder.h"
+#include "host_state.h"
+
+// Weight of the newest call in the moving latency average
+#define LATENCY_SMOOTHING 0.2
+// Rate at which the baseline follows latency above it
+#define BASELINE_DRIFT 0.01
+// Time constant of the decaying busy time used for host shares
+#define SHARE_WINDOW_MS 60000.0
+
+static struct host_state *     host_states = NULL;
+static struct breaker_settings settings    = {
+    0.5,    // failure_rate
+    5,      // min_requests
+    60000,  // window_ms
+    30000,  // open_ms
+    0       // slow_call_ms
+};
+static struct concurrency_settings concurrency = {
+    16,     // max_limit
+    2.0,    // latency_tolerance
+    0.5     // backoff
+};
+
+// Busy time of all hosts, decayed alongside each host's busy_ms
+static double         total_busy_ms  = 0;
+static struct timeval busy_decayed   = {0};
+static double         max_host_share = 0.5;
+
+static long _elapsed_ms( struct timeval * );
+static void _set_breaker( struct host_state *, int );
+static int _compare_schedule( const void *, const void * );
+static int _compare_latency( const void *, const void * );
+
+/*
+ * void _configure_breakers( struct breaker_settings * new_settings )
+ *     Sets the thresholds used by every host's breaker
+ *
+ * Arguments:
+ *     struct breaker_settings * new_settings: Thresholds to apply.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _configure_breakers( struct breaker_settings * new_settings )
+{
+    settings = *new_settings;
+    return;
+}
+
+/*
+ * struct host_state * _get_host_state( const char * host )
+ *     Looks up the state for a host, creating a closed breaker for hosts
+ *     not seen before.
+ *
+ * Arguments:
+ *     const char * host: Host name, as extracted from the action's URI.
+ * Return:
+ *     struct host_state *: State for the host, NULL on allocation failure
+ *                          or NULL host. Owned by the registry.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+struct host_state * _get_host_state( const char * host )
+{
+    struct host_state * state = NULL;
+
+    if( host == NULL )
+    {
+        return NULL;
+    }
+
+    for( state = host_states; state != NULL; state = state->next )
+    {
+        if( strcmp( state->host, host ) == 0 )
+        {
+            return state;
+        }
+    }
+
+    state = ( struct host_state * ) calloc( 1, sizeof( struct host_state ) );
+
+    if( state == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for host state"
+        );
+
+        return NULL;
+    }
+
+    state->host = strdup( host );
+
+    if( state->host == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for host state"
+        );
+
+        free( state );
+        return NULL;
+    }
+
+    state->breaker           = BREAKER_CLOSED;
+    state->concurrency_limit = 1;
+    gettimeofday( &state->window_start, NULL );
+
+    state->next = host_states;
+    host_states = state;
+
+    return state;
+}
+
+/*
+ * void _record_host_result(
+ *     struct host_state * state,
+ *     bool success,
+ *     long latency_ms
+ * )
+ *     Feeds the outcome of a call into the host's breaker. A closed breaker
+ *     opens once the failure rate over the current window reaches the
+ *     threshold, a half-open breaker closes on success and reopens on
+ *     failure. Calls slower than slow_call_ms count as failures. The
+ *     latency is also kept for _latency_percentile_ms().
+ *
+ * Arguments:
+ *     struct host_state * state: Host the call was made to.
+ *     bool success:              Whether the host handled the call. Client
+ *                                errors (HTTP 4xx) should count as success.
+ *     long latency_ms:           Duration of the call.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     - Emits warning when a breaker opens.
+ */
+void _record_host_result( struct host_state * state, bool success, long latency_ms )
+{
+    if( state == NULL )
+    {
+        return;
+    }
+
+    state->latency_ms = state->latency_ms == 0
+                      ? latency_ms
+                      : state->latency_ms * ( 1 - LATENCY_SMOOTHING )
+                      + latency_ms * LATENCY_SMOOTHING;
+
+    state->latency_samples[state->sample_next] = latency_ms;
+    state->sample_next = ( state->sample_next + 1 ) % LATENCY_SAMPLES;
+
+    if( state->sample_count < LATENCY_SAMPLES )
+    {
+        state->sample_count++;
+    }
+
+    if( success && settings.slow_call_ms > 0 && latency_ms > settings.slow_call_ms )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "Call to %s took %ldms, counted as a failure",
+            state->host,
+            latency_ms
+        );
+
+        success = false;
+    }
+
+    if( state->breaker == BREAKER_HALF_OPEN )
+    {
+        _set_breaker( state, success ? BREAKER_CLOSED : BREAKER_OPEN );
+        return;
+    }
+
+    if( state->breaker == BREAKER_OPEN )
+    {
+        return;
+    }
+
+    if( _elapsed_ms( &state->window_start ) > settings.window_ms )
+    {
+        gettimeofday( &state->window_start, NULL );
+        state->window_requests = 0;
+        state->window_failures = 0;
+    }
+
+    state->window_requests++;
+
+    if( !success )
+    {
+        state->window_failures++;
+    }
+
+    if(
+            state->window_requests >= settings.min_requests
+         && state->window_failures >= settings.failure_rate * state->window_requests
+      )
+    {
+        _set_breaker( state, BREAKER_OPEN );
+    }
+
+    return;
+}
+
+/*
+ * int _open_hosts_array( struct string_builder * output )
+ *     Writes the hosts whose breakers are open as a PostgreSQL TEXT[]
+ *     literal, so that the work queue dequeue can leave their items in
+ *     the queue. Open breakers that have cooled down become half-open
+ *     here, and are left out of the list so one trial call is claimed.
+ *
+ * Arguments:
+ *     struct string_builder * output: Buffer for the array literal, reset
+ *                                     first.
+ * Return:
+ *     int: Number of open hosts written, -1 on allocation failure.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+int _open_hosts_array( struct string_builder * output )
+{
+    struct host_state * state = NULL;
+    int                 count = 0;
+    bool                ok    = true;
+
+    _string_builder_reset( output );
+    ok = _string_builder_append_char( output, '{' );
+
+    for( state = host_states; state != NULL && ok; state = state->next )
+    {
+        if( state->breaker != BREAKER_OPEN )
+        {
+            continue;
+        }
+
+        if( _elapsed_ms( &state->opened_at ) >= settings.open_ms )
+        {
+            _set_breaker( state, BREAKER_HALF_OPEN );
+            continue;
+        }
+
+        if( count > 0 )
+        {
+            ok = _string_builder_append_char( output, ',' );
+        }
+
+        ok = ok && _string_builder_append_array_element( output, state->host );
+        count++;
+    }
+
+    if( !ok || !_string_builder_append_char( output, '}' ) )
+    {
+        return -1;
+    }
+
+    return count;
+}
+
+/*
+ * long _next_breaker_timeout_ms( void )
+ *     Time until the next open breaker is due a half-open trial, so that
+ *     the queue loop can wake up and claim the items it left behind.
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     long: Milliseconds until the earliest trial (0 if one is already
+ *           due), -1 when no breaker is open.
+ * Error Conditions:
+ *     None
+ */
+long _next_breaker_timeout_ms( void )
+{
+    struct host_state * state     = NULL;
+    long                remaining = 0;
+    long                earliest  = -1;
+
+    for( state = host_states; state != NULL; state = state->next )
+    {
+        if( state->breaker != BREAKER_OPEN )
+        {
+            continue;
+        }
+
+        remaining = settings.open_ms - _elapsed_ms( &state->opened_at );
+
+        if( remaining < 0 )
+        {
+            remaining = 0;
+        }
+
+        if( earliest < 0 || remaining < earliest )
+        {
+            earliest = remaining;
+        }
+    }
+
+    return earliest;
+}
+
+/*
+ * const char * _breaker_name( int breaker )
+ *     Returns a printable name for a BREAKER_* state
+ */
+const char * _breaker_name( int breaker )
+{
+    switch( breaker )
+    {
+        case BREAKER_CLOSED:
+            return "closed";
+        case BREAKER_OPEN:
+            return "open";
+        case BREAKER_HALF_OPEN:
+            return "half-open";
+        default:
+            return "unknown";
+    }
+}
+
+/*
+ * void _configure_concurrency( struct concurrency_settings * new_settings )
+ *     Sets the parameters used to adapt every host's concurrency limit
+ *
+ * Arguments:
+ *     struct concurrency_settings * new_settings: Parameters to apply.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _configure_concurrency( struct concurrency_settings * new_settings )
+{
+    concurrency = *new_settings;
+    return;
+}
+
+/*
+ * int _concurrency_limit( struct host_state * state )
+ *     Returns the number of calls currently allowed in flight to a host,
+ *     across all daemons
+ *
+ * Arguments:
+ *     struct host_state * state: Host to check.
+ * Return:
+ *     int: Concurrency limit, at least 1.
+ * Error Conditions:
+ *     None
+ */
+int _concurrency_limit( struct host_state * state )
+{
+    if( state == NULL || state->concurrency_limit < 1 )
+    {
+        return 1;
+    }
+
+    return ( int ) state->concurrency_limit;
+}
+
+/*
+ * void _adjust_concurrency(
+ *     struct host_state * state,
+ *     bool overloaded,
+ *     long latency_ms
+ * )
+ *     Adapts a host's concurrency limit to the outcome of a call (AIMD).
+ *     The limit grows by one per limit's worth of calls while latency stays
+ *     within latency_tolerance of the host's baseline, and is multiplied by
+ *     backoff when the host signals overload.
+ *
+ * Arguments:
+ *     struct host_state * state: Host the call was made to.
+ *     bool overloaded:           The call timed out or was answered with
+ *                                HTTP 429 / 503.
+ *     long latency_ms:           Duration of the call.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _adjust_concurrency( struct host_state * state, bool overloaded, long latency_ms )
+{
+    int previous_limit = 0;
+
+    if( state == NULL )
+    {
+        return;
+    }
+
+    previous_limit = _concurrency_limit( state );
+
+    if( overloaded )
+    {
+        state->concurrency_limit = state->concurrency_limit * concurrency.backoff;
+
+        if( state->concurrency_limit < 1 )
+        {
+            state->concurrency_limit = 1;
+        }
+
+        if( _concurrency_limit( state ) < previous_limit )
+        {
+            _log(
+                LOG_LEVEL_INFO,
+                "Concurrency limit for %s cut from %d to %d",
+                state->host,
+                previous_limit,
+                _concurrency_limit( state )
+            );
+        }
+
+        return;
+    }
+
+    // Baseline tracks the fastest recent calls, drifting up slowly
+    if( state->baseline_ms == 0 || latency_ms < state->baseline_ms )
+    {
+        state->baseline_ms = latency_ms;
+    }
+    else
+    {
+        state->baseline_ms = state->baseline_ms
+                           + ( latency_ms - state->baseline_ms ) * BASELINE_DRIFT;
+    }
+
+    if(
+            latency_ms > state->baseline_ms * concurrency.latency_tolerance
+         || state->concurrency_limit >= concurrency.max_limit
+      )
+    {
+        return;
+    }
+
+    state->concurrency_limit = state->concurrency_limit
+                             + 1 / state->concurrency_limit;
+
+    if( state->concurrency_limit > concurrency.max_limit )
+    {
+        state->concurrency_limit = concurrency.max_limit;
+    }
+
+    if( _concurrency_limit( state ) > previous_limit )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Concurrency limit for %s raised to %d (latency %ldms, baseline %.0fms)",
+            state->host,
+            _concurrency_limit( state ),
+            latency_ms,
+            state->baseline_ms
+        );
+    }
+
+    return;
+}
+
+/*
+ * void _configure_host_share( double new_max_share )
+ *     Sets the share of daemon time a host may use while other hosts have
+ *     work queued
+ *
+ * Arguments:
+ *     double new_max_share: Fraction of busy time, 1 to disable.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _configure_host_share( double new_max_share )
+{
+    max_host_share = new_max_share;
+    return;
+}
+
+/*
+ * void _record_host_busy( struct host_state * state, long busy_ms )
+ *     Accounts time spent calling a host. Busy times decay exponentially
+ *     over SHARE_WINDOW_MS, so shares reflect recent work.
+ *
+ * Arguments:
+ *     struct host_state * state: Host that was called.
+ *     long busy_ms:              Duration of the call.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _record_host_busy( struct host_state * state, long busy_ms )
+{
+    struct host_state * other = NULL;
+    double              decay = 1;
+
+    if( state == NULL )
+    {
+        return;
+    }
+
+    if( busy_decayed.tv_sec != 0 )
+    {
+        decay = exp( -_elapsed_ms( &busy_decayed ) / SHARE_WINDOW_MS );
+    }
+
+    for( other = host_states; other != NULL; other = other->next )
+    {
+        other->busy_ms = other->busy_ms * decay;
+    }
+
+    total_busy_ms = total_busy_ms * decay + busy_ms;
+    state->busy_ms = state->busy_ms + busy_ms;
+
+    gettimeofday( &busy_decayed, NULL );
+    state->last_served = busy_decayed;
+
+    return;
+}
+
+/*
+ * int _host_schedule_array( struct string_builder * output )
+ *     Writes known hosts as a PostgreSQL TEXT[] literal in the order their
+ *     work should be claimed: least recently served first, with hosts
+ *     over max_host_share of recent busy time after all others. Hosts
+ *     not yet called are not listed, and are claimed ahead of these.
+ *     LOCAL_WORK_HOST is listed like any other host once it has been
+ *     served.
+ *
+ * Arguments:
+ *     struct string_builder * output: Buffer for the array literal, reset
+ *                                     first.
+ * Return:
+ *     int: Number of hosts written, -1 on allocation failure.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+int _host_schedule_array( struct string_builder * output )
+{
+    struct host_state *  state = NULL;
+    struct host_state ** hosts = NULL;
+    int                  count = 0;
+    int                  i     = 0;
+    bool                 ok    = true;
+
+    for( state = host_states; state != NULL; state = state->next )
+    {
+        count++;
+    }
+
+    _string_builder_reset( output );
+
+    if( count == 0 )
+    {
+        return _string_builder_append( output, "{}", 2 ) ? 0 : -1;
+    }
+
+    hosts = ( struct host_state ** ) malloc( sizeof( struct host_state * ) * count );
+
+    if( hosts == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for host schedule"
+        );
+
+        return -1;
+    }
+
+    for( state = host_states, i = 0; state != NULL; state = state->next, i++ )
+    {
+        hosts[i] = state;
+    }
+
+    qsort( hosts, count, sizeof( struct host_state * ), _compare_schedule );
+
+    ok = _string_builder_append_char( output, '{' );
+
+    for( i = 0; i < count && ok; i++ )
+    {
+        if( i > 0 )
+        {
+            ok = _string_builder_append_char( output, ',' );
+        }
+
+        ok = ok && _string_builder_append_array_element( output, hosts[i]->host );
+    }
+
+    free( hosts );
+
+    if( !ok || !_string_builder_append_char( output, '}' ) )
+    {
+        return -1;
+    }
+
+    return count;
+}
+
+/*
+ * long _latency_percentile_ms( struct host_state * state, int percentile )
+ *     Returns a percentile of the host's last LATENCY_SAMPLES call latencies
+ *
+ * Arguments:
+ *     struct host_state * state: Host to check.
+ *     int percentile:            Percentile, 1 to 99.
+ * Return:
+ *     long: Latency in milliseconds, -1 until LATENCY_MIN_SAMPLES calls
+ *           have been recorded.
+ * Error Conditions:
+ *     None
+ */
+long _latency_percentile_ms( struct host_state * state, int percentile )
+{
+    long sorted[LATENCY_SAMPLES] = {0};
+    int  index                   = 0;
+
+    if( state == NULL || state->sample_count < LATENCY_MIN_SAMPLES )
+    {
+        return -1;
+    }
+
+    memcpy( sorted, state->latency_samples, sizeof( long ) * state->sample_count );
+    qsort( sorted, state->sample_count, sizeof( long ), _compare_latency );
+
+    index = ( state->sample_count * percentile ) / 100;
+
+    if( index >= state->sample_count )
+    {
+        index = state->sample_count - 1;
+    }
+
+    return sorted[index];
+}
+
+/*
+ * static int _compare_latency( const void * a, const void * b )
+ *     qsort() comparator for _latency_percentile_ms()
+ */
+static int _compare_latency( const void * a, const void * b )
+{
+    long left  = *( const long * ) a;
+    long right = *( const long * ) b;
+
+    return ( left > right ) - ( left < right );
+}
+
+/*
+ * static int _compare_schedule( const void * a, const void * b )
+ *     qsort() comparator for _host_schedule_array()
+ */
+static int _compare_schedule( const void * a, const void * b )
+{
+    struct host_state * left  = *( struct host_state ** ) a;
+    struct host_state * right = *( struct host_state ** ) b;
+    bool                left_over  = false;
+    bool                right_over = false;
+
+    if( total_busy_ms > 0 )
+    {
+        left_over  = left->busy_ms > total_busy_ms * max_host_share;
+        right_over = right->busy_ms > total_busy_ms * max_host_share;
+    }
+
+    if( left_over != right_over )
+    {
+        return left_over ? 1 : -1;
+    }
+
+    if( left->last_served.tv_sec != right->last_served.tv_sec )
+    {
+        return left->last_served.tv_sec < right->last_served.tv_sec ? -1 : 1;
+    }
+
+    if( left->last_served.tv_usec != right->last_served.tv_usec )
+    {
+        return left->last_served.tv_usec < right->last_served.tv_usec ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+ * static void _set_breaker( struct host_state * state, int breaker )
+ *     Moves a host's breaker to a new state, logging the transition with
+ *     the statistics that caused it.
+ */
+static void _set_breaker( struct host_state * state, int breaker )
+{
+    _log(
+        breaker == BREAKER_OPEN ? LOG_LEVEL_WARNING : LOG_LEVEL_INFO,
+        "Circuit breaker for %s: %s -> %s "
+        "(%d/%d failed in window, average latency %.0fms)",
+        state->host,
+        _breaker_name( state->breaker ),
+        _breaker_name( breaker ),
+        state->window_failures,
+        state->window_requests,
+        state->latency_ms
+    );
+
+    state->breaker = breaker;
+
+    if( breaker == BREAKER_OPEN )
+    {
+        gettimeofday( &state->opened_at, NULL );
+    }
+    else if( breaker == BREAKER_CLOSED )
+    {
+        gettimeofday( &state->window_start, NULL );
+        state->window_requests = 0;
+        state->window_failures = 0;
+    }
+
+    return;
+}
+
+/*
+ * static long _elapsed_ms( struct timeval * since )
+ *     Milliseconds elapsed since a point in time
+ */
+static long _elapsed_ms( struct timeval * since )
+{
+    struct timeval now = {0};
+
+    gettimeofday( &now, NULL );
+
+    return ( now.tv_sec - since->tv_sec ) * 1000
+         + ( now.tv_usec - since->tv_usec ) / 1000;
+}
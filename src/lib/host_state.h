@@ -0,0 +1,78 @@
+/*------------------------------------------------------------------------
+ *
+ * host_state.h
+ *     Prototypes for the per-host breaker, concurrency and scheduling registry
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        host_state.h
+ *
+ *------------------------------------------------------------------------
+ */
+
+#ifndef HOST_STATE_H
+#define HOST_STATE_H
+#include <stdbool.h>
+#include <sys/time.h>
+#include "string_builder.h"
+
+#define BREAKER_CLOSED 0
+#define BREAKER_OPEN 1
+#define BREAKER_HALF_OPEN 2
+
+// Host of work queue items without one (query, function and local sink actions)
+#define LOCAL_WORK_HOST ""
+
+// Recent call latencies kept per host for percentiles
+#define LATENCY_SAMPLES 128
+// Samples needed before a percentile is reported
+#define LATENCY_MIN_SAMPLES 20
+
+struct breaker_settings {
+    double failure_rate;  // Failed fraction of a window that opens the breaker
+    int    min_requests;  // Requests needed in a window before it can open
+    long   window_ms;     // Length of the failure rate window
+    long   open_ms;       // Time spent open before a half-open trial
+    long   slow_call_ms;  // Calls slower than this count as failures, 0 = off
+};
+
+struct concurrency_settings {
+    int    max_limit;          // Upper bound for a host's concurrency limit
+    double latency_tolerance;  // Latency / baseline ratio that stops growth
+    double backoff;            // Factor applied to the limit when overloaded
+};
+
+struct host_state {
+    char *              host;
+    int                 breaker;
+    struct timeval      opened_at;
+    struct timeval      window_start;
+    int                 window_requests;
+    int                 window_failures;
+    double              latency_ms;        // Moving average of call latency
+    long                latency_samples[LATENCY_SAMPLES];
+    int                 sample_count;
+    int                 sample_next;
+    double              baseline_ms;       // Latency of the host when healthy
+    double              concurrency_limit; // Calls allowed in flight (AIMD)
+    double              busy_ms;           // Decaying sum of call durations
+    struct timeval      last_served;
+    struct host_state * next;
+};
+
+void _configure_breakers( struct breaker_settings * );
+struct host_state * _get_host_state( const char * );
+void _record_host_result( struct host_state *, bool, long );
+int _open_hosts_array( struct string_builder * );
+long _next_breaker_timeout_ms( void );
+const char * _breaker_name( int );
+void _configure_concurrency( struct concurrency_settings * );
+int _concurrency_limit( struct host_state * );
+void _adjust_concurrency( struct host_state *, bool, long );
+void _configure_host_share( double );
+void _record_host_busy( struct host_state *, long );
+int _host_schedule_array( struct string_builder * );
+long _latency_percentile_ms( struct host_state *, int );
+
+#endif
@@ -0,0 +1,619 @@
+/*------------------------------------------------------------------------
+ *
+ * local_sink.c
+ *     Delivery of work items, as newline delimited JSON, to consumers on
+ *     the same host: unix:// (stream socket), fifo:// (named pipe) and
+ *     file:// (appended, rotated by size) action URIs. Lines are buffered
+ *     per sink and written in batches; a line only counts as delivered once
+ *     a flush has written it, and synced it to disk for files.
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        local_sink.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "util.h"
+#include "string_builder.h"
+#include "local_sink.h"
+
+// Rotated file names are <path>.YYYYmmddHHMMSS
+#define SINK_ROTATED_SUFFIX_SIZE 16
+
+static struct local_sink * local_sinks  = NULL;
+static long                rotate_bytes = 104857600;
+
+static const struct {
+    const char * prefix;
+    int          kind;
+} sink_schemes[] = {
+    { "unix://", SINK_UNIX },
+    { "fifo://", SINK_FIFO },
+    { "file://", SINK_FILE }
+};
+
+static struct local_sink * _get_local_sink( const char * );
+static bool _open_local_sink( struct local_sink * );
+static bool _rotate_local_sink( struct local_sink * );
+static bool _flush_local_sink( struct local_sink * );
+static void _close_local_sink( struct local_sink * );
+static const char * _sink_path( const char *, int * );
+
+/*
+ * int _local_sink_kind( const char * uri )
+ *     Identifies action URIs that are delivered to a local sink
+ *
+ * Arguments:
+ *     const char * uri: Action URI.
+ * Return:
+ *     int:              SINK_UNIX, SINK_FIFO, SINK_FILE, or SINK_NONE for
+ *                       remote URIs.
+ * Error Conditions:
+ *     None
+ */
+int _local_sink_kind( const char * uri )
+{
+    int kind = SINK_NONE;
+
+    _sink_path( uri, &kind );
+
+    return kind;
+}
+
+/*
+ * void _configure_local_sinks( long bytes )
+ *     Sets the size at which file:// sinks are rotated
+ *
+ * Arguments:
+ *     long bytes: Rotation size, 0 disables rotation.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _configure_local_sinks( long bytes )
+{
+    rotate_bytes = bytes;
+
+    return;
+}
+
+/*
+ * bool _local_sink_write( const char * uri, const char * line, size_t length )
+ *     Buffers a line for a local sink, writing the buffer out once it is
+ *     full. The line is not delivered until _flush_local_sinks() succeeds,
+ *     and must be retried if the flush fails.
+ *
+ * Arguments:
+ *     const char * uri:  unix://, fifo:// or file:// URI of the sink.
+ *     const char * line: JSON document, without a trailing newline.
+ *     size_t length:     Length of line.
+ * Return:
+ *     bool:              true when the line was accepted.
+ * Error Conditions:
+ *     - Emits error when the URI is not a local sink.
+ *     - Emits error when the sink's buffer is full and cannot be written.
+ *     - Emits error on failure to allocate memory.
+ */
+bool _local_sink_write( const char * uri, const char * line, size_t length )
+{
+    struct local_sink * sink = NULL;
+
+    sink = _get_local_sink( uri );
+
+    if( sink == NULL )
+    {
+        return false;
+    }
+
+    if(
+           sink->buffer.length + length + 1 > SINK_BUFFER_MAX
+        && ( !_flush_local_sink( sink ) || sink->buffer.length + length + 1 > SINK_BUFFER_MAX )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Local sink %s is not accepting writes, %zu bytes are waiting",
+            sink->path,
+            sink->buffer.length
+        );
+
+        return false;
+    }
+
+    if(
+           !_string_builder_append( &( sink->buffer ), line, length )
+        || !_string_builder_append_char( &( sink->buffer ), '\n' )
+      )
+    {
+        return false;
+    }
+
+    if( sink->buffer.length >= SINK_BUFFER_SIZE )
+    {
+        _flush_local_sink( sink );
+    }
+
+    return true;
+}
+
+/*
+ * bool _flush_local_sinks( void )
+ *     Writes out every sink's buffered lines
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     bool: true when every buffer was written.
+ * Error Conditions:
+ *     - Emits error for each sink that could not be opened, written or
+ *       synced. The sink's lines are kept until _discard_local_sinks().
+ */
+bool _flush_local_sinks( void )
+{
+    struct local_sink * sink = NULL;
+    bool                ok   = true;
+
+    for( sink = local_sinks; sink != NULL; sink = sink->next )
+    {
+        if( sink->buffer.length > 0 && !_flush_local_sink( sink ) )
+        {
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+/*
+ * void _discard_local_sinks( void )
+ *     Drops every sink's buffered lines after a failed flush, so that the
+ *     items they belong to can be retried without being written twice
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _discard_local_sinks( void )
+{
+    struct local_sink * sink = NULL;
+
+    for( sink = local_sinks; sink != NULL; sink = sink->next )
+    {
+        _string_builder_reset( &( sink->buffer ) );
+    }
+
+    return;
+}
+
+/*
+ * void _close_local_sinks( void )
+ *     Flushes and closes every sink, releasing the registry
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     None
+ * Error Conditions:
+ *     - Emits error for each sink whose buffered lines could not be
+ *       written, those lines are lost.
+ */
+void _close_local_sinks( void )
+{
+    struct local_sink * sink = NULL;
+    struct local_sink * next = NULL;
+
+    _flush_local_sinks();
+
+    for( sink = local_sinks; sink != NULL; sink = next )
+    {
+        next = sink->next;
+
+        if( sink->buffer.length > 0 )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Discarding %zu unwritten bytes for local sink %s",
+                sink->buffer.length,
+                sink->path
+            );
+        }
+
+        _close_local_sink( sink );
+        _string_builder_free( &( sink->buffer ) );
+        free( sink->path );
+        free( sink );
+    }
+
+    local_sinks = NULL;
+
+    return;
+}
+
+/*
+ * Registry entry for a sink URI, created on first use
+ */
+static struct local_sink * _get_local_sink( const char * uri )
+{
+    struct local_sink * sink = NULL;
+    const char *        path = NULL;
+    int                 kind = SINK_NONE;
+
+    path = _sink_path( uri, &kind );
+
+    if( path == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "'%s' is not a unix://, fifo:// or file:// URI",
+            uri
+        );
+
+        return NULL;
+    }
+
+    for( sink = local_sinks; sink != NULL; sink = sink->next )
+    {
+        if( sink->kind == kind && strcmp( sink->path, path ) == 0 )
+        {
+            return sink;
+        }
+    }
+
+    sink = ( struct local_sink * ) calloc( 1, sizeof( struct local_sink ) );
+
+    if( sink == NULL || ( sink->path = strdup( path ) ) == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for local sink"
+        );
+
+        free( sink );
+        return NULL;
+    }
+
+    sink->kind  = kind;
+    sink->fd    = -1;
+    sink->next  = local_sinks;
+    _string_builder_init( &( sink->buffer ) );
+    local_sinks = sink;
+
+    return sink;
+}
+
+/*
+ * Connects to a socket, opens a FIFO for writing (failing if nothing is
+ * reading it) or opens a file for appending
+ */
+static bool _open_local_sink( struct local_sink * sink )
+{
+    struct sockaddr_un address   = {0};
+    struct stat        file_stat = {0};
+    int                flags     = 0;
+
+    if( sink->kind == SINK_UNIX )
+    {
+        if( strlen( sink->path ) >= sizeof( address.sun_path ) )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Socket path %s is too long",
+                sink->path
+            );
+
+            return false;
+        }
+
+        address.sun_family = AF_UNIX;
+        strcpy( address.sun_path, sink->path );
+        sink->fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+        if(
+               sink->fd >= 0
+            && connect( sink->fd, ( struct sockaddr * ) &address, sizeof( address ) ) != 0
+          )
+        {
+            close( sink->fd );
+            sink->fd = -1;
+        }
+    }
+    else if( sink->kind == SINK_FIFO )
+    {
+        // Non-blocking open fails with ENXIO rather than waiting for a reader
+        sink->fd = open( sink->path, O_WRONLY | O_NONBLOCK );
+
+        if( sink->fd >= 0 )
+        {
+            flags = fcntl( sink->fd, F_GETFL );
+            fcntl( sink->fd, F_SETFL, flags & ~O_NONBLOCK );
+        }
+    }
+    else
+    {
+        sink->fd = open( sink->path, O_WRONLY | O_APPEND | O_CREAT, 0644 );
+
+        if( sink->fd >= 0 && fstat( sink->fd, &file_stat ) == 0 )
+        {
+            sink->file_size = file_stat.st_size;
+        }
+    }
+
+    if( sink->fd < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to open local sink %s: %s",
+            sink->path,
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Moves a file sink aside once the buffered lines would take it past
+ * rotate_bytes, and starts a new file
+ */
+static bool _rotate_local_sink( struct local_sink * sink )
+{
+    char *    rotated = NULL;
+    size_t    size    = 0;
+    time_t    now     = 0;
+    struct tm local   = {0};
+
+    if(
+           rotate_bytes <= 0
+        || sink->file_size == 0
+        || sink->file_size + ( off_t ) sink->buffer.length <= rotate_bytes
+      )
+    {
+        return true;
+    }
+
+    size    = strlen( sink->path ) + SINK_ROTATED_SUFFIX_SIZE;
+    rotated = ( char * ) malloc( size );
+
+    if( rotated == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for local sink rotation"
+        );
+
+        return false;
+    }
+
+    now = time( NULL );
+    localtime_r( &now, &local );
+    snprintf( rotated, size, "%s.", sink->path );
+    strftime( rotated + strlen( rotated ), SINK_ROTATED_SUFFIX_SIZE - 1, "%Y%m%d%H%M%S", &local );
+
+    _close_local_sink( sink );
+
+    if( rename( sink->path, rotated ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to rotate %s to %s: %s",
+            sink->path,
+            rotated,
+            strerror( errno )
+        );
+
+        free( rotated );
+        return false;
+    }
+
+    _log(
+        LOG_LEVEL_INFO,
+        "Rotated local sink %s to %s",
+        sink->path,
+        rotated
+    );
+
+    free( rotated );
+
+    return _open_local_sink( sink );
+}
+
+/*
+ * Writes a sink's buffer in as few calls as possible. After a failed
+ * write the sink is reopened on the next flush, and lines that were
+ * completely written are dropped from the buffer. A partly written line
+ * is truncated away for files and sent again in full on the new socket
+ * connection; a FIFO reader has already received it torn, so the FIFO's
+ * buffer is dropped.
+ */
+static bool _flush_local_sink( struct local_sink * sink )
+{
+    size_t  written   = 0;
+    ssize_t result    = 0;
+    off_t   file_size = 0;
+    int     error     = 0;
+
+    if( sink->fd < 0 && !_open_local_sink( sink ) )
+    {
+        return false;
+    }
+
+    if( sink->kind == SINK_FILE && !_rotate_local_sink( sink ) )
+    {
+        return false;
+    }
+
+    file_size = sink->file_size;
+
+    while( written < sink->buffer.length )
+    {
+        if( sink->kind == SINK_UNIX )
+        {
+            result = send(
+                sink->fd,
+                sink->buffer.data + written,
+                sink->buffer.length - written,
+                MSG_NOSIGNAL
+            );
+        }
+        else
+        {
+            result = write(
+                sink->fd,
+                sink->buffer.data + written,
+                sink->buffer.length - written
+            );
+        }
+
+        if( result < 0 && errno == EINTR )
+        {
+            continue;
+        }
+
+        if( result <= 0 )
+        {
+            break;
+        }
+
+        written += ( size_t ) result;
+    }
+
+    sink->file_size += ( off_t ) written;
+
+    if( written == sink->buffer.length )
+    {
+        _string_builder_reset( &( sink->buffer ) );
+
+        if( sink->kind != SINK_FILE || fsync( sink->fd ) == 0 )
+        {
+            return true;
+        }
+
+        // The lines may not be on disk, their items are retried
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to sync local sink %s: %s",
+            sink->path,
+            strerror( errno )
+        );
+
+        _close_local_sink( sink );
+        return false;
+    }
+
+    error = errno;
+
+    while( written > 0 && sink->buffer.data[written - 1] != '\n' )
+    {
+        written--;
+    }
+
+    _log(
+        LOG_LEVEL_ERROR,
+        "Failed to write to local sink %s: %s",
+        sink->path,
+        strerror( error )
+    );
+
+    if(
+           sink->kind == SINK_FILE
+        && ftruncate( sink->fd, file_size + ( off_t ) written ) != 0
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to remove a partly written line from %s: %s",
+            sink->path,
+            strerror( errno )
+        );
+    }
+
+    _close_local_sink( sink );
+
+    if( sink->kind == SINK_FIFO )
+    {
+        _log(
+            LOG_LEVEL_WARNING,
+            "The last line written to %s may be torn, dropping %zu buffered bytes",
+            sink->path,
+            sink->buffer.length - written
+        );
+
+        _string_builder_reset( &( sink->buffer ) );
+        return false;
+    }
+
+    memmove(
+        sink->buffer.data,
+        sink->buffer.data + written,
+        sink->buffer.length - written + 1
+    );
+    sink->buffer.length = sink->buffer.length - written;
+
+    return false;
+}
+
+/*
+ * Closes a sink's descriptor
+ */
+static void _close_local_sink( struct local_sink * sink )
+{
+    if( sink->fd >= 0 )
+    {
+        close( sink->fd );
+    }
+
+    sink->fd        = -1;
+    sink->file_size = 0;
+
+    return;
+}
+
+/*
+ * Path part of a local sink URI, setting kind, or NULL when the URI is
+ * not a local sink
+ */
+static const char * _sink_path( const char * uri, int * kind )
+{
+    size_t i      = 0;
+    size_t length = 0;
+
+    *kind = SINK_NONE;
+
+    if( uri == NULL )
+    {
+        return NULL;
+    }
+
+    for( i = 0; i < sizeof( sink_schemes ) / sizeof( sink_schemes[0] ); i++ )
+    {
+        length = strlen( sink_schemes[i].prefix );
+
+        if( strncmp( uri, sink_schemes[i].prefix, length ) == 0 && uri[length] != '\0' )
+        {
+            *kind = sink_schemes[i].kind;
+            return uri + length;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,47 @@
+/*------------------------------------------------------------------------
+ *
+ * local_sink.h
+ *     Prototypes for NDJSON delivery to Unix sockets, FIFOs and files
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        local_sink.h
+ *
+ *------------------------------------------------------------------------
+ */
+
+#ifndef LOCAL_SINK_H
+#define LOCAL_SINK_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "string_builder.h"
+
+#define SINK_NONE -1
+#define SINK_UNIX 0
+#define SINK_FIFO 1
+#define SINK_FILE 2
+
+// Buffered lines are written once this many bytes are waiting
+#define SINK_BUFFER_SIZE 65536
+// Writes are refused while a sink that cannot be written holds this much
+#define SINK_BUFFER_MAX ( SINK_BUFFER_SIZE * 16 )
+
+struct local_sink {
+    int                   kind;       // SINK_UNIX, SINK_FIFO or SINK_FILE
+    char *                path;
+    int                   fd;         // -1 when not open
+    off_t                 file_size;  // Bytes in the current file, SINK_FILE
+    struct string_builder buffer;     // Lines not yet written
+    struct local_sink *   next;
+};
+
+int _local_sink_kind( const char * );
+void _configure_local_sinks( long );
+bool _local_sink_write( const char *, const char *, size_t );
+bool _flush_local_sinks( void );
+void _discard_local_sinks( void );
+void _close_local_sinks( void );
+
+#endif
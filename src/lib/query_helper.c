@@ -14,227 +14,409 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <regex.h>
 #include <signal.h>
 #include <stdbool.h>
-#include <math.h>
-#include <curl/curl.h>
 
 #include "util.h"
 #include "query_helper.h"
 
-#define MAX_REGEX_GROUPS 1
-#define MAX_REGEX_MATCHES 100
+// FNV-1a
+#define TEMPLATE_HASH_OFFSET 14695981039346656037UL
+#define TEMPLATE_HASH_PRIME 1099511628211UL
 
-#define JSON_TOKENS 16
+/* Cached templates, at most one per ( kind, id ) */
+static struct query_template * template_cache = NULL;
+
+static struct query_template * _new_query_template( struct arena *, char * );
+static void * _template_alloc( struct arena *, size_t );
+static void _free_query_template( struct query_template * );
+static unsigned long _hash_query_string( char *, int * );
+static bool _is_bindpoint_char( char );
+static bool _is_nullable_bindpoint( char * );
+static int _compare_names( const void *, const void * );
+static int _find_template_name( struct query_template *, char *, int, char *, int );
+static void _bind_template_name( struct query *, int, char *, int );
+static int _compare_members( const void *, const void * );
 
 /*
- * struct query * _new_query( char * query_string )
- *     Generates a query struct from a query string, allowing
- *     statements and their parameters to be passed around in one
- *     neat little package.
+ * struct query_template * _get_query_template(
+ *     int kind,
+ *     char * id,
+ *     char * query_string
+ * )
+ *     Returns the parsed template for a query, parsing it only when the
+ *     ( kind, id ) pair is new or its query text has changed.
  *
  * Arguments:
- *     char * query_string: Statement to be copied into the structure.
+ *     int kind:            Template namespace (QUERY_TEMPLATE_*).
+ *     char * id:           Identifier within that namespace, such as the
+ *                          event_table_work_item or action.
+ *     char * query_string: Query text containing ?key? bindpoints.
  * Return:
- *     struct query *:      Pointer to the allocated query struct.
+ *     struct query_template *: Cached template. NOTE: Owned by the cache,
+ *                              do not free.
  * Error Conditions:
  *     - Emits error on failure to allocate memory.
  */
-struct query * _new_query( char * query_string )
+struct query_template * _get_query_template(
+    int kind,
+    char * id,
+    char * query_string
+)
 {
-    struct query * query_object = NULL;
+    struct query_template * template      = NULL;
+    struct query_template * previous      = NULL;
+    struct query_template * new_template  = NULL;
+    unsigned long           hash          = 0;
+    int                     length        = 0;
 
-    query_object = ( struct query * ) calloc( 1, sizeof( struct query ) );
-
-    if( query_object == NULL )
+    if( id == NULL || query_string == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "Failed to allocate memory for query parameterization structure"
+            "Cannot get template for NULL id or query"
         );
+
         return NULL;
     }
 
-    query_object->length = strlen( query_string );
+    hash = _hash_query_string( query_string, &length );
 
-    query_object->query_string = ( char * ) calloc(
-        ( query_object->length + 1 ),
-        sizeof( char )
-    );
+    for( template = template_cache; template != NULL; template = template->next )
+    {
+        if( template->kind == kind && strcmp( template->id, id ) == 0 )
+        {
+            break;
+        }
+
+        previous = template;
+    }
+
+    if(
+            template != NULL
+         && template->hash == hash
+         && template->length == length
+         && memcmp( template->text, query_string, length ) == 0
+      )
+    {
+        return template;
+    }
+
+    new_template = _new_query_template( NULL, query_string );
+
+    if( new_template == NULL )
+    {
+        return NULL;
+    }
+
+    new_template->kind = kind;
+    new_template->hash = hash;
+    new_template->id   = ( char * ) calloc( strlen( id ) + 1, sizeof( char ) );
 
-    if( query_object->query_string == NULL )
+    if( new_template->id == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "Failed to allocate memory for query string"
+            "Failed to allocate memory for query template id"
         );
 
-        free( query_object );
+        _free_query_template( new_template );
         return NULL;
     }
 
-    strcpy( (char * )( query_object->query_string ), query_string );
-    query_object->_bind_count = 0;
-    query_object->_bind_list = NULL;
+    strcpy( new_template->id, id );
 
-    return query_object;
+    // The query for this id changed, replace the stale template in place
+    if( template != NULL )
+    {
+        _log(
+            LOG_LEVEL_DEBUG,
+            "Query for template %d/%s changed, re-parsing",
+            kind,
+            id
+        );
+
+        new_template->next = template->next;
+
+        if( previous == NULL )
+        {
+            template_cache = new_template;
+        }
+        else
+        {
+            previous->next = new_template;
+        }
+
+        _free_query_template( template );
+        return new_template;
+    }
+
+    new_template->next = template_cache;
+    template_cache     = new_template;
+
+    return new_template;
 }
 
 /*
- * void _finalize_query( struct query * query_object )
- *     Finalizes a query, replacing all remaining unbound placeholders with
- *     SQL NULL.
+ * struct query * _new_query( struct arena * arena, char * query_string )
+ *     Generates a query struct from a query string, allowing
+ *     statements and their parameters to be passed around in one
+ *     neat little package. The query is parsed into an uncached template.
  *
  * Arguments:
- *     struct query * query_object: Query struct containing statement
- *                                  to finalize.
+ *     struct arena * arena: Arena the query, its template and its
+ *                           parameters are allocated from.
+ *     char * query_string:  Statement to be parsed into the structure.
  * Return:
- *     None
+ *     struct query *:       Pointer to the query struct, released with
+ *                           the arena.
  * Error Conditions:
- *     - Emits error on failure to allocate / reallocate string memory
+ *     - Emits error on failure to allocate memory.
  */
-void _finalize_query( struct query * query_object )
+struct query * _new_query( struct arena * arena, char * query_string )
 {
-    regmatch_t matches[MAX_REGEX_GROUPS + 1] = {{0}};
-    regex_t    regex                         = {0};
-    char *     temp_query                    = NULL;
-    int        reg_result                    = 0;
-    int        i                             = 0;
-
-    char * bind_search      = "[?](((OLD)|(NEW))[[:punct:]])?[[:alpha:]_]+[?]";
-    char * bind_replace     = "NULL";
-    int    bindpoint_length = 0;
-
-    if( query_object == NULL )
+    if( query_string == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "NULL query object passed"
+            "Cannot create query from NULL string"
         );
 
-        return;
+        return NULL;
     }
 
-    if( query_object->query_string == NULL )
+    return _new_query_from_template(
+        arena,
+        _new_query_template( arena, query_string )
+    );
+}
+
+/*
+ * struct query * _new_query_from_template(
+ *     struct arena * arena,
+ *     struct query_template * template
+ * )
+ *     Generates a query struct whose bindpoints are filled from a
+ *     pre-parsed template.
+ *
+ * Arguments:
+ *     struct arena * arena:             Arena the query and its parameters
+ *                                       are allocated from.
+ *     struct query_template * template: Template to bind against.
+ * Return:
+ *     struct query *:                   Pointer to the query struct,
+ *                                       released with the arena.
+ * Error Conditions:
+ *     - Emits error on NULL template.
+ *     - Emits error on failure to allocate memory.
+ */
+struct query * _new_query_from_template(
+    struct arena * arena,
+    struct query_template * template
+)
+{
+    struct query * query_object = NULL;
+
+    if( template == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "NULL query string passed in object"
+            "Cannot create query from NULL template"
         );
 
-        _free_query( query_object );
+        return NULL;
+    }
+
+    query_object = ( struct query * ) _arena_alloc(
+        arena,
+        sizeof( struct query )
+      + ( sizeof( char * ) + sizeof( bool ) ) * template->name_count
+    );
 
-        return;
+    if( query_object == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for query parameterization structure"
+        );
+        return NULL;
     }
 
-    reg_result = regcomp( &regex, bind_search, REG_EXTENDED );
+    query_object->_arena    = arena;
+    query_object->_template = template;
+    query_object->_values   = ( char ** ) ( query_object + 1 );
+    query_object->_bound    = ( bool * ) ( query_object->_values + template->name_count );
+
+    return query_object;
+}
 
-    if( reg_result != 0 )
+/*
+ * bool _finalize_query( struct query * query_object )
+ *     Renders the query in a single pass over its template: bound
+ *     bindpoints become $n placeholders (in order of first appearance),
+ *     and remaining ?[OLD.|NEW.]word? placeholders become SQL NULL.
+ *
+ * Arguments:
+ *     struct query * query_object: Query struct containing statement
+ *                                  to finalize.
+ * Return:
+ *     bool:                        true on success, false if the query
+ *                                  could not be rendered.
+ * Error Conditions:
+ *     - Emits error if binding a parameter previously failed
+ *     - Emits error on failure to allocate string memory
+ */
+bool _finalize_query( struct query * query_object )
+{
+    struct query_template * template       = NULL;
+    struct template_slot *  slot           = NULL;
+    int *                   param_numbers  = NULL;
+    char *                  output         = NULL;
+    int                     length         = 0;
+    int                     position       = 0;
+    int                     literal_start  = 0;
+    int                     i              = 0;
+    int                     name_index     = 0;
+
+    if( query_object == NULL || query_object->_template == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "Failed to compile regular expression (_finalize_query)"
+            "NULL query object passed"
         );
 
-        _free_query( query_object );
+        return false;
+    }
 
-        return;
+    if( query_object->_error )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Cannot finalize query, parameter binding failed"
+        );
+
+        return false;
     }
 
-    for( i = 0; i < MAX_REGEX_MATCHES; i++ )
+    template = query_object->_template;
+    query_object->_bind_count = 0;
+
+    if( template->name_count > 0 )
     {
-        reg_result = regexec(
-            &regex,
-            query_object->query_string,
-            MAX_REGEX_GROUPS,
-            matches,
-            0
+        param_numbers = ( int * ) _arena_alloc(
+            query_object->_arena,
+            sizeof( int ) * template->name_count
         );
 
-        if( matches[0].rm_so == -1 || reg_result == REG_NOMATCH )
-        {
-            break;
-        }
-        else if( reg_result != 0 )
+        query_object->_bind_list = ( char ** ) _arena_alloc(
+            query_object->_arena,
+            sizeof( char * ) * template->name_count
+        );
+
+        if( param_numbers == NULL || query_object->_bind_list == NULL )
         {
             _log(
                 LOG_LEVEL_ERROR,
-                "Failed to execute regular expression"
+                "Failed to allocate memory for query parameter list"
             );
 
-            _free_query( query_object );
-            regfree( &regex );
-
-            return;
+            query_object->_error = true;
+            return false;
         }
+    }
 
-        bindpoint_length = matches[0].rm_eo - matches[0].rm_so;
+    // Number the bound parameters and size the output exactly
+    length = template->length;
 
-        temp_query = ( char * ) calloc(
-            (
-                strlen( query_object->query_string )
-             - bindpoint_length
-             + strlen( bind_replace )
-             + 1
-            ),
-            sizeof( char )
-        );
+    for( i = 0; i < template->slot_count; i++ )
+    {
+        slot       = &template->slots[i];
+        name_index = slot->name_index;
 
-        if( temp_query == NULL )
+        if( query_object->_bound[name_index] )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for string resize operation"
-            );
-
-            _free_query( query_object );
-            regfree( &regex );
+            if( param_numbers[name_index] == 0 )
+            {
+                query_object->_bind_list[query_object->_bind_count] = query_object->_values[name_index];
+                query_object->_bind_count++;
+                param_numbers[name_index] = query_object->_bind_count;
+            }
 
-            return;
+            length = length
+                   - ( slot->end - slot->start )
+                   + snprintf( NULL, 0, "$%d", param_numbers[name_index] );
+        }
+        else if( template->null_if_unbound[name_index] )
+        {
+            length = length - ( slot->end - slot->start ) + 4;
         }
+    }
 
-        strncpy(
-            temp_query,
-            query_object->query_string,
-            matches[0].rm_so
-        );
+    output = ( char * ) _arena_alloc( query_object->_arena, length + 1 );
 
-        strcat(
-            temp_query,
-            bind_replace
+    if( output == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for query string"
         );
 
-        strcat(
-            temp_query,
-            ( char * ) ( query_object->query_string + matches[0].rm_eo )
-        );
+        query_object->_error = true;
+        return false;
+    }
 
-        query_object->query_string = ( char * ) realloc(
-            ( void * ) query_object->query_string,
-            strlen( temp_query ) + 1
-        );
+    for( i = 0; i < template->slot_count; i++ )
+    {
+        slot       = &template->slots[i];
+        name_index = slot->name_index;
 
-        if( query_object->query_string == NULL )
+        if(
+               !query_object->_bound[name_index]
+            && !template->null_if_unbound[name_index]
+          )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to reallocate memory for query string"
-            );
+            // Left as literal text
+            continue;
+        }
+
+        memcpy(
+            output + position,
+            template->text + literal_start,
+            slot->start - literal_start
+        );
 
-            free( temp_query );
-            regfree( &regex );
+        position = position + slot->start - literal_start;
 
-            return;
+        if( query_object->_bound[name_index] )
+        {
+            position = position + sprintf(
+                output + position,
+                "$%d",
+                param_numbers[name_index]
+            );
+        }
+        else
+        {
+            memcpy( output + position, "NULL", 4 );
+            position = position + 4;
         }
 
-        strcpy( query_object->query_string, temp_query );
-        free( temp_query );
+        literal_start = slot->end;
     }
 
-    regfree( &regex );
+    memcpy(
+        output + position,
+        template->text + literal_start,
+        template->length - literal_start
+    );
 
-    return;
+    position = position + template->length - literal_start;
+    output[position] = '\0';
+
+    query_object->query_string = output;
+    query_object->length       = position;
+
+    return true;
 }
 
 /*
@@ -243,11 +425,9 @@ void _finalize_query( struct query * query_object )
  *     char * key,
  *     char * value
  * )
- *     Adds parameter to query structure. This performs several actions:
- *         - Creates a new indexed bindpoint for the named parameter
- *         - Replace all appearances of the named bindpoint with bindpoint index
- *              EX: ?some_parameter?  becomes $4
- *         - Pushes parameter onto the param_list at that index position
+ *     Binds a value to the named bindpoint of the query's template. The
+ *     first value bound to a name wins, later ones are ignored. Names that
+ *     do not appear in the query are ignored.
  *
  * Arguments:
  *     - struct query * query_object: Query struct to add the parameter to.
@@ -257,9 +437,8 @@ void _finalize_query( struct query * query_object )
  * Return:
  *     None
  * Error Conditions:
- *     - Emits error on failure to allocate string memory
- *     - Emits error on regular expression compilation failure
- *     - Emits error on regular expression execution failure
+ *     - Emits error on failure to allocate string memory, flagging the
+ *       query so that _finalize_query fails
  */
 void _add_parameter_to_query(
     struct query * query_object,
@@ -267,17 +446,9 @@ void _add_parameter_to_query(
     char * value
 )
 {
-    regmatch_t matches[MAX_REGEX_GROUPS + 1] = {{0}};
-    regex_t    regex                         = {0};
-    char *     temp_query                    = NULL;
-    int        reg_result                    = 0;
-    int        i                             = 0;
-    int        bind_length                   = 0;
-    int        bind_counter                  = 0;
-    char *     bindpoint_search              = NULL;
-    char *     bindpoint_replace             = NULL;
+    int name_index = 0;
 
-    if( query_object == NULL )
+    if( query_object == NULL || query_object->_template == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
@@ -287,272 +458,72 @@ void _add_parameter_to_query(
         return;
     }
 
-    if( query_object->query_string == NULL )
+    if( key == NULL )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Cannot parameterize NULL query string"
-        );
-
-        _free_query( query_object );
-
         return;
     }
 
-    bindpoint_search = ( char * ) calloc(
-        ( strlen( key ) + 7 ),
-        sizeof( char )
+    name_index = _find_template_name(
+        query_object->_template,
+        NULL,
+        0,
+        key,
+        strlen( key )
     );
 
-    if( bindpoint_search == NULL )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to allocate memory for regular expression"
-        );
-        _free_query( query_object );
-        return;
-    }
-
-    strcpy( bindpoint_search, "[?]" );
-    strcat( bindpoint_search, key );
-    strcat( bindpoint_search, "[?]" );
-
-    reg_result = regcomp( &regex, bindpoint_search, REG_EXTENDED );
-
-    if( reg_result != 0 )
+    if( name_index < 0 )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to compile bindpoint search regular expression"
-        );
-
-        free( bindpoint_search );
-        _free_query( query_object );
-
         return;
     }
 
-    bindpoint_replace = ( char * ) calloc(
-        (int) ( floor( log10( abs( query_object->_bind_count + 1 ) ) ) + 3 ),
-        sizeof( char )
+    _bind_template_name(
+        query_object,
+        name_index,
+        value,
+        value == NULL ? 0 : strlen( value )
     );
 
-    if( bindpoint_replace == NULL )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to allocate memory for replacement string in regular "
-            "expression"
-        );
-
-        free( bindpoint_search );
-        _free_query( query_object );
-        regfree( &regex );
-
-        return;
-    }
-
-    sprintf( bindpoint_replace, "$%d", query_object->_bind_count + 1 );
-
-    for( i = 0; i < MAX_REGEX_MATCHES; i++ )
-    {
-        reg_result = regexec(
-            &regex,
-            query_object->query_string,
-            MAX_REGEX_GROUPS,
-            matches,
-            0
-        );
-
-        if( matches[0].rm_so == -1 || reg_result == REG_NOMATCH )
-        {
-            break;
-        }
-        else if( reg_result != 0 )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to execute regular expression search"
-            );
-
-            free( bindpoint_search );
-            _free_query( query_object );
-            free( bindpoint_replace );
-            regfree( &regex );
-
-            return;
-        }
-
-        bind_counter++;
-
-        bind_length = matches[0].rm_eo - matches[0].rm_so;
-        temp_query = ( char * ) calloc(
-            (
-                strlen( query_object->query_string )
-              - bind_length
-              + strlen( bindpoint_replace )
-              + 1
-            ),
-            sizeof( char )
-        );
-
-        if( temp_query == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for string resize operation"
-            );
-
-            free( bindpoint_search );
-            free( query_object );
-            free( bindpoint_replace );
-            regfree( &regex );
-            _free_query( query_object );
-
-            return;
-        }
-
-        strncpy(
-            temp_query,
-            query_object->query_string,
-            matches[0].rm_so
-        );
-
-        strcat(
-            temp_query,
-            bindpoint_replace
-        );
-
-        strcat(
-            temp_query,
-            ( char * ) ( query_object->query_string + matches[0].rm_eo )
-        );
-
-        free( query_object->query_string );
-
-        query_object->query_string = ( char * ) calloc(
-            ( strlen( temp_query ) + 1 ),
-            sizeof( char )
-        );
-
-        if( query_object->query_string == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for resized string"
-            );
-
-            free( bindpoint_search );
-            _free_query( query_object );
-            free( bindpoint_replace );
-            regfree( &regex );
-            free( temp_query );
-
-            return;
-        }
-
-        strcpy( query_object->query_string, temp_query );
-        query_object->length = strlen( temp_query );
-        free( temp_query );
-    }
-
-    free( bindpoint_search );
-    free( bindpoint_replace );
-    regfree( &regex );
-
-    if( bind_counter > 0 )
-    {
-        if( query_object->_bind_count == 0 )
-        {
-            query_object->_bind_list = ( char ** ) calloc(
-                1,
-                sizeof( char * )
-            );
-        }
-        else
-        {
-            query_object->_bind_list = ( char ** ) realloc(
-                query_object->_bind_list,
-                sizeof( char * ) * ( query_object->_bind_count + 1 )
-            );
-        }
-
-        if( query_object->_bind_list == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for query parameter"
-            );
-
-            _free_query( query_object );
-
-            return;
-        }
-
-        if( value == NULL )
-        {
-            query_object->_bind_list[query_object->_bind_count] = NULL;
-        }
-        else
-        {
-            query_object->_bind_list[query_object->_bind_count] = ( char * ) calloc(
-                ( strlen( value ) + 1 ),
-                sizeof( char )
-            );
-
-            strcpy( query_object->_bind_list[query_object->_bind_count], value );
-        }
-
-        query_object->_bind_count = query_object->_bind_count + 1;
-    }
-
     return;
 }
 
 /*
  * void _add_json_parameter_to_query(
  *     struct query * query_obj,
- *     char * json_string,
+ *     struct json_object * json,
  *     char * key_prefix
  * )
- *     Adds the key-value pairs from a JSON object to a query
+ *     Adds the key-value pairs from a parsed JSON object to a query. Walks
+ *     whichever side is smaller: the query's bindpoint names (looked up in
+ *     the JSON's key index) or the JSON's members (looked up in the
+ *     template's name list).
  *
  * Arguments:
- *     struct query * query_obj: Query struct to add the parameters to
- *     char * json_string:       JSON containing the key-value pairs to be
- *                               added.
- *     char * key_prefix:        Optional key prefix for the JSON strings
- *                               being added to the query. Allows support for
- *                               NEW and OLD psuedorecords to be added as
- *                               ?OLD.key?, for example.
+ *     struct query * query_obj:  Query struct to add the parameters to
+ *     struct json_object * json: Parsed JSON containing the key-value pairs
+ *                                to be added.
+ *     char * key_prefix:         Optional key prefix for the JSON strings
+ *                                being added to the query. Allows support for
+ *                                NEW and OLD psuedorecords to be added as
+ *                                ?OLD.key?, for example.
  * Return:
  *     None
  * Error Conditions:
  *     - Emits error on failure to allocate string memory
- *     - Emits error on failure to parse JSON object
- *     - Emits error on invalid JSON structure (ARRAY / SCALAR )
  *     - Emits error on receipt of invalid arguments (NULL query object)
  */
 void _add_json_parameter_to_query(
     struct query * query_obj,
-    char * json_string,
+    struct json_object * json,
     char * key_prefix
 )
 {
-    jsmntok_t * json_tokens      = NULL;
-    jsmntok_t   json_key_token   = {0};
-    jsmntok_t   json_value_token = {0};
-    jsmntok_t   temp_token       = {0};
-    char *      key              = NULL;
-    char *      value            = NULL;
-    int         i                = 0;
-    int         j                = 0;
-    int         end_index        = 0;
-    int         max_tokens       = 0;
-    int         key_size_offset  = 0;
+    struct query_template * template      = NULL;
+    struct json_member *    member        = NULL;
+    int                     name_index    = 0;
+    int                     prefix_length = 0;
+    int                     i             = 0;
 
-    if( json_string == NULL )
+    if( json == NULL )
     {
         _log(
             LOG_LEVEL_DEBUG,
@@ -561,7 +532,7 @@ void _add_json_parameter_to_query(
         return;
     }
 
-    if( query_obj == NULL )
+    if( query_obj == NULL || query_obj->_template == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
@@ -570,679 +541,912 @@ void _add_json_parameter_to_query(
         return;
     }
 
-    if( query_obj->query_string == NULL )
+    template = query_obj->_template;
+
+    if( key_prefix != NULL )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Cannot parameterize NULL query string"
-        );
-        _free_query( query_obj );
-        return;
+        prefix_length = strlen( key_prefix );
     }
 
-    json_tokens = json_tokenise( json_string, &max_tokens );
+    if( template->name_count < json->member_count )
+    {
+        for( i = 0; i < template->name_count; i++ )
+        {
+            if(
+                    query_obj->_bound[i]
+                 || strncmp( template->names[i], key_prefix == NULL ? "" : key_prefix, prefix_length ) != 0
+              )
+            {
+                continue;
+            }
+
+            member = _json_object_get(
+                json,
+                template->names[i] + prefix_length,
+                strlen( template->names[i] ) - prefix_length
+            );
 
-    if( json_tokens == NULL )
+            if( member != NULL )
+            {
+                _bind_template_name(
+                    query_obj,
+                    i,
+                    member->is_null ? NULL : member->value,
+                    member->value_length
+                );
+            }
+        }
+
+        return;
+    }
+
+    for( i = 0; i < json->member_count; i++ )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to tokenise JSON string for binding to query"
+        member     = &json->members[i];
+        name_index = _find_template_name(
+            template,
+            key_prefix,
+            prefix_length,
+            member->key,
+            member->key_length
         );
-        _free_query( query_obj );
-        return;
+
+        if( name_index >= 0 )
+        {
+            _bind_template_name(
+                query_obj,
+                name_index,
+                member->is_null ? NULL : member->value,
+                member->value_length
+            );
+        }
     }
 
-    // JSMN returns OBJECT, KEY, VALUE, ...
-    //  We're expecting at least an object with one key and one value
-    if( json_tokens[0].type != JSMN_OBJECT )
+    return;
+}
+
+/*
+ * void _debug_struct( struct query * obj )
+ *     Emits the structure on STDOUT
+ *
+ * Arguments:
+ *     struct query * obj: Struct to dump
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _debug_struct( struct query * obj )
+{
+    int i = 0;
+    _log( LOG_LEVEL_DEBUG, "Query object: " );
+    _log( LOG_LEVEL_DEBUG, "==============" );
+    _log(
+        LOG_LEVEL_DEBUG,
+        "query_string: '%s'",
+        obj->query_string == NULL ? "(not finalized)" : obj->query_string
+    );
+    _log( LOG_LEVEL_DEBUG, "length: %d", obj->length );
+    _log( LOG_LEVEL_DEBUG, "_bind_count: %d", obj->_bind_count );
+    _log( LOG_LEVEL_DEBUG, "_bind_list: " );
+
+    for( i = 0; i < obj->_bind_count; i++ )
+    {
+        _log( LOG_LEVEL_DEBUG, "%d: '%s'", i, obj->_bind_list[i] );
+    }
+
+    return;
+}
+
+/*
+ * static struct query_template * _new_query_template(
+ *     struct arena * arena,
+ *     char * query_string
+ * )
+ *     Parses a query into literal text and ?name? slots, with a sorted,
+ *     de-duplicated list of the names the slots refer to.
+ *
+ * Arguments:
+ *     struct arena * arena: Arena to allocate from, or NULL for a heap
+ *                           allocated (cacheable) template.
+ *     char * query_string:  Query text to parse.
+ * Return:
+ *     struct query_template *: Template. Heap templates must be freed with
+ *                              _free_query_template().
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+static struct query_template * _new_query_template(
+    struct arena * arena,
+    char * query_string
+)
+{
+    struct query_template * template      = NULL;
+    char **                 slot_names    = NULL;
+    char **                 found         = NULL;
+    int                     marker_count  = 0;
+    int                     name_offset   = 0;
+    int                     i             = 0;
+    int                     j             = 0;
+
+    template = ( struct query_template * ) _template_alloc(
+        arena,
+        sizeof( struct query_template )
+    );
+
+    if( template == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "Root element of JSON response is not an object"
+            "Failed to allocate memory for query template"
         );
-        _free_query( query_obj );
-        free( json_tokens );
-        return;
+
+        return NULL;
     }
 
-    if( max_tokens < 3 )
+    template->length = strlen( query_string );
+    template->text   = ( char * ) _template_alloc( arena, template->length + 1 );
+
+    // Every name is a substring of the query, so the query length bounds them
+    template->_name_buffer = ( char * ) _template_alloc( arena, template->length + 1 );
+
+    if( template->text == NULL || template->_name_buffer == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "JSON response is empty"
+            "Failed to allocate memory for query template text"
         );
 
-        _log(
-            LOG_LEVEL_DEBUG,
-            "Got '%s', (%d tokens )",
-            json_string,
-            max_tokens
-        );
-        _free_query( query_obj );
-        free( json_tokens );
-        return;
+        if( arena == NULL )
+        {
+            _free_query_template( template );
+        }
+
+        return NULL;
     }
 
-    i = 1;
-    _log( LOG_LEVEL_DEBUG, "Parsing JSON '%s'", json_string );
+    memcpy( template->text, query_string, template->length );
 
-    if( key_prefix != NULL )
+    for( i = 0; i < template->length; i++ )
     {
-        key_size_offset = strlen( key_prefix );
+        if( query_string[i] == '?' )
+        {
+            marker_count++;
+        }
     }
 
-    for(;;)
+    if( marker_count < 2 )
     {
-        json_key_token = json_tokens[i];
+        return template;
+    }
+
+    template->slots = ( struct template_slot * ) _template_alloc(
+        arena,
+        sizeof( struct template_slot ) * ( marker_count / 2 )
+    );
+
+    slot_names = ( char ** ) _template_alloc(
+        arena,
+        sizeof( char * ) * ( marker_count / 2 )
+    );
+
+    if( template->slots == NULL || slot_names == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for query template slots"
+        );
 
-        if( json_key_token.type != JSMN_STRING )
+        if( arena == NULL )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Expected string key in JSON structure (got %d at index %d)",
-                json_key_token.type,
-                i
-            );
-            free( json_tokens );
-            _free_query( query_obj );
-            return;
+            free( slot_names );
+            _free_query_template( template );
         }
 
-        key = ( char * ) calloc(
-            ( json_key_token.end - json_key_token.start + 1 + key_size_offset ),
-            sizeof( char )
-        );
+        return NULL;
+    }
+
+    i = 0;
 
-        if( key == NULL )
+    while( i < template->length )
+    {
+        if( query_string[i] != '?' )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for JSON key string"
-            );
-            _free_query( query_obj );
-            free( json_tokens );
-            return;
+            i++;
+            continue;
         }
 
-        if( key_prefix != NULL )
+        for( j = i + 1; j < template->length && _is_bindpoint_char( query_string[j] ); j++ );
+
+        if( j >= template->length || query_string[j] != '?' || j == i + 1 )
         {
-            strcpy( key, key_prefix );
+            i++;
+            continue;
         }
 
-        strncat(
-            key,
-            ( char * ) ( json_string + json_key_token.start ),
-            json_key_token.end - json_key_token.start
-        );
+        template->slots[template->slot_count].start = i;
+        template->slots[template->slot_count].end   = j + 1;
 
-        key[key_size_offset + json_key_token.end - json_key_token.start] = '\0';
+        slot_names[template->slot_count] = template->_name_buffer + name_offset;
+        memcpy( template->_name_buffer + name_offset, query_string + i + 1, j - i - 1 );
+        name_offset = name_offset + j - i;
 
-        i++;
+        template->slot_count++;
+        i = j + 1;
+    }
 
-        if( i >= ( max_tokens ) )
+    if( template->slot_count == 0 )
+    {
+        if( arena == NULL )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Reached unexpected end of JSON object"
-            );
-            free( key );
-            free( json_tokens );
-            _free_query( query_obj );
-            return;
+            free( slot_names );
         }
 
-        json_value_token = json_tokens[i];
+        return template;
+    }
+
+    template->names = ( char ** ) _template_alloc(
+        arena,
+        sizeof( char * ) * template->slot_count
+    );
 
-        value = ( char * ) calloc(
-            ( json_value_token.end - json_value_token.start + 1 ),
-            sizeof( char )
+    template->null_if_unbound = ( bool * ) _template_alloc(
+        arena,
+        sizeof( bool ) * template->slot_count
+    );
+
+    if( template->names == NULL || template->null_if_unbound == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for query template names"
         );
 
-        if( value == NULL )
+        if( arena == NULL )
         {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for JSON value string"
-            );
-            _free_query( query_obj );
-            free( json_tokens );
-            free( key );
-            return;
+            free( slot_names );
+            _free_query_template( template );
         }
 
-        strncpy(
-            value,
-            ( char * ) ( json_string + json_value_token.start ),
-            json_value_token.end - json_value_token.start
-        );
+        return NULL;
+    }
 
-        value[json_value_token.end - json_value_token.start] = '\0';
+    memcpy( template->names, slot_names, sizeof( char * ) * template->slot_count );
+    qsort( template->names, template->slot_count, sizeof( char * ), _compare_names );
 
+    for( i = 0; i < template->slot_count; i++ )
+    {
         if(
-             json_value_token.type == JSMN_OBJECT ||
-             json_value_token.type == JSMN_ARRAY
+                template->name_count == 0
+             || strcmp( template->names[template->name_count - 1], template->names[i] ) != 0
           )
         {
-            // index i to point to the next key by finding the index of the
-            //  first token that is >= our value's end index
-            end_index = json_value_token.end;
-
-            for( j = i; j < max_tokens; j++ )
-            {
-                temp_token = json_tokens[j];
-                if( temp_token.start >= end_index )
-                {
-                    i = j;
-                    break;
-                }
-            }
-
-            // The value which is an object or key somehow was last thing in
-            // our json object
-            i = max_tokens;
-        }
-
-        if( strcmp( value, "null" ) == 0 || strcmp( value, "NULL" ) == 0 )
-        {
-            free( value );
-            value = NULL;
+            template->names[template->name_count] = template->names[i];
+            template->null_if_unbound[template->name_count] = _is_nullable_bindpoint(
+                template->names[i]
+            );
+            template->name_count++;
         }
+    }
 
-        _add_parameter_to_query(
-            query_obj,
-            key,
-            value
+    for( i = 0; i < template->slot_count; i++ )
+    {
+        found = ( char ** ) bsearch(
+            &slot_names[i],
+            template->names,
+            template->name_count,
+            sizeof( char * ),
+            _compare_names
         );
 
-        _log( LOG_LEVEL_DEBUG, "Potentially bound KV: %s,%s", key, value );
-        free( key );
-
-        if( value != NULL )
-        {
-            free( value );
-        }
-
-        if( i >=  ( max_tokens - 1 ) )
-        {
-            break;
-        }
+        template->slots[i].name_index = ( int ) ( found - template->names );
+    }
 
-        i++;
+    if( arena == NULL )
+    {
+        free( slot_names );
     }
 
-    free( json_tokens );
-    return;
+    return template;
 }
 
 /*
- * void _debug_struct( struct query * obj )
- *     Emits the structure on STDOUT
+ * static void _free_query_template( struct query_template * template )
+ *     Frees a template that is not (or no longer) in the cache
  *
  * Arguments:
- *     struct query * obj: Struct to dump
+ *     struct query_template * template: Template to free
  * Return:
  *     None
  * Error Conditions:
  *     None
  */
-void _debug_struct( struct query * obj )
+static void _free_query_template( struct query_template * template )
 {
-    int i = 0;
-    _log( LOG_LEVEL_DEBUG, "Query object: " );
-    _log( LOG_LEVEL_DEBUG, "==============" );
-    _log( LOG_LEVEL_DEBUG, "query_string: '%s'", obj->query_string );
-    _log( LOG_LEVEL_DEBUG, "length: %d", obj->length );
-    _log( LOG_LEVEL_DEBUG, "_bind_count: %d", obj->_bind_count );
-    _log( LOG_LEVEL_DEBUG, "_bind_list: " );
-
-    for( i = 0; i < obj->_bind_count; i++ )
+    if( template == NULL )
     {
-        _log( LOG_LEVEL_DEBUG, "%d: '%s'", i, obj->_bind_list[i] );
+        return;
     }
 
+    free( template->id );
+    free( template->text );
+    free( template->slots );
+    free( template->names );
+    free( template->null_if_unbound );
+    free( template->_name_buffer );
+    free( template );
+
     return;
 }
 
 /*
- * void _free_query( struct query * query_object )
- *     Frees the memory allocated to internal query struct strings and
- *     parameter lists.
+ * static void * _template_alloc( struct arena * arena, size_t size )
+ *     Zeroed allocation from the arena, or from the heap for cached templates
+ */
+static void * _template_alloc( struct arena * arena, size_t size )
+{
+    if( arena == NULL )
+    {
+        return calloc( 1, size );
+    }
+
+    return _arena_alloc( arena, size );
+}
+
+/*
+ * static unsigned long _hash_query_string( char * query_string, int * length )
+ *     FNV-1a hash of a query's text, used to detect changed queries
  *
  * Arguments:
- *     struct query * query_object: Struct to free
+ *     char * query_string: Query text to hash.
+ *     int * length:        Set to the length of query_string
+ *                          (pass by reference).
  * Return:
- *     None
+ *     unsigned long hash
  * Error Conditions:
  *     None
  */
-void _free_query( struct query * query_object )
+static unsigned long _hash_query_string( char * query_string, int * length )
 {
-    int i = 0;
+    unsigned long hash = TEMPLATE_HASH_OFFSET;
+    int           i    = 0;
 
-    if( query_object == NULL )
+    for( i = 0; query_string[i] != '\0'; i++ )
     {
-        return;
+        hash = ( hash ^ ( unsigned char ) query_string[i] ) * TEMPLATE_HASH_PRIME;
     }
 
-    if( query_object->query_string != NULL )
+    *length = i;
+    return hash;
+}
+
+/*
+ * static bool _is_bindpoint_char( char c )
+ *     Characters allowed between the ?'s of a bindpoint: identifiers,
+ *     plus '.' for OLD. / NEW. prefixes and namespaced GUC names
+ */
+static bool _is_bindpoint_char( char c )
+{
+    return ( c >= 'a' && c <= 'z' )
+        || ( c >= 'A' && c <= 'Z' )
+        || ( c >= '0' && c <= '9' )
+        || c == '_'
+        || c == '.';
+}
+
+/*
+ * static bool _is_nullable_bindpoint( char * name )
+ *     Whether an unbound bindpoint is replaced with NULL, i.e. whether it
+ *     is of the form [OLD.|NEW.]word
+ */
+static bool _is_nullable_bindpoint( char * name )
+{
+    if( strncmp( name, "OLD.", 4 ) == 0 || strncmp( name, "NEW.", 4 ) == 0 )
     {
-        free( query_object->query_string );
+        name = name + 4;
     }
 
-    if( query_object->_bind_list != NULL )
+    if( *name == '\0' )
     {
-        if( query_object->_bind_count > 0 )
+        return false;
+    }
+
+    for( ; *name != '\0'; name++ )
+    {
+        if( *name == '.' )
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * static int _compare_names( const void * a, const void * b )
+ *     qsort / bsearch comparator for arrays of strings
+ */
+static int _compare_names( const void * a, const void * b )
+{
+    return strcmp( *( char * const * ) a, *( char * const * ) b );
+}
+
+/*
+ * static int _find_template_name(
+ *     struct query_template * template,
+ *     char * prefix,
+ *     int prefix_length,
+ *     char * key,
+ *     int key_length
+ * )
+ *     Binary searches the template's names for prefix || key, without
+ *     building the concatenated string
+ *
+ * Arguments:
+ *     struct query_template * template: Template to search.
+ *     char * prefix:                    Optional key prefix (may be NULL).
+ *     int prefix_length:                Length of prefix.
+ *     char * key:                       Key, not necessarily NUL terminated.
+ *     int key_length:                   Length of key.
+ * Return:
+ *     int index into template->names, or -1 when not found
+ * Error Conditions:
+ *     None
+ */
+static int _find_template_name(
+    struct query_template * template,
+    char * prefix,
+    int prefix_length,
+    char * key,
+    int key_length
+)
+{
+    int           low        = 0;
+    int           high       = template->name_count - 1;
+    int           middle     = 0;
+    int           comparison = 0;
+    int           i          = 0;
+    unsigned char c          = 0;
+    unsigned char * name     = NULL;
+
+    while( low <= high )
+    {
+        middle     = low + ( high - low ) / 2;
+        name       = ( unsigned char * ) template->names[middle];
+        comparison = 0;
+
+        for( i = 0; i < prefix_length + key_length; i++ )
         {
-            for( i = 0; i < query_object->_bind_count; i++ )
+            c = ( unsigned char ) ( i < prefix_length ? prefix[i] : key[i - prefix_length] );
+
+            if( name[i] == '\0' || c != name[i] )
             {
-                if( query_object->_bind_list[i] != NULL )
-                {
-                    free( query_object->_bind_list[i] );
-                }
+                comparison = ( name[i] == '\0' ) ? 1 : ( int ) c - ( int ) name[i];
+                break;
             }
         }
 
-        free( query_object->_bind_list );
-    }
+        if( comparison == 0 && name[i] != '\0' )
+        {
+            comparison = -1;
+        }
 
-    free( query_object );
+        if( comparison == 0 )
+        {
+            return middle;
+        }
 
-    return;
+        if( comparison < 0 )
+        {
+            high = middle - 1;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    return -1;
 }
 
 /*
- * void _add_json_parameters_to_param_list(
- *     CURL * curl_handle,
- *     char * param_list,
- *     char * json_string,
- *     int * malloc_size
+ * static void _bind_template_name(
+ *     struct query * query_object,
+ *     int name_index,
+ *     char * value,
+ *     int value_length
  * )
- *    Adds the parameters from the json_string to a URI's parameter list.
- *    Example:
- *        {"key1":"val1","key2":"val2"}
- *    becomes:
- *        key1=val1&key2=val2
-
+ *     Binds a value to a template slot, unless the slot is already bound.
+ *     NUL terminated values are referenced in place (they live in a
+ *     PGresult or a parsed JSON working copy, both of which outlive the
+ *     query), anything else is copied into the query's arena.
+ *
  * Arguments:
- *     CURL * curl_handle: Handle to the CuRL global state / handle.
- *     char * param_list:  URI parameter list.
- *     char * json_string: JSON object to get new parameters from.
- *     int * malloc_size:  Current size in sizeof( char ) of param_list,
- *                         may be adjusted as parameters are added
- *                         (pass by reference).
+ *     struct query * query_object: Query being bound.
+ *     int name_index:              Index of the name in the template.
+ *     char * value:                Value (not necessarily NUL terminated),
+ *                                  NULL binds SQL NULL. Must outlive the
+ *                                  query when NUL terminated.
+ *     int value_length:            Length of value.
  * Return:
  *     None
  * Error Conditions:
- *     - Emits error on failure to allocate string memory.
- *     - Emits error on failure to parse JSON object.
- *     - Emits error on receipt of invalid JSON structure (ARRAY / SCALAR ).
+ *     - Emits error on failure to allocate memory, flagging the query
  */
-void _add_json_parameters_to_param_list(
-    CURL * curl_handle,
-    char * param_list,
-    char * json_string,
-    int * malloc_size
+static void _bind_template_name(
+    struct query * query_object,
+    int name_index,
+    char * value,
+    int value_length
 )
 {
-    jsmntok_t * json_tokens      = NULL;
-    jsmntok_t   json_key_token   = {0};
-    jsmntok_t   json_value_token = {0};
-    jsmntok_t   temp_token       = {0};
-    int         end_index        = 0;
-    int         j                = 0;
-    int         i                = 0;
-    int         max_tokens       = 0;
-    bool        first_param_pass = true;
-    char      * encoded_value    = NULL;
-    char      * value            = NULL;
-
-    if( param_list == NULL )
+    if( query_object->_bound[name_index] )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Received NULL URI parameter list"
-        );
-
         return;
     }
 
-    if( json_string == NULL )
-    {
-        _log( LOG_LEVEL_DEBUG, "Nothing to bind" );
+    query_object->_bound[name_index] = true;
 
+    if( value == NULL )
+    {
         return;
     }
 
-    json_tokens = json_tokenise( json_string, &max_tokens );
-
-    if( json_tokens == NULL )
+    if( value[value_length] == '\0' )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to tokenise JSON string for binding to parameter_list"
-        );
-
+        query_object->_values[name_index] = value;
         return;
     }
 
-    // JSMN returns OBJECT, KEY, VALUE, ...
-    //  We're expecting at least an object with one key and one value
-    if( json_tokens[0].type != JSMN_OBJECT )
+    query_object->_values[name_index] = _arena_strndup(
+        query_object->_arena,
+        value,
+        value_length
+    );
+
+    if( query_object->_values[name_index] == NULL )
     {
         _log(
             LOG_LEVEL_ERROR,
-            "Root element of JSON response is not an object"
+            "Failed to allocate memory for query parameter"
         );
 
+        query_object->_error = true;
         return;
     }
 
-    if( max_tokens < 3 )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "JSON response is empty"
-        );
-
-        _log(
-            LOG_LEVEL_DEBUG,
-            "Got '%s', (%d tokens )",
-            json_string,
-            max_tokens
-        );
+    return;
+}
 
-        free( json_tokens );
+/*
+ * bool _add_json_parameters_to_param_list(
+ *     struct string_builder * param_list,
+ *     size_t list_start,
+ *     struct json_object * json
+ * )
+ *    Appends the parameters from a parsed JSON object to a URI's parameter
+ *    list, URL encoding values directly into the buffer.
+ *    Example:
+ *        {"key1":"val1","key2":"val2"}
+ *    becomes:
+ *        key1=val1&key2=val2
 
-        return;
-    }
+ * Arguments:
+ *     struct string_builder * param_list: URI parameter list to append to.
+ *     size_t list_start:                  Offset at which the parameter list
+ *                                         begins within param_list. Pairs
+ *                                         appended after it are separated
+ *                                         by '&'.
+ *     struct json_object * json:          Parsed JSON object to get new
+ *                                         parameters from.
+ * Return:
+ *     bool:                               false on failure to grow the list.
+ * Error Conditions:
+ *     - Emits error on failure to allocate string memory
+ */
+bool _add_json_parameters_to_param_list(
+    struct string_builder * param_list,
+    size_t list_start,
+    struct json_object * json
+)
+{
+    struct json_member * member = NULL;
+    int                  i      = 0;
 
-    i = 1;
+    if( json == NULL || json->member_count == 0 )
+    {
+        _log( LOG_LEVEL_DEBUG, "Nothing to bind" );
 
-    _log( LOG_LEVEL_DEBUG, "Parsing JSON '%s'", json_string );
+        return true;
+    }
 
-    for(;;)
+    for( i = 0; i < json->member_count; i++ )
     {
-        json_key_token = json_tokens[i];
+        member = &json->members[i];
 
-        if( json_key_token.type != JSMN_STRING )
+        if(
+                (
+                    param_list->length > list_start
+                 && !_string_builder_append_char( param_list, '&' )
+                )
+             || !_string_builder_append( param_list, member->key, member->key_length )
+             || !_string_builder_append_char( param_list, '=' )
+             || !_string_builder_append_url_encoded(
+                    param_list,
+                    member->value,
+                    member->value_length
+                )
+          )
         {
             _log(
                 LOG_LEVEL_ERROR,
-                "Expected string key in JSON structure (got %d at index %d)",
-                json_key_token.type,
-                i
+                "Failed to append parameter '%s' to parameter list",
+                member->key
             );
 
-            free( json_tokens );
-            free( param_list );
-
-            return;
-        }
-
-        *malloc_size = *malloc_size
-                     + json_key_token.end
-                     - json_key_token.start
-                     + 2;
-
-        if( first_param_pass == true )
-        {
-            *malloc_size = *malloc_size - 1;
+            return false;
         }
+    }
 
-        param_list = ( char * ) realloc(
-            ( char * ) param_list,
-            sizeof( char ) * (*malloc_size)
-        );
-
-        if( param_list == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to reallocate memory for parameter string key"
-            );
-
-            free( json_tokens );
+    _log(
+        LOG_LEVEL_DEBUG,
+        "PARAM LIST: '%s' (%zu)",
+        param_list->data + list_start,
+        param_list->length - list_start
+    );
 
-            return;
-        }
+    return true;
+}
 
-        if( first_param_pass == false )
-        {
-            strcat( param_list, "&" );
-        }
+/*
+ * struct json_object * _parse_json_object(
+ *     struct arena * arena,
+ *     char * json_string
+ * )
+ *     Parses a JSON object once into its members, so that every consumer
+ *     of a payload (GUCs, query binding, URI parameters) can share it.
+ *     Tokens are counted first, and the object, its members, a key-sorted
+ *     member index, the tokens and a working copy of the JSON text are
+ *     carved out of a single allocation. Member keys and values are NUL
+ *     terminated in place within the working copy, so they can be handed
+ *     to libpq without further copies.
+ *
+ * Arguments:
+ *     struct arena * arena: Arena the parsed object is allocated from.
+ *     char * json_string:   JSON object text. Not modified.
+ * Return:
+ *     struct json_object *: Parsed object, NULL if json_string is NULL or
+ *                           invalid. Released with the arena.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ *     - Emits error on failure to parse JSON.
+ *     - Emits error on invalid JSON structure (ARRAY / SCALAR)
+ */
+struct json_object * _parse_json_object(
+    struct arena * arena,
+    char * json_string
+)
+{
+    struct json_object * object       = NULL;
+    struct json_member * member       = NULL;
+    jsmntok_t *          value_token  = NULL;
+    jsmn_parser          parser       = {0};
+    size_t               length       = 0;
+    int                  token_count  = 0;
+    int                  max_members  = 0;
+    int                  i            = 0;
 
-        first_param_pass = false;
+    if( json_string == NULL )
+    {
+        return NULL;
+    }
 
-        strncat(
-            param_list,
-            ( char * ) ( json_string + json_key_token.start ),
-            json_key_token.end - json_key_token.start
-        );
+    length = strlen( json_string );
 
-        param_list[*malloc_size - 1] = '\0';
+    jsmn_init( &parser );
+    token_count = jsmn_parse( &parser, json_string, length, NULL, 0 );
 
+    if( token_count <= 0 )
+    {
         _log(
-            LOG_LEVEL_DEBUG,
-            "PARAM LIST: '%s' (%d)",
-            param_list,
-            *malloc_size
+            LOG_LEVEL_ERROR,
+            "Failed to parse JSON string: invalid, partial or empty string"
         );
 
-        i++;
-
-        if( i >= ( max_tokens ) )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Reached unexpected end of JSON object"
-            );
-
-            free( param_list );
-            free( json_tokens );
+        return NULL;
+    }
 
-            return;
-        }
+    // Every member is at least a key and a value token
+    max_members = ( token_count - 1 ) / 2;
 
-        json_value_token = json_tokens[i];
+    object = ( struct json_object * ) _arena_alloc(
+        arena,
+        sizeof( struct json_object )
+      + sizeof( struct json_member ) * max_members
+      + sizeof( struct json_member * ) * max_members
+      + sizeof( jsmntok_t ) * token_count
+      + length + 1
+    );
 
-        value = calloc(
-            json_value_token.end - json_value_token.start + 1,
-            sizeof( char )
+    if( object == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for JSON object"
         );
 
-        if( value == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to allocate memory for URL encoding operation"
-            );
+        return NULL;
+    }
 
-            free( json_tokens );
-            free( param_list );
+    object->members     = ( struct json_member * ) ( object + 1 );
+    object->_index      = ( struct json_member ** ) ( object->members + max_members );
+    object->tokens      = ( jsmntok_t * ) ( object->_index + max_members );
+    object->json_string = ( char * ) ( object->tokens + token_count );
 
-            return;
-        }
+    memcpy( object->json_string, json_string, length );
+    json_string = object->json_string;
 
-        strncpy(
-            value,
-            ( char * ) ( json_string + json_value_token.start ),
-            json_value_token.end - json_value_token.start
-        );
+    jsmn_init( &parser );
+    object->token_count = jsmn_parse(
+        &parser,
+        json_string,
+        length,
+        object->tokens,
+        token_count
+    );
 
-        value[json_value_token.end - json_value_token.start] = '\0';
-        encoded_value = curl_easy_escape(
-            curl_handle,
-            ( const char * ) value,
-            strlen( value )
+    if( object->token_count != token_count )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to parse JSON string: received invalid partial string"
         );
 
-        free( value );
-
-        if( encoded_value == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "URL Encoding operation failed"
-            );
+        return NULL;
+    }
 
-            free( json_tokens );
-            free( param_list );
+    if( object->tokens[0].type != JSMN_OBJECT )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Root element of JSON structure is not an object"
+        );
 
-            return;
-        }
+        return NULL;
+    }
 
-        *malloc_size = *malloc_size + strlen( encoded_value ) + 2;
-        param_list = ( char * ) realloc(
-            ( char * ) param_list,
-            *malloc_size
-        );
+    i = 1;
 
-        if( param_list == NULL )
+    while( i + 1 < token_count )
+    {
+        if( object->tokens[i].type != JSMN_STRING )
         {
             _log(
                 LOG_LEVEL_ERROR,
-                "Failed to reallocate memory for parameter string value"
+                "Expected string key in JSON structure (got %d at index %d)",
+                object->tokens[i].type,
+                i
             );
 
-            free( json_tokens );
-            free( param_list );
-            curl_free( encoded_value );
-
-            return;
+            return NULL;
         }
 
-        strcat( param_list, "=" );
-
-        strcat(
-            param_list,
-            encoded_value
-        );
-
-        curl_free( encoded_value );
-        param_list[*malloc_size - 1] = '\0';
-
-        if(
-            json_value_token.type == JSMN_OBJECT ||
-            json_value_token.type == JSMN_ARRAY
-          )
+        value_token = &object->tokens[i + 1];
+        member      = &object->members[object->member_count];
+
+        member->key          = json_string + object->tokens[i].start;
+        member->key_length   = object->tokens[i].end - object->tokens[i].start;
+        member->value        = json_string + value_token->start;
+        member->value_length = value_token->end - value_token->start;
+        member->type         = value_token->type;
+        member->is_null      = (
+                                    member->value_length == 4
+                                 && (
+                                        strncmp( member->value, "null", 4 ) == 0
+                                     || strncmp( member->value, "NULL", 4 ) == 0
+                                    )
+                               );
+
+        // Terminate on the closing quote, or the delimiter after a primitive
+        member->key[member->key_length]     = '\0';
+        member->value[member->value_length] = '\0';
+
+        object->_index[object->member_count] = member;
+        object->member_count++;
+
+        // Skip past any tokens nested within the value
+        for( i = i + 2; i < token_count; i++ )
         {
-            // index i to point to the next key by finding the index of the
-            //  first token that is >= our value's end index
-            end_index = json_value_token.end;
-
-            for( j = i; j < max_tokens; j++ )
+            if( object->tokens[i].start >= value_token->end )
             {
-                temp_token = json_tokens[j];
-                if( temp_token.start >= end_index )
-                {
-                    i = j;
-                    break;
-                }
+                break;
             }
-
-            // The value which is an object or key somehow was last thing in
-            // our json object
-            i = max_tokens;
-        }
-
-        if( i >=  ( max_tokens - 1 ) )
-        {
-            break;
         }
-
-        i++;
     }
 
-    free( json_tokens );
-    return;
+    qsort(
+        object->_index,
+        object->member_count,
+        sizeof( struct json_member * ),
+        _compare_members
+    );
+
+    return object;
 }
 
 /*
- * jsmntok_t * json_tokenise( char * json, int * token_count )
- *     Converts a JSON string into an array of JSMN tokens
+ * struct json_member * _json_object_get(
+ *     struct json_object * object,
+ *     char * key,
+ *     int key_length
+ * )
+ *     Looks up a member of a parsed JSON object by key
  *
  * Arguments:
- *     char * json:        JSON string to tokenise.
- *     int * token_count:  Count of tokens found within the JSON string.
+ *     struct json_object * object: Parsed JSON object.
+ *     char * key:                  Key, not necessarily NUL terminated.
+ *     int key_length:              Length of key.
  * Return:
- *     jsmntok_t * tokens: Array of JSMN tokens from JSON string.
- *                         NOTE: The caller is responsible for freeing this.
+ *     struct json_member *:        Matching member, or NULL
  * Error Conditions:
- *     - Emits error on failure to allocate memory for a token block.
- *     - Emits error on failure to parse JSON.
+ *     None
  */
-jsmntok_t * json_tokenise( char * json, int * token_count )
+struct json_member * _json_object_get(
+    struct json_object * object,
+    char * key,
+    int key_length
+)
 {
-    jsmn_parser  parser  = {0};
-    int          jsmn_rc = 0;
-    jsmntok_t *  tokens  = NULL;
-    unsigned int n       = JSON_TOKENS;
-
-    jsmn_init( &parser );
-
-    tokens = ( jsmntok_t * ) malloc(
-        sizeof( jsmntok_t )
-      * n
-    );
+    struct json_member   search     = {0};
+    struct json_member * search_ptr = &search;
+    struct json_member ** found     = NULL;
 
-    if( tokens == NULL )
+    if( object == NULL || object->member_count == 0 )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to allocate memory for JSON tokenisation"
-        );
         return NULL;
     }
 
-    jsmn_rc = jsmn_parse( &parser, json, strlen( json ), tokens, n );
+    search.key        = key;
+    search.key_length = key_length;
 
-    // Keep reallocating memory in JSON_TOKENS chunks until
-    // The entire JSON structure can fit
+    found = ( struct json_member ** ) bsearch(
+        &search_ptr,
+        object->_index,
+        object->member_count,
+        sizeof( struct json_member * ),
+        _compare_members
+    );
 
-    while( jsmn_rc == JSMN_ERROR_NOMEM )
+    if( found == NULL )
     {
-        n = n + JSON_TOKENS;
-
-        tokens = realloc(
-            tokens,
-            sizeof( jsmntok_t )
-          * n
-        );
-
-        if( tokens == NULL )
-        {
-            _log(
-                LOG_LEVEL_ERROR,
-                "Failed to reallocate memory for JSON tokenisation"
-            );
-            return NULL;
-        }
-
-        jsmn_rc = jsmn_parse( &parser, json, strlen( json ), tokens, n );
+        return NULL;
     }
 
-    if( jsmn_rc == JSMN_ERROR_INVAL )
-    {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to parse JSON string: invalid or corrupted string"
-        );
+    return *found;
+}
 
-        free( tokens );
-        return NULL;
-    }
+/*
+ * static int _compare_members( const void * a, const void * b )
+ *     qsort / bsearch comparator for arrays of json_member pointers, by key
+ */
+static int _compare_members( const void * a, const void * b )
+{
+    const struct json_member * member_a = *( struct json_member * const * ) a;
+    const struct json_member * member_b = *( struct json_member * const * ) b;
+    int                        result   = 0;
+
+    result = memcmp(
+        member_a->key,
+        member_b->key,
+        member_a->key_length < member_b->key_length
+            ? member_a->key_length
+            : member_b->key_length
+    );
 
-    if( jsmn_rc == JSMN_ERROR_PART )
+    if( result != 0 )
     {
-        _log(
-            LOG_LEVEL_ERROR,
-            "Failed to parse JSON string: received invalid partial string"
-        );
-        free( tokens );
-
-        return NULL;
+        return result;
     }
 
-    *token_count = jsmn_rc;
-    return tokens;
+    return member_a->key_length - member_b->key_length;
 }
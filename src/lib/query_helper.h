@@ -13,22 +13,76 @@
 
 #ifndef QUERY_HELPER_H
 #define QUERY_HELPER_H
-#include <curl/curl.h>
+#include <stdbool.h>
 #include "jsmn/jsmn.h"
+#include "arena.h"
+#include "string_builder.h"
+
+// Query template cache namespaces
+#define QUERY_TEMPLATE_WORK_ITEM 1
+#define QUERY_TEMPLATE_ACTION 2
+#define QUERY_TEMPLATE_SET_UID 3
+
+struct template_slot {
+    int start;      // Offset of the opening '?'
+    int end;        // Offset just past the closing '?'
+    int name_index; // Index into the template's sorted name list
+};
+
+struct query_template {
+    int                     kind;
+    char *                  id;
+    unsigned long           hash;
+    char *                  text;
+    int                     length;
+    struct template_slot *  slots;
+    int                     slot_count;
+    char **                 names;
+    bool *                  null_if_unbound;
+    int                     name_count;
+    char *                  _name_buffer;
+    struct query_template * next;
+};
+
 struct query {
-    char *  query_string;
-    int     length;
-    char ** _bind_list;
-    int     _bind_count;
+    char *                  query_string;
+    int                     length;
+    char **                 _bind_list;
+    int                     _bind_count;
+    struct query_template * _template;
+    char **                 _values;
+    bool *                  _bound;
+    bool                    _error;
+    struct arena *          _arena;
+};
+
+struct json_member {
+    char * key;         // NUL terminated, within the object's working copy
+    int    key_length;
+    char * value;       // NUL terminated and unquoted, as key
+    int    value_length;
+    int    type;        // jsmntype_t of the value
+    bool   is_null;
+};
+
+struct json_object {
+    char *                json_string;  // Working copy, members point into it
+    jsmntok_t *           tokens;
+    int                   token_count;
+    struct json_member *  members;      // In document order
+    int                   member_count;
+    struct json_member ** _index;       // Sorted by key
 };
 
-struct query * _new_query( char * );
-void _finalize_query( struct query * );
+struct query_template * _get_query_template( int, char *, char * );
+struct query * _new_query( struct arena *, char * );
+struct query * _new_query_from_template( struct arena *, struct query_template * );
+bool _finalize_query( struct query * );
 void _add_parameter_to_query( struct query *, char *, char * );
-void _add_json_parameter_to_query( struct query *, char *, char * );
-void _free_query( struct query * );
+void _add_json_parameter_to_query( struct query *, struct json_object *, char * );
 void _debug_struct( struct query * );
-jsmntok_t * json_tokenise( char *, int * );
-void _add_json_parameters_to_param_list( CURL *, char *, char *, int * );
+struct json_object * _parse_json_object( struct arena *, char * );
+struct json_member * _json_object_get( struct json_object *, char *, int );
+bool _add_json_parameters_to_param_list( struct string_builder *, size_t, struct json_object * );
 
 #endif
@@ -0,0 +1,221 @@
+/*------------------------------------------------------------------------
+ *
+ * rate_limit.c
+ *     Local tracking of rate limited actions and hosts. The token buckets
+ *     themselves live in tb_rate_bucket so that every daemon shares them;
+ *     this registry remembers which buckets are empty, and for how long,
+ *     so their work queue items can be left in the queue.
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        rate_limit.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "util.h"
+#include "string_builder.h"
+#include "rate_limit.h"
+
+static struct rate_limit * rate_limits = NULL;
+
+static long _remaining_throttle_ms( struct rate_limit * );
+
+/*
+ * void _throttle( int kind, const char * name, long wait_ms )
+ *     Leaves an action or host's work queue items in the queue for a
+ *     while, such as until its token bucket has refilled.
+ *
+ * Arguments:
+ *     int kind:          RATE_LIMIT_ACTION or RATE_LIMIT_HOST.
+ *     const char * name: Action number or host name.
+ *     long wait_ms:      Time to hold the action or host back for.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory, in which case the
+ *       bucket is not throttled locally and is checked again on the next
+ *       dequeue.
+ */
+void _throttle( int kind, const char * name, long wait_ms )
+{
+    struct rate_limit * limit = NULL;
+
+    for( limit = rate_limits; limit != NULL; limit = limit->next )
+    {
+        if( limit->kind == kind && strcmp( limit->name, name ) == 0 )
+        {
+            break;
+        }
+    }
+
+    if( limit == NULL )
+    {
+        limit = ( struct rate_limit * ) calloc( 1, sizeof( struct rate_limit ) );
+
+        if( limit == NULL || ( limit->name = strdup( name ) ) == NULL )
+        {
+            _log(
+                LOG_LEVEL_ERROR,
+                "Failed to allocate memory for rate limit"
+            );
+
+            free( limit );
+            return;
+        }
+
+        limit->kind = kind;
+        limit->next = rate_limits;
+        rate_limits = limit;
+    }
+
+    gettimeofday( &limit->throttled_until, NULL );
+    limit->throttled_until.tv_sec  += wait_ms / 1000;
+    limit->throttled_until.tv_usec += ( wait_ms % 1000 ) * 1000;
+
+    if( limit->throttled_until.tv_usec >= 1000000 )
+    {
+        limit->throttled_until.tv_sec++;
+        limit->throttled_until.tv_usec -= 1000000;
+    }
+
+    _log(
+        LOG_LEVEL_DEBUG,
+        "Holding back %s %s for %ldms",
+        kind == RATE_LIMIT_ACTION ? "action" : "host",
+        name,
+        wait_ms
+    );
+
+    return;
+}
+
+/*
+ * bool _is_throttled( int kind, const char * name )
+ *     Checks whether an action or host is currently held back
+ *
+ * Arguments:
+ *     int kind:          RATE_LIMIT_ACTION or RATE_LIMIT_HOST.
+ *     const char * name: Action number or host name.
+ * Return:
+ *     bool:              true while the throttle has not expired.
+ * Error Conditions:
+ *     None
+ */
+bool _is_throttled( int kind, const char * name )
+{
+    struct rate_limit * limit = NULL;
+
+    for( limit = rate_limits; limit != NULL; limit = limit->next )
+    {
+        if( limit->kind == kind && strcmp( limit->name, name ) == 0 )
+        {
+            return _remaining_throttle_ms( limit ) > 0;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * int _throttled_array( int kind, struct string_builder * output )
+ *     Writes the currently throttled actions or hosts as a PostgreSQL
+ *     array literal for the work queue dequeue.
+ *
+ * Arguments:
+ *     int kind:                       RATE_LIMIT_ACTION or RATE_LIMIT_HOST.
+ *     struct string_builder * output: Buffer for the array literal, reset
+ *                                     first.
+ * Return:
+ *     int: Number of entries written, -1 on allocation failure.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+int _throttled_array( int kind, struct string_builder * output )
+{
+    struct rate_limit * limit = NULL;
+    int                 count = 0;
+    bool                ok    = true;
+
+    _string_builder_reset( output );
+    ok = _string_builder_append_char( output, '{' );
+
+    for( limit = rate_limits; limit != NULL && ok; limit = limit->next )
+    {
+        if( limit->kind != kind || _remaining_throttle_ms( limit ) <= 0 )
+        {
+            continue;
+        }
+
+        if( count > 0 )
+        {
+            ok = _string_builder_append_char( output, ',' );
+        }
+
+        ok = ok && _string_builder_append_array_element( output, limit->name );
+        count++;
+    }
+
+    if( !ok || !_string_builder_append_char( output, '}' ) )
+    {
+        return -1;
+    }
+
+    return count;
+}
+
+/*
+ * long _next_throttle_timeout_ms( void )
+ *     Time until the next throttled action or host may be called again
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     long: Milliseconds until the earliest throttle expires, -1 when
+ *           nothing is throttled.
+ * Error Conditions:
+ *     None
+ */
+long _next_throttle_timeout_ms( void )
+{
+    struct rate_limit * limit     = NULL;
+    long                remaining = 0;
+    long                earliest  = -1;
+
+    for( limit = rate_limits; limit != NULL; limit = limit->next )
+    {
+        remaining = _remaining_throttle_ms( limit );
+
+        if( remaining <= 0 )
+        {
+            continue;
+        }
+
+        if( earliest < 0 || remaining < earliest )
+        {
+            earliest = remaining;
+        }
+    }
+
+    return earliest;
+}
+
+/*
+ * static long _remaining_throttle_ms( struct rate_limit * limit )
+ *     Milliseconds left before a throttled bucket has a token again
+ */
+static long _remaining_throttle_ms( struct rate_limit * limit )
+{
+    struct timeval now = {0};
+
+    gettimeofday( &now, NULL );
+
+    return ( limit->throttled_until.tv_sec - now.tv_sec ) * 1000
+         + ( limit->throttled_until.tv_usec - now.tv_usec ) / 1000;
+}
@@ -0,0 +1,35 @@
+/*------------------------------------------------------------------------
+ *
+ * rate_limit.h
+ *     Prototypes for local tracking of rate limited actions and hosts
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        rate_limit.h
+ *
+ *------------------------------------------------------------------------
+ */
+
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+#include <stdbool.h>
+#include <sys/time.h>
+#include "string_builder.h"
+
+#define RATE_LIMIT_ACTION 0
+#define RATE_LIMIT_HOST 1
+
+struct rate_limit {
+    int                 kind;             // RATE_LIMIT_ACTION or RATE_LIMIT_HOST
+    char *              name;             // Action number or host name
+    struct timeval      throttled_until;
+    struct rate_limit * next;
+};
+
+void _throttle( int, const char *, long );
+bool _is_throttled( int, const char * );
+int _throttled_array( int, struct string_builder * );
+long _next_throttle_timeout_ms( void );
+
+#endif
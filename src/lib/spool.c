@@ -0,0 +1,680 @@
+/*------------------------------------------------------------------------
+ *
+ * spool.c
+ *     Append-only, memory mapped journal of work queue items. Items are
+ *     moved from tb_work_queue into the spool in bulk and delivered from
+ *     it, so that remote calls do not each cost a claim and an ack round
+ *     trip to the database. Records carry a crc32 so that a journal torn
+ *     by a crash is truncated to its last complete record on open.
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        spool.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "util.h"
+#include "spool.h"
+
+// Records start after the header, and are kept 8 byte aligned
+#define SPOOL_DATA_START ( ( uint64_t ) sizeof( struct spool_header ) )
+#define SPOOL_ALIGN( n ) ( ( ( n ) + 7 ) & ~( ( uint64_t ) 7 ) )
+
+static struct spool_header * _spool_header( struct spool * );
+static struct spool_record * _spool_record_at( struct spool *, uint64_t, bool );
+static uint64_t _spool_record_size( uint32_t );
+static bool _spool_reserve( struct spool *, uint64_t );
+static bool _spool_map( struct spool *, size_t );
+static void _spool_recover( struct spool * );
+static void _spool_advance_head( struct spool * );
+
+/*
+ * bool _spool_open( struct spool * spool, const char * path )
+ *     Opens, or creates, the spool file at path, locks it against other
+ *     processes and maps it into memory.
+ *     Records left by a previous run are kept for delivery, and any
+ *     incomplete record at the end of the journal is discarded.
+ *
+ * Arguments:
+ *     struct spool * spool: Spool to open.
+ *     const char * path:    Path of the spool file.
+ * Return:
+ *     bool:                 true on success.
+ * Error Conditions:
+ *     - Emits error on failure to open, size or map the file.
+ *     - Emits error when the file is not an event_manager spool.
+ *     - Emits error when another process holds the spool.
+ */
+bool _spool_open( struct spool * spool, const char * path )
+{
+    struct stat           file_stat = {0};
+    struct spool_header * header    = NULL;
+
+    spool->map = NULL;
+    spool->fd  = open( path, O_RDWR | O_CREAT, 0600 );
+
+    if( spool->fd < 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to open spool %s: %s",
+            path,
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    // Two daemons appending to one journal would corrupt it
+    if( flock( spool->fd, LOCK_EX | LOCK_NB ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Spool %s is in use by another process: %s",
+            path,
+            strerror( errno )
+        );
+
+        close( spool->fd );
+        return false;
+    }
+
+    if( fstat( spool->fd, &file_stat ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to stat spool %s: %s",
+            path,
+            strerror( errno )
+        );
+
+        close( spool->fd );
+        return false;
+    }
+
+    if(
+           !_spool_map(
+                spool,
+                file_stat.st_size < SPOOL_INITIAL_SIZE
+                    ? SPOOL_INITIAL_SIZE
+                    : ( size_t ) file_stat.st_size
+            )
+      )
+    {
+        close( spool->fd );
+        return false;
+    }
+
+    header = _spool_header( spool );
+
+    if( header->magic == 0 )
+    {
+        header->magic   = SPOOL_MAGIC;
+        header->version = SPOOL_VERSION;
+        header->head    = SPOOL_DATA_START;
+        header->tail    = SPOOL_DATA_START;
+    }
+    else if(
+                header->magic != SPOOL_MAGIC
+             || header->version != SPOOL_VERSION
+             || header->head < SPOOL_DATA_START
+             || header->head > header->tail
+             || header->tail > spool->size
+           )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "%s is not an event_manager spool, or is damaged",
+            path
+        );
+
+        _spool_close( spool );
+        return false;
+    }
+
+    _spool_recover( spool );
+
+    return true;
+}
+
+/*
+ * void _spool_close( struct spool * spool )
+ *     Flushes and unmaps the spool
+ *
+ * Arguments:
+ *     struct spool * spool: Spool to close.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _spool_close( struct spool * spool )
+{
+    if( spool->map == NULL )
+    {
+        return;
+    }
+
+    _spool_sync( spool );
+    munmap( spool->map, spool->size );
+    close( spool->fd );
+
+    spool->map  = NULL;
+    spool->size = 0;
+
+    return;
+}
+
+/*
+ * bool _spool_append( struct spool * spool, char ** values, int count )
+ *     Appends a pending record of count fields. The record is not durable
+ *     until the spool is synced.
+ *
+ * Arguments:
+ *     struct spool * spool: Spool to append to.
+ *     char ** values:       NUL terminated field values, NULL for SQL NULL.
+ *     int count:            Number of fields.
+ * Return:
+ *     bool:                 true on success.
+ * Error Conditions:
+ *     - Emits error on failure to grow the spool file.
+ */
+bool _spool_append( struct spool * spool, char ** values, int count )
+{
+    struct spool_header * header = NULL;
+    struct spool_record * record = NULL;
+    char *                out    = NULL;
+    uint32_t              length = 0;
+    uint32_t              field  = 0;
+    int                   i      = 0;
+
+    for( i = 0; i < count; i++ )
+    {
+        length += sizeof( uint32_t );
+
+        if( values[i] != NULL )
+        {
+            length += strlen( values[i] ) + 1;
+        }
+    }
+
+    if( !_spool_reserve( spool, _spool_record_size( length ) ) )
+    {
+        return false;
+    }
+
+    header = _spool_header( spool );
+    record = ( struct spool_record * ) ( spool->map + header->tail );
+    out    = ( char * ) ( record + 1 );
+
+    for( i = 0; i < count; i++ )
+    {
+        field = values[i] == NULL ? SPOOL_NULL_FIELD : ( uint32_t ) strlen( values[i] );
+        memcpy( out, &field, sizeof( uint32_t ) );
+        out += sizeof( uint32_t );
+
+        if( values[i] != NULL )
+        {
+            memcpy( out, values[i], field + 1 );
+            out += field + 1;
+        }
+    }
+
+    record->magic  = SPOOL_RECORD_MAGIC;
+    record->state  = SPOOL_PENDING;
+    record->length = length;
+    record->crc    = crc32( 0L, ( const Bytef * ) ( record + 1 ), length );
+
+    header->tail += _spool_record_size( length );
+
+    return true;
+}
+
+/*
+ * bool _spool_sync( struct spool * spool )
+ *     Flushes appended records and delivery acknowledgements to disk. Called
+ *     once per batch rather than once per record.
+ *
+ * Arguments:
+ *     struct spool * spool: Spool to flush.
+ * Return:
+ *     bool:                 true on success.
+ * Error Conditions:
+ *     - Emits error on failure to flush the mapping.
+ */
+bool _spool_sync( struct spool * spool )
+{
+    if( msync( spool->map, _spool_header( spool )->tail, MS_SYNC ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to sync spool: %s",
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * uint64_t _spool_mark( struct spool * spool )
+ *     Returns the end of the journal, to rewind to if a batch of appended
+ *     records must be abandoned.
+ *
+ * Arguments:
+ *     struct spool * spool: Spool to mark.
+ * Return:
+ *     uint64_t:             Current tail offset.
+ * Error Conditions:
+ *     None
+ */
+uint64_t _spool_mark( struct spool * spool )
+{
+    return _spool_header( spool )->tail;
+}
+
+/*
+ * void _spool_rewind( struct spool * spool, uint64_t mark )
+ *     Discards records appended after mark
+ *
+ * Arguments:
+ *     struct spool * spool: Spool to rewind.
+ *     uint64_t mark:        Offset returned by _spool_mark().
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _spool_rewind( struct spool * spool, uint64_t mark )
+{
+    struct spool_header * header = NULL;
+
+    header = _spool_header( spool );
+
+    if( mark >= header->head && mark <= header->tail )
+    {
+        header->tail = mark;
+    }
+
+    return;
+}
+
+/*
+ * uint64_t _spool_next(
+ *     struct spool * spool,
+ *     uint64_t * cursor,
+ *     char ** values,
+ *     int count
+ * )
+ *     Finds the next pending record at or after cursor, pointing values at
+ *     its fields inside the mapping. The pointers are valid until the next
+ *     append, which may move the mapping.
+ *
+ * Arguments:
+ *     struct spool * spool: Spool to read.
+ *     uint64_t * cursor:    Scan position, 0 to start at the head. Advanced
+ *                           past the returned record.
+ *     char ** values:       Receives count field values, NULL for SQL NULL.
+ *     int count:            Number of fields.
+ * Return:
+ *     uint64_t:             Offset of the record, for _spool_ack(), or 0
+ *                           when no pending record remains.
+ * Error Conditions:
+ *     None
+ */
+uint64_t _spool_next(
+    struct spool * spool,
+    uint64_t * cursor,
+    char ** values,
+    int count
+)
+{
+    struct spool_header * header = NULL;
+    struct spool_record * record = NULL;
+    char *                in     = NULL;
+    char *                end    = NULL;
+    uint64_t              offset = 0;
+    uint32_t              field  = 0;
+    int                   i      = 0;
+
+    header = _spool_header( spool );
+    offset = *cursor < header->head ? header->head : *cursor;
+
+    while( offset < header->tail )
+    {
+        record = _spool_record_at( spool, offset, false );
+
+        if( record == NULL )
+        {
+            break;
+        }
+
+        *cursor = offset + _spool_record_size( record->length );
+
+        if( record->state != SPOOL_PENDING )
+        {
+            offset = *cursor;
+            continue;
+        }
+
+        in  = ( char * ) ( record + 1 );
+        end = in + record->length;
+
+        for( i = 0; i < count; i++ )
+        {
+            values[i] = NULL;
+
+            if( in + sizeof( uint32_t ) > end )
+            {
+                continue;
+            }
+
+            memcpy( &field, in, sizeof( uint32_t ) );
+            in += sizeof( uint32_t );
+
+            if( field != SPOOL_NULL_FIELD )
+            {
+                values[i] = in;
+                in += field + 1;
+            }
+        }
+
+        return offset;
+    }
+
+    *cursor = header->tail;
+    return 0;
+}
+
+/*
+ * void _spool_ack( struct spool * spool, uint64_t offset )
+ *     Marks a record delivered. Once every record has been delivered the
+ *     journal is emptied, and reused from the start.
+ *
+ * Arguments:
+ *     struct spool * spool: Spool holding the record.
+ *     uint64_t offset:      Offset returned by _spool_next().
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _spool_ack( struct spool * spool, uint64_t offset )
+{
+    struct spool_record * record = NULL;
+
+    record = _spool_record_at( spool, offset, false );
+
+    if( record == NULL )
+    {
+        return;
+    }
+
+    record->state = SPOOL_DELIVERED;
+    _spool_advance_head( spool );
+
+    return;
+}
+
+/*
+ * bool _spool_empty( struct spool * spool )
+ *     Checks for records awaiting delivery
+ *
+ * Arguments:
+ *     struct spool * spool: Spool to check.
+ * Return:
+ *     bool:                 true when every record has been delivered.
+ * Error Conditions:
+ *     None
+ */
+bool _spool_empty( struct spool * spool )
+{
+    return _spool_header( spool )->head == _spool_header( spool )->tail;
+}
+
+/*
+ * Header at the start of the mapping
+ */
+static struct spool_header * _spool_header( struct spool * spool )
+{
+    return ( struct spool_header * ) spool->map;
+}
+
+/*
+ * Record at offset, or NULL if it runs past the tail or, when verify is
+ * set, its magic or crc32 do not match
+ */
+static struct spool_record * _spool_record_at(
+    struct spool * spool,
+    uint64_t offset,
+    bool verify
+)
+{
+    struct spool_header * header = NULL;
+    struct spool_record * record = NULL;
+
+    header = _spool_header( spool );
+
+    if( offset + sizeof( struct spool_record ) > header->tail )
+    {
+        return NULL;
+    }
+
+    record = ( struct spool_record * ) ( spool->map + offset );
+
+    if(
+           record->magic != SPOOL_RECORD_MAGIC
+        || offset + _spool_record_size( record->length ) > header->tail
+      )
+    {
+        return NULL;
+    }
+
+    if(
+           verify
+        && record->crc != crc32( 0L, ( const Bytef * ) ( record + 1 ), record->length )
+      )
+    {
+        return NULL;
+    }
+
+    return record;
+}
+
+/*
+ * Bytes taken by a record with a payload of length bytes
+ */
+static uint64_t _spool_record_size( uint32_t length )
+{
+    return SPOOL_ALIGN( sizeof( struct spool_record ) + ( uint64_t ) length );
+}
+
+/*
+ * Grows the file and mapping, doubling its size, until bytes more can be
+ * appended
+ */
+static bool _spool_reserve( struct spool * spool, uint64_t bytes )
+{
+    uint64_t needed = 0;
+    size_t   size   = 0;
+
+    needed = _spool_header( spool )->tail + bytes;
+    size   = spool->size;
+
+    if( needed <= size )
+    {
+        return true;
+    }
+
+    while( size < needed )
+    {
+        size = size * 2;
+    }
+
+    if( msync( spool->map, spool->size, MS_ASYNC ) != 0 || munmap( spool->map, spool->size ) != 0 )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to unmap spool: %s",
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    spool->map = NULL;
+
+    if( !_spool_map( spool, size ) )
+    {
+        // Keep the existing size mapped, so the spool remains usable
+        _spool_map( spool, spool->size );
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Sizes the file to at least size bytes and maps it
+ */
+static bool _spool_map( struct spool * spool, size_t size )
+{
+    struct stat file_stat = {0};
+    void *      map       = NULL;
+
+    if(
+           fstat( spool->fd, &file_stat ) != 0
+        || (
+                ( size_t ) file_stat.st_size < size
+             && ftruncate( spool->fd, ( off_t ) size ) != 0
+           )
+      )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to size spool to %zu bytes: %s",
+            size,
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, spool->fd, 0 );
+
+    if( map == MAP_FAILED )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to map spool: %s",
+            strerror( errno )
+        );
+
+        return false;
+    }
+
+    spool->map  = ( char * ) map;
+    spool->size = size;
+
+    return true;
+}
+
+/*
+ * Truncates the journal at its first incomplete record, as left by a crash
+ * mid-append, and reports records still awaiting delivery
+ */
+static void _spool_recover( struct spool * spool )
+{
+    struct spool_header * header  = NULL;
+    struct spool_record * record  = NULL;
+    uint64_t              offset  = 0;
+    int                   pending = 0;
+
+    header = _spool_header( spool );
+    offset = header->head;
+
+    while( offset < header->tail )
+    {
+        record = _spool_record_at( spool, offset, true );
+
+        if( record == NULL )
+        {
+            _log(
+                LOG_LEVEL_WARNING,
+                "Discarding %lu bytes of incomplete spool records",
+                ( unsigned long ) ( header->tail - offset )
+            );
+
+            header->tail = offset;
+            break;
+        }
+
+        if( record->state == SPOOL_PENDING )
+        {
+            pending++;
+        }
+
+        offset += _spool_record_size( record->length );
+    }
+
+    if( pending > 0 )
+    {
+        _log(
+            LOG_LEVEL_INFO,
+            "Recovered %d undelivered spool records",
+            pending
+        );
+    }
+
+    _spool_advance_head( spool );
+
+    return;
+}
+
+/*
+ * Moves the head past delivered records, emptying the journal when none
+ * remain pending
+ */
+static void _spool_advance_head( struct spool * spool )
+{
+    struct spool_header * header = NULL;
+    struct spool_record * record = NULL;
+
+    header = _spool_header( spool );
+
+    while( header->head < header->tail )
+    {
+        record = _spool_record_at( spool, header->head, false );
+
+        if( record == NULL || record->state != SPOOL_DELIVERED )
+        {
+            break;
+        }
+
+        header->head += _spool_record_size( record->length );
+    }
+
+    if( header->head == header->tail )
+    {
+        header->head = SPOOL_DATA_START;
+        header->tail = SPOOL_DATA_START;
+    }
+
+    return;
+}
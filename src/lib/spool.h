@@ -0,0 +1,61 @@
+/*------------------------------------------------------------------------
+ *
+ * spool.h
+ *     Prototypes for the memory mapped work queue spool
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        spool.h
+ *
+ *------------------------------------------------------------------------
+ */
+
+#ifndef SPOOL_H
+#define SPOOL_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPOOL_MAGIC 0x454D5350        // "EMSP"
+#define SPOOL_RECORD_MAGIC 0x454D5243 // "EMRC"
+#define SPOOL_VERSION 1
+#define SPOOL_INITIAL_SIZE ( 1024 * 1024 )
+
+#define SPOOL_PENDING 0
+#define SPOOL_DELIVERED 1
+
+// Marks a NULL field in a record
+#define SPOOL_NULL_FIELD UINT32_MAX
+
+struct spool_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t head;    // Offset of the first record not yet delivered
+    uint64_t tail;    // Offset at which the next record is appended
+};
+
+struct spool_record {
+    uint32_t magic;
+    uint32_t state;   // SPOOL_PENDING or SPOOL_DELIVERED
+    uint32_t length;  // Payload bytes following this header
+    uint32_t crc;     // crc32 of the payload
+};
+
+struct spool {
+    int    fd;
+    char * map;
+    size_t size;
+};
+
+bool _spool_open( struct spool *, const char * );
+void _spool_close( struct spool * );
+bool _spool_append( struct spool *, char **, int );
+bool _spool_sync( struct spool * );
+uint64_t _spool_mark( struct spool * );
+void _spool_rewind( struct spool *, uint64_t );
+uint64_t _spool_next( struct spool *, uint64_t *, char **, int );
+void _spool_ack( struct spool *, uint64_t );
+bool _spool_empty( struct spool * );
+
+#endif
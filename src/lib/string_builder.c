@@ -0,0 +1,305 @@
+/*------------------------------------------------------------------------
+ *
+ * string_builder.c
+ *     Growable string buffer with amortized constant time appends
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        string_builder.c
+ *
+ *------------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "string_builder.h"
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/*
+ * void _string_builder_init( struct string_builder * builder )
+ *     Initializes an empty builder. No memory is allocated until first use.
+ *
+ * Arguments:
+ *     struct string_builder * builder: Builder to initialize.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _string_builder_init( struct string_builder * builder )
+{
+    builder->data     = NULL;
+    builder->length   = 0;
+    builder->capacity = 0;
+
+    return;
+}
+
+/*
+ * void _string_builder_reset( struct string_builder * builder )
+ *     Empties the builder, keeping its buffer for reuse
+ *
+ * Arguments:
+ *     struct string_builder * builder: Builder to reset.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _string_builder_reset( struct string_builder * builder )
+{
+    builder->length = 0;
+
+    if( builder->data != NULL )
+    {
+        builder->data[0] = '\0';
+    }
+
+    return;
+}
+
+/*
+ * void _string_builder_free( struct string_builder * builder )
+ *     Releases the builder's buffer
+ *
+ * Arguments:
+ *     struct string_builder * builder: Builder to free.
+ * Return:
+ *     None
+ * Error Conditions:
+ *     None
+ */
+void _string_builder_free( struct string_builder * builder )
+{
+    free( builder->data );
+    _string_builder_init( builder );
+
+    return;
+}
+
+/*
+ * bool _string_builder_reserve( struct string_builder * builder, size_t additional )
+ *     Ensures there is room for additional bytes plus a NUL terminator,
+ *     doubling the capacity as needed.
+ *
+ * Arguments:
+ *     struct string_builder * builder: Builder to grow.
+ *     size_t additional:               Number of bytes about to be appended.
+ * Return:
+ *     bool:                            true on success. On failure the
+ *                                      builder's contents are unchanged.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+bool _string_builder_reserve( struct string_builder * builder, size_t additional )
+{
+    char * new_data     = NULL;
+    size_t new_capacity = 0;
+
+    if( builder->length + additional + 1 <= builder->capacity )
+    {
+        return true;
+    }
+
+    new_capacity = builder->capacity == 0 ? STRING_BUILDER_INITIAL_SIZE : builder->capacity;
+
+    while( new_capacity < builder->length + additional + 1 )
+    {
+        new_capacity = new_capacity * 2;
+    }
+
+    new_data = ( char * ) realloc( builder->data, new_capacity );
+
+    if( new_data == NULL )
+    {
+        _log(
+            LOG_LEVEL_ERROR,
+            "Failed to allocate memory for string buffer"
+        );
+
+        return false;
+    }
+
+    builder->data     = new_data;
+    builder->capacity = new_capacity;
+    builder->data[builder->length] = '\0';
+
+    return true;
+}
+
+/*
+ * bool _string_builder_append(
+ *     struct string_builder * builder,
+ *     const char * string,
+ *     size_t length
+ * )
+ *     Appends length bytes of a string
+ *
+ * Arguments:
+ *     struct string_builder * builder: Builder to append to.
+ *     const char * string:             String (need not be NUL terminated).
+ *     size_t length:                   Number of bytes to append.
+ * Return:
+ *     bool:                            true on success.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+bool _string_builder_append(
+    struct string_builder * builder,
+    const char * string,
+    size_t length
+)
+{
+    if( !_string_builder_reserve( builder, length ) )
+    {
+        return false;
+    }
+
+    memcpy( builder->data + builder->length, string, length );
+    builder->length = builder->length + length;
+    builder->data[builder->length] = '\0';
+
+    return true;
+}
+
+/*
+ * bool _string_builder_append_char( struct string_builder * builder, char c )
+ *     Appends a single character
+ *
+ * Arguments:
+ *     struct string_builder * builder: Builder to append to.
+ *     char c:                          Character to append.
+ * Return:
+ *     bool:                            true on success.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+bool _string_builder_append_char( struct string_builder * builder, char c )
+{
+    if( !_string_builder_reserve( builder, 1 ) )
+    {
+        return false;
+    }
+
+    builder->data[builder->length] = c;
+    builder->length++;
+    builder->data[builder->length] = '\0';
+
+    return true;
+}
+
+/*
+ * bool _string_builder_append_url_encoded(
+ *     struct string_builder * builder,
+ *     const char * string,
+ *     size_t length
+ * )
+ *     Appends a string percent-encoded directly into the buffer. As with
+ *     curl_easy_escape(), everything but RFC 3986 unreserved characters is
+ *     encoded.
+ *
+ * Arguments:
+ *     struct string_builder * builder: Builder to append to.
+ *     const char * string:             String (need not be NUL terminated).
+ *     size_t length:                   Number of bytes to encode.
+ * Return:
+ *     bool:                            true on success.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+bool _string_builder_append_url_encoded(
+    struct string_builder * builder,
+    const char * string,
+    size_t length
+)
+{
+    unsigned char c   = 0;
+    char *        out = NULL;
+    size_t        i   = 0;
+
+    // Worst case every byte becomes %XX
+    if( !_string_builder_reserve( builder, length * 3 ) )
+    {
+        return false;
+    }
+
+    out = builder->data + builder->length;
+
+    for( i = 0; i < length; i++ )
+    {
+        c = ( unsigned char ) string[i];
+
+        if(
+               ( c >= 'A' && c <= 'Z' )
+            || ( c >= 'a' && c <= 'z' )
+            || ( c >= '0' && c <= '9' )
+            || c == '-'
+            || c == '.'
+            || c == '_'
+            || c == '~'
+          )
+        {
+            *out++ = ( char ) c;
+        }
+        else
+        {
+            *out++ = '%';
+            *out++ = hex_digits[c >> 4];
+            *out++ = hex_digits[c & 0x0F];
+        }
+    }
+
+    builder->length = out - builder->data;
+    builder->data[builder->length] = '\0';
+
+    return true;
+}
+
+/*
+ * bool _string_builder_append_array_element(
+ *     struct string_builder * builder,
+ *     const char * string
+ * )
+ *     Appends a string as a double quoted element of a PostgreSQL array
+ *     literal, escaping quotes and backslashes
+ *
+ * Arguments:
+ *     struct string_builder * builder: Builder to append to.
+ *     const char * string:             NUL terminated element value.
+ * Return:
+ *     bool:                            true on success.
+ * Error Conditions:
+ *     - Emits error on failure to allocate memory.
+ */
+bool _string_builder_append_array_element(
+    struct string_builder * builder,
+    const char * string
+)
+{
+    const char * c = NULL;
+
+    if( !_string_builder_append_char( builder, '"' ) )
+    {
+        return false;
+    }
+
+    for( c = string; *c != '\0'; c++ )
+    {
+        if( ( *c == '"' || *c == '\\' ) && !_string_builder_append_char( builder, '\\' ) )
+        {
+            return false;
+        }
+
+        if( !_string_builder_append_char( builder, *c ) )
+        {
+            return false;
+        }
+    }
+
+    return _string_builder_append_char( builder, '"' );
+}
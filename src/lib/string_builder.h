@@ -0,0 +1,36 @@
+/*------------------------------------------------------------------------
+ *
+ * string_builder.h
+ *     Prototypes for the growable string buffer
+ *
+ * Copyright (c) 2018, Nead Werx, Inc.
+ *
+ * IDENTIFICATION
+ *        string_builder.h
+ *
+ *------------------------------------------------------------------------
+ */
+
+#ifndef STRING_BUILDER_H
+#define STRING_BUILDER_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STRING_BUILDER_INITIAL_SIZE 1024
+
+struct string_builder {
+    char * data;     // Always NUL terminated once allocated
+    size_t length;
+    size_t capacity;
+};
+
+void _string_builder_init( struct string_builder * );
+void _string_builder_reset( struct string_builder * );
+void _string_builder_free( struct string_builder * );
+bool _string_builder_reserve( struct string_builder *, size_t );
+bool _string_builder_append( struct string_builder *, const char *, size_t );
+bool _string_builder_append_char( struct string_builder *, char );
+bool _string_builder_append_url_encoded( struct string_builder *, const char *, size_t );
+bool _string_builder_append_array_element( struct string_builder *, const char * );
+
+#endif
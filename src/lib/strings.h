@@ -44,6 +44,8 @@ static const char * get_event_queue_item = "\
       FROM " EXTENSION_NAME ".tb_event_queue eq \
 INNER JOIN " EXTENSION_NAME ".tb_event_table_work_item etwi \
         ON etwi.event_table_work_item = eq.event_table_work_item \
+     WHERE eq.next_attempt_at IS NULL \
+        OR eq.next_attempt_at <= clock_timestamp() \
   ORDER BY eq.recorded DESC \
      LIMIT 1 \
        FOR UPDATE OF eq SKIP LOCKED";
@@ -60,33 +62,73 @@ DELETE FROM " EXTENSION_NAME ".tb_event_queue eq \
         AND eq.session_values::TEXT IS NOT DISTINCT FROM $8::TEXT \
         AND eq.ctid = $9::TID";
 
+// Items are claimed, and locked, by fn_claim_work_queue_items, in claim order
 static const char * get_work_queue_item = "\
+      WITH claimed AS ( \
+               SELECT " EXTENSION_NAME ".fn_claim_work_queue_items( \
+                          $1::TEXT[], \
+                          $2::TEXT[], \
+                          $3::INTEGER[], \
+                          $4::TEXT[], \
+                          $5::INTEGER, \
+                          $6::BOOLEAN \
+                      ) AS items \
+           ) \
     SELECT wq.parameters, \
            a.static_parameters, \
-           regexp_replace( \
-                a.uri, \
-                '__BASE_URL__', \
-                COALESCE( \
-                    wq.session_values->>'" EXTENSION_NAME ".base_url', \
-                    current_setting( '" EXTENSION_NAME ".base_url', TRUE ), \
-                    'localhost' \
-                ) \
-           ) AS uri, \
+           u.uri, \
+           wq.host, \
            COALESCE( a.method, 'GET' ) AS method, \
            a.query, \
            a.use_ssl, \
+           a.body_format, \
+           a.body_compression, \
+           a.compress_min_size, \
+           COALESCE( \
+               a.connect_timeout_ms, \
+               NULLIF( current_setting( '" EXTENSION_NAME ".connect_timeout_ms', TRUE ), '' )::INTEGER, \
+               10000 \
+           ) AS connect_timeout_ms, \
+           COALESCE( \
+               a.timeout_ms, \
+               NULLIF( current_setting( '" EXTENSION_NAME ".timeout_ms', TRUE ), '' )::INTEGER, \
+               30000 \
+           ) AS timeout_ms, \
+           a.response_policy, \
+           a.response_limit, \
+           CASE WHEN a.idempotent THEN a.hedge_percentile END AS hedge_percentile, \
+           a.rate_limit_per_sec IS NOT NULL OR rh.host IS NOT NULL AS rate_limited, \
+           CASE WHEN a.body_format = 'json' OR a.uri ~ '^(unix|fifo|file)://' \
+                THEN COALESCE( wq.session_values, '{}'::JSONB ) \
+                  || COALESCE( a.static_parameters, '{}'::JSONB ) \
+                  || COALESCE( wq.parameters, '{}'::JSONB ) \
+                 END AS json_body, \
            wq.uid, \
            wq.recorded, \
            wq.transaction_label, \
            wq.action, \
            wq.session_values, \
+           wq.attempts, \
+           a.function::OID AS function, \
            wq.ctid \
       FROM " EXTENSION_NAME ".tb_work_queue wq \
 INNER JOIN " EXTENSION_NAME ".tb_action a \
         ON a.action = wq.action \
-  ORDER BY wq.recorded DESC  \
-     LIMIT 1 \
-       FOR UPDATE OF wq SKIP LOCKED";
+CROSS JOIN LATERAL ( \
+               SELECT regexp_replace( \
+                          a.uri, \
+                          '__BASE_URL__', \
+                          COALESCE( \
+                              wq.session_values->>'" EXTENSION_NAME ".base_url', \
+                              current_setting( '" EXTENSION_NAME ".base_url', TRUE ), \
+                              'localhost' \
+                          ) \
+                      ) AS uri \
+           ) u \
+ LEFT JOIN " EXTENSION_NAME ".tb_remote_host rh \
+        ON rh.host = wq.host \
+     WHERE wq.ctid = ANY( ( SELECT items FROM claimed ) ) \
+  ORDER BY array_position( ( SELECT items FROM claimed ), wq.ctid )";
 
 static const char * delete_work_queue_item = "\
 DELETE FROM " EXTENSION_NAME ".tb_work_queue \
@@ -120,6 +162,192 @@ INSERT INTO " EXTENSION_NAME ".tb_work_queue \
                 NULLIF( $7::TEXT, '' )::JSONB \
             )";
 
+static const char * take_rate_tokens = "\
+    SELECT action_wait_ms, \
+           host_wait_ms \
+      FROM " EXTENSION_NAME ".fn_take_rate_tokens( $1::INTEGER, $2::VARCHAR )";
+
+static const char * acquire_host_slot = "\
+    SELECT slot \
+      FROM generate_series( 0, $2::INTEGER - 1 ) slot \
+     WHERE pg_try_advisory_lock( hashtext( '" EXTENSION_NAME ".' || $1::VARCHAR ), slot ) \
+     LIMIT 1";
+
+static const char * release_host_slot = "\
+    SELECT pg_advisory_unlock( hashtext( '" EXTENSION_NAME ".' || $1::VARCHAR ), $2::INTEGER )";
+
+static const char * schedule_retry = "\
+    SELECT " EXTENSION_NAME ".fn_schedule_retry( $1::VARCHAR, $2::TID, $3::TEXT, $4::VARCHAR ) AS retry_ms";
+
+static const char * next_event_retry = "\
+    SELECT CEIL( EXTRACT( EPOCH FROM MIN( next_attempt_at ) - clock_timestamp() ) * 1000 )::BIGINT AS retry_ms \
+      FROM " EXTENSION_NAME ".tb_event_queue \
+     WHERE next_attempt_at > clock_timestamp()";
+
+static const char * next_work_retry = "\
+    SELECT CEIL( EXTRACT( EPOCH FROM MIN( due ) - clock_timestamp() ) * 1000 )::BIGINT AS retry_ms \
+      FROM ( \
+               SELECT GREATEST( next_attempt_at, leased_until ) AS due \
+                 FROM " EXTENSION_NAME ".tb_work_queue \
+           ) wq \
+     WHERE due > clock_timestamp()";
+
+static const char * delete_spooled_items = "\
+    DELETE FROM " EXTENSION_NAME ".tb_work_queue \
+          WHERE ctid = ANY( $1::TID[] )";
+
+static const char * requeue_spooled_item = "\
+    INSERT INTO " EXTENSION_NAME ".tb_work_queue \
+                ( \
+                    parameters, \
+                    uid, \
+                    recorded, \
+                    transaction_label, \
+                    action, \
+                    session_values, \
+                    attempts, \
+                    execute_asynchronously \
+                ) \
+         VALUES \
+                ( \
+                    $1::JSONB, \
+                    $2::INTEGER, \
+                    $3::TIMESTAMP, \
+                    $4::VARCHAR, \
+                    $5::INTEGER, \
+                    $6::JSONB, \
+                    $7::INTEGER, \
+                    TRUE \
+                ) \
+      RETURNING ctid";
+
+static const char * lease_work_queue_item = "\
+    UPDATE " EXTENSION_NAME ".tb_work_queue \
+       SET leased_until = clock_timestamp() \
+                        + ( \
+                              $2::INTEGER \
+                            + COALESCE( \
+                                  NULLIF( current_setting( '" EXTENSION_NAME ".lease_grace_ms', TRUE ), '' )::INTEGER, \
+                                  30000 \
+                              ) \
+                          ) * INTERVAL '1 millisecond', \
+           leased_by = $3::VARCHAR \
+     WHERE ctid = $1::TID \
+ RETURNING ctid";
+
+// One row per input argument of a function action, in call order, each
+// carrying the statement that calls the function with them as $1 .. $n
+static const char * get_function_arguments = "\
+      WITH args AS ( \
+                       SELECT row_number() OVER ( ORDER BY a.ordinal ) AS position, \
+                              a.arg_name, \
+                              a.arg_type, \
+                              a.arg_mode \
+                         FROM pg_catalog.pg_proc p \
+                   CROSS JOIN LATERAL unnest( \
+                                  COALESCE( p.proallargtypes, p.proargtypes::OID[] ), \
+                                  COALESCE( p.proargmodes, array_fill( 'i'::\"char\", ARRAY[ p.pronargs::INTEGER ] ) ), \
+                                  p.proargnames \
+                              ) WITH ORDINALITY AS a( arg_type, arg_mode, arg_name, ordinal ) \
+                        WHERE p.oid = $1::OID \
+                          AND a.arg_mode IN( 'i', 'b', 'v' ) \
+                   ) \
+    SELECT format( \
+               'SELECT %I.%I( %s )', \
+               n.nspname, \
+               p.proname, \
+               COALESCE( \
+                   ( \
+                       SELECT string_agg( \
+                                  CASE WHEN x.arg_mode = 'v' THEN 'VARIADIC ' ELSE '' END || '$' || x.position, \
+                                  ', ' \
+                                  ORDER BY x.position \
+                              ) \
+                         FROM args x \
+                   ), \
+                   '' \
+               ) \
+           ) AS call, \
+           args.arg_name, \
+           args.arg_type \
+      FROM pg_catalog.pg_proc p \
+INNER JOIN pg_catalog.pg_namespace n \
+        ON n.oid = p.pronamespace \
+ LEFT JOIN args \
+        ON TRUE \
+     WHERE p.oid = $1::OID \
+  ORDER BY args.position";
+
+static const char * curl_settings_query = "\
+    SELECT COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".dns_cache_timeout', TRUE ), '' ), \
+               '60' \
+           )::INTEGER AS dns_cache_timeout, \
+           CASE WHEN lower( COALESCE( current_setting( '" EXTENSION_NAME ".ssl_session_reuse', TRUE ), 't' ) ) LIKE '%t%' \
+                THEN 't' \
+                ELSE 'f' \
+                 END AS ssl_session_reuse, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".low_speed_limit', TRUE ), '' ), \
+               '1' \
+           )::INTEGER AS low_speed_limit, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".low_speed_time', TRUE ), '' ), \
+               '30' \
+           )::INTEGER AS low_speed_time, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".breaker_failure_rate', TRUE ), '' ), \
+               '0.5' \
+           )::FLOAT AS breaker_failure_rate, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".breaker_min_requests', TRUE ), '' ), \
+               '5' \
+           )::INTEGER AS breaker_min_requests, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".breaker_window_ms', TRUE ), '' ), \
+               '60000' \
+           )::INTEGER AS breaker_window_ms, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".breaker_open_ms', TRUE ), '' ), \
+               '30000' \
+           )::INTEGER AS breaker_open_ms, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".breaker_slow_call_ms', TRUE ), '' ), \
+               '10000' \
+           )::INTEGER AS breaker_slow_call_ms, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".concurrency_max', TRUE ), '' ), \
+               '16' \
+           )::INTEGER AS concurrency_max, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".concurrency_latency_tolerance', TRUE ), '' ), \
+               '2.0' \
+           )::FLOAT AS concurrency_latency_tolerance, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".concurrency_backoff', TRUE ), '' ), \
+               '0.5' \
+           )::FLOAT AS concurrency_backoff, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".max_host_share', TRUE ), '' ), \
+               '0.5' \
+           )::FLOAT AS max_host_share, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".hedge_budget_percent', TRUE ), '' ), \
+               '5' \
+           )::FLOAT AS hedge_budget_percent, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".spool_batch_size', TRUE ), '' ), \
+               '100' \
+           )::INTEGER AS spool_batch_size, \
+           COALESCE( \
+               NULLIF( current_setting( '" EXTENSION_NAME ".sink_rotate_bytes', TRUE ), '' ), \
+               '104857600' \
+           )::BIGINT AS sink_rotate_bytes, \
+           CASE WHEN lower( COALESCE( current_setting( '" EXTENSION_NAME ".fail_on_http_error', TRUE ), 'f' ) ) LIKE '%t%' \
+                THEN 't' \
+                ELSE 'f' \
+                 END AS fail_on_http_error";
+
 static const char * _uid_function = "\
     SELECT current_setting( \
                '" EXTENSION_NAME ".' || $1::VARCHAR, \
@@ -24,7 +24,11 @@
 bool event_listener = false;
 bool work_listener  = false;
 
-char * conninfo = NULL;
+char * conninfo   = NULL;
+char * spool_path = NULL;
+
+// First error since the last clear, recorded against queue items that fail
+static char recorded_error[LAST_ERROR_SIZE] = {0};
 
 static const char * usage_string = "\
 Usage: event_manager\n \
@@ -33,6 +37,7 @@ Usage: event_manager\n \
     -h DB Host (default: localhost)\n \
     -d DB name (default: DB User)\n \
     -E | -W Start Event or Work Queue Processor, respectively\n \
+  [ -S Spool file, delivers work queue remote calls from a local journal (-W only) ]\n \
   [ -D debug mode\n \
     -v VERSION\n \
     -? HELP ]\n";
@@ -47,7 +52,7 @@ void _parse_args( int argc, char ** argv )
 
     opterr = 0;
 
-    while( ( c = getopt( argc, argv, "U:p:d:h:v?EW" ) ) != -1 )
+    while( ( c = getopt( argc, argv, "U:p:d:h:S:v?EW" ) ) != -1 )
     {
         switch( c )
         {
@@ -74,6 +79,9 @@ void _parse_args( int argc, char ** argv )
             case 'W':
                 work_listener = true;
                 break;
+            case 'S':
+                spool_path = optarg;
+                break;
             default:
                 _usage( "Invalid argument." );
         }
@@ -89,6 +97,11 @@ void _parse_args( int argc, char ** argv )
         _usage( "Need to instruct program to listen to events (-E) or work (-W)" );
     }
 
+    if( spool_path != NULL && work_listener == false )
+    {
+        _usage( "A spool file (-S) is only used by the work queue processor (-W)" );
+    }
+
     if( port == NULL )
         port = "5432";
 
@@ -145,6 +158,7 @@ void _usage( char * message )
 void _log( char * log_level, char * message, ... )
 {
     va_list args = {{0}};
+    va_list error_args;
     FILE *  output_handle = NULL;
 
     if( message == NULL )
@@ -154,6 +168,19 @@ void _log( char * log_level, char * message, ... )
 
     va_start( args, message );
 
+    // Later errors tend to restate the first one with less detail
+    if(
+        recorded_error[0] == '\0' && (
+            strcmp( log_level, LOG_LEVEL_ERROR ) == 0 ||
+            strcmp( log_level, LOG_LEVEL_FATAL ) == 0
+        )
+      )
+    {
+        va_copy( error_args, args );
+        vsnprintf( recorded_error, LAST_ERROR_SIZE, message, error_args );
+        va_end( error_args );
+    }
+
     if(
         strcmp( log_level, LOG_LEVEL_WARNING ) == 0 ||
         strcmp( log_level, LOG_LEVEL_ERROR ) == 0 ||
@@ -203,3 +230,35 @@ void _log( char * log_level, char * message, ... )
 
     return;
 }
+
+/*
+ * const char * _recorded_error( void )
+ *     Returns the first ERROR logged since _clear_recorded_error(), which
+ *     is usually the root cause of a failure
+ *
+ * Arguments:
+ *     None
+ * Return:
+ *     const char *: Error message, NULL if none was logged.
+ * Error Conditions:
+ *     None
+ */
+const char * _recorded_error( void )
+{
+    if( recorded_error[0] == '\0' )
+    {
+        return NULL;
+    }
+
+    return recorded_error;
+}
+
+/*
+ * void _clear_recorded_error( void )
+ *     Forgets the recorded error, before handling a new queue item
+ */
+void _clear_recorded_error( void )
+{
+    recorded_error[0] = '\0';
+    return;
+}
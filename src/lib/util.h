@@ -20,13 +20,18 @@
 #define LOG_LEVEL_DEBUG "DEBUG"
 #define LOG_LEVEL_INFO "INFO"
 
+#define LAST_ERROR_SIZE 1024
+
 bool event_listener;
 bool work_listener;
 
 char * conninfo;
+char * spool_path;
 
 void _parse_args( int, char ** );
 void _usage( char * ) __attribute__ ((noreturn));
 void _log( char *, char *, ... ) __attribute__ ((format (gnu_printf, 2, 3)));
+const char * _recorded_error( void );
+void _clear_recorded_error( void );
 
 #endif
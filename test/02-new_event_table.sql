@@ -12,6 +12,17 @@ INSERT INTO event_manager.tb_event_table
 DO
  $_$
 BEGIN
+    PERFORM *
+       FROM event_manager.tb_event_table
+      WHERE table_name = 'tb_a'
+        AND schema_name = 'eventmanagertest';
+
+    IF NOT FOUND THEN
+        RAISE EXCEPTION 'FAILED: new event table';
+        RETURN;
+    END IF;
+
+    -- Triggers are only generated once a work item subscribes to the table
     PERFORM *
        FROM pg_trigger t
  INNER JOIN pg_class c
@@ -21,10 +32,10 @@ BEGIN
  INNER JOIN pg_namespace n
          ON n.oid = c.relnamespace
         AND n.nspname::VARCHAR = 'eventmanagertest'
-      WHERE t.tgname::VARCHAR = 'tr_event_enqueue';
+      WHERE t.tgname::VARCHAR LIKE 'tr\_event\_enqueue%';
 
-    IF NOT FOUND THEN
-        RAISE EXCEPTION 'FAILED: new event table';
+    IF FOUND THEN
+        RAISE EXCEPTION 'FAILED: new event table (trigger created without work items)';
         RETURN;
     END IF;
 
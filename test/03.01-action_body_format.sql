@@ -0,0 +1,103 @@
+DO
+ $_$
+DECLARE
+    my_action   INTEGER;
+BEGIN
+    INSERT INTO event_manager.tb_action
+                (
+                    uri,
+                    method,
+                    body_format
+                )
+         VALUES
+                (
+                    'https://ises.chris.neadwerx.com/api/current/locations',
+                    'POST',
+                    'json'
+                )
+      RETURNING action
+           INTO my_action;
+
+    BEGIN
+        UPDATE event_manager.tb_action
+           SET method = 'GET'
+         WHERE action = my_action;
+
+        RAISE EXCEPTION 'FAILED: json body_format allowed for GET';
+        RETURN;
+    EXCEPTION
+        WHEN check_violation THEN
+            NULL;
+    END;
+
+    BEGIN
+        UPDATE event_manager.tb_action
+           SET method = NULL
+         WHERE action = my_action;
+
+        RAISE EXCEPTION 'FAILED: json body_format allowed without a method';
+        RETURN;
+    EXCEPTION
+        WHEN check_violation THEN
+            NULL;
+    END;
+
+    UPDATE event_manager.tb_action
+       SET body_compression = 'gzip'
+     WHERE action = my_action;
+
+    BEGIN
+        UPDATE event_manager.tb_action
+           SET method = 'GET',
+               body_format = 'form'
+         WHERE action = my_action;
+
+        RAISE EXCEPTION 'FAILED: body_compression allowed for GET';
+        RETURN;
+    EXCEPTION
+        WHEN check_violation THEN
+            NULL;
+    END;
+
+    BEGIN
+        UPDATE event_manager.tb_action
+           SET method = NULL,
+               body_format = 'form'
+         WHERE action = my_action;
+
+        RAISE EXCEPTION 'FAILED: body_compression allowed without a method';
+        RETURN;
+    EXCEPTION
+        WHEN check_violation THEN
+            NULL;
+    END;
+
+    BEGIN
+        UPDATE event_manager.tb_action
+           SET response_policy = 'keep'
+         WHERE action = my_action;
+
+        RAISE EXCEPTION 'FAILED: invalid response_policy allowed';
+        RETURN;
+    EXCEPTION
+        WHEN check_violation THEN
+            NULL;
+    END;
+
+    DELETE FROM event_manager.tb_action
+          WHERE action = my_action;
+
+    IF EXISTS(
+                SELECT 1
+                  FROM event_manager.tb_action
+                 WHERE body_format IS DISTINCT FROM 'form'
+             ) THEN
+        RAISE EXCEPTION 'FAILED: body_format defaults to form';
+        RETURN;
+    END IF;
+
+    RAISE NOTICE 'PASSED: action body_format, body_compression and response_policy';
+    RETURN;
+END
+ $_$
+    LANGUAGE 'plpgsql';
@@ -0,0 +1,100 @@
+DO
+ $_$
+DECLARE
+    my_action       INTEGER;
+    my_wait         RECORD;
+BEGIN
+    INSERT INTO event_manager.tb_action
+                (
+                    uri,
+                    method,
+                    rate_limit_per_sec,
+                    burst
+                )
+         VALUES
+                (
+                    'https://ises.chris.neadwerx.com/api/current/locations',
+                    'GET',
+                    0.1,
+                    2
+                )
+      RETURNING action
+           INTO my_action;
+
+    INSERT INTO event_manager.tb_remote_host
+                (
+                    host,
+                    rate_limit_per_sec,
+                    burst
+                )
+         VALUES
+                (
+                    'ises.chris.neadwerx.com',
+                    1,
+                    10
+                );
+
+    -- Burst of 2 is granted, the third call waits for the action bucket to refill
+    FOR i IN 1..2 LOOP
+        SELECT *
+          INTO my_wait
+          FROM event_manager.fn_take_rate_tokens( my_action, 'ises.chris.neadwerx.com' );
+
+        IF( my_wait.action_wait_ms <> 0 OR my_wait.host_wait_ms <> 0 ) THEN
+            RAISE EXCEPTION 'FAILED: call % within burst was throttled', i;
+            RETURN;
+        END IF;
+    END LOOP;
+
+    SELECT *
+      INTO my_wait
+      FROM event_manager.fn_take_rate_tokens( my_action, 'ises.chris.neadwerx.com' );
+
+    IF( my_wait.action_wait_ms <= 0 ) THEN
+        RAISE EXCEPTION 'FAILED: call beyond burst was not throttled';
+        RETURN;
+    END IF;
+
+    IF( my_wait.host_wait_ms <> 0 ) THEN
+        RAISE EXCEPTION 'FAILED: host bucket reported a wait with tokens available';
+        RETURN;
+    END IF;
+
+    -- The throttled call must not have used up a host token
+    IF(
+        (
+            SELECT tokens
+              FROM event_manager.tb_rate_bucket
+             WHERE bucket = 'host:ises.chris.neadwerx.com'
+        ) < 1
+      ) THEN
+        RAISE EXCEPTION 'FAILED: throttled call debited the host bucket';
+        RETURN;
+    END IF;
+
+    BEGIN
+        UPDATE event_manager.tb_action
+           SET burst = 0
+         WHERE action = my_action;
+
+        RAISE EXCEPTION 'FAILED: zero burst allowed';
+        RETURN;
+    EXCEPTION
+        WHEN check_violation THEN
+            NULL;
+    END;
+
+    DELETE FROM event_manager.tb_rate_bucket
+          WHERE bucket IN( 'action:' || my_action, 'host:ises.chris.neadwerx.com' );
+
+    DELETE FROM event_manager.tb_remote_host
+          WHERE host = 'ises.chris.neadwerx.com';
+
+    DELETE FROM event_manager.tb_action
+          WHERE action = my_action;
+
+    RAISE NOTICE 'PASSED: action and host rate limits';
+    RETURN;
+END
+ $_$
+    LANGUAGE 'plpgsql';
@@ -0,0 +1,37 @@
+DO
+ $_$
+DECLARE
+    my_action       INTEGER;
+BEGIN
+    INSERT INTO event_manager.tb_action
+                (
+                    uri
+                )
+         VALUES
+                (
+                    'file:///tmp/event_manager_test.ndjson'
+                )
+      RETURNING action
+           INTO my_action;
+
+    BEGIN
+        UPDATE event_manager.tb_action
+           SET method = 'POST',
+               body_compression = 'gzip'
+         WHERE action = my_action;
+
+        RAISE EXCEPTION 'FAILED: compression allowed for a local sink';
+        RETURN;
+    EXCEPTION
+        WHEN check_violation THEN
+            NULL;
+    END;
+
+    DELETE FROM event_manager.tb_action
+          WHERE action = my_action;
+
+    RAISE NOTICE 'PASSED: local sink actions';
+    RETURN;
+END
+ $_$
+    LANGUAGE 'plpgsql';
@@ -0,0 +1,36 @@
+DO
+ $_$
+DECLARE
+    my_action       INTEGER;
+BEGIN
+    INSERT INTO event_manager.tb_action
+                (
+                    function
+                )
+         VALUES
+                (
+                    'event_manager.fn_dummy_when_function(integer, integer, char, jsonb, jsonb)'
+                )
+      RETURNING action
+           INTO my_action;
+
+    BEGIN
+        UPDATE event_manager.tb_action
+           SET query = 'SELECT 1'
+         WHERE action = my_action;
+
+        RAISE EXCEPTION 'FAILED: function action allowed a query';
+        RETURN;
+    EXCEPTION
+        WHEN check_violation THEN
+            NULL;
+    END;
+
+    DELETE FROM event_manager.tb_action
+          WHERE action = my_action;
+
+    RAISE NOTICE 'PASSED: function actions';
+    RETURN;
+END
+ $_$
+    LANGUAGE 'plpgsql';
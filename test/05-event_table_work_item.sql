@@ -24,6 +24,23 @@ BEGIN
         RETURN;
     END IF;
 
+    PERFORM COUNT(*)
+       FROM pg_trigger t
+ INNER JOIN pg_class c
+         ON c.oid = t.tgrelid
+        AND c.relkind = 'r'
+        AND c.relname::VARCHAR = 'tb_a'
+ INNER JOIN pg_namespace n
+         ON n.oid = c.relnamespace
+        AND n.nspname::VARCHAR = 'eventmanagertest'
+      WHERE t.tgname::VARCHAR IN( 'tr_event_enqueue_insert', 'tr_event_enqueue_update', 'tr_event_enqueue_delete' )
+     HAVING COUNT(*) = 3;
+
+    IF NOT FOUND THEN
+        RAISE EXCEPTION 'FAILED: create event_table_work_item (event triggers not generated)';
+        RETURN;
+    END IF;
+
     RAISE NOTICE 'PASSED: create event_table_work_item';
     RETURN;
 END
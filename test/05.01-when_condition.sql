@@ -0,0 +1,107 @@
+ALTER TABLE event_manager.tb_event_queue DISABLE TRIGGER tr_handle_new_event_queue_item;
+
+INSERT INTO event_manager.tb_event_table_work_item
+            (
+                source_event_table,
+                source_column_name,
+                action,
+                work_item_query,
+                op,
+                when_condition
+            )
+     SELECT et.event_table,
+            'bar',
+            a.action,
+            'SELECT ''{}''::JSONB AS parameters',
+            ARRAY[ 'U' ]::CHAR(1)[],
+            'NEW.foo = ''when_condition_test'' AND NEW.bar IS DISTINCT FROM OLD.bar'
+       FROM event_manager.tb_event_table et
+ INNER JOIN event_manager.tb_action a
+         ON a.query IS NOT NULL
+      WHERE et.table_name = 'tb_a'
+        AND et.schema_name = 'eventmanagertest';
+
+UPDATE eventmanagertest.tb_a
+   SET foo = 'when_condition_test'
+ WHERE a = 2;
+
+UPDATE eventmanagertest.tb_a
+   SET bar = 'when_condition_test'
+ WHERE a IN( 2, 3 );
+
+DO
+ $_$
+DECLARE
+    my_count    INTEGER;
+BEGIN
+    BEGIN
+        INSERT INTO event_manager.tb_event_table_work_item
+                    (
+                        source_event_table,
+                        source_column_name,
+                        action,
+                        work_item_query,
+                        op,
+                        when_condition
+                    )
+             SELECT et.event_table,
+                    'foo',
+                    a.action,
+                    'SELECT ''{}''::JSONB AS parameters',
+                    ARRAY[ 'I' ]::CHAR(1)[],
+                    'OLD.foo IS NULL'
+               FROM event_manager.tb_event_table et
+         INNER JOIN event_manager.tb_action a
+                 ON a.query IS NOT NULL
+              WHERE et.table_name = 'tb_a'
+                AND et.schema_name = 'eventmanagertest';
+
+        RAISE EXCEPTION 'FAILED: when condition (OLD accepted for INSERT work item)';
+    EXCEPTION
+        WHEN raise_exception THEN
+            IF( SQLERRM LIKE 'FAILED:%' ) THEN
+                RAISE;
+            END IF;
+    END;
+
+    SELECT COUNT(*)
+      INTO my_count
+      FROM event_manager.tb_event_queue eq
+ INNER JOIN event_manager.tb_event_table_work_item etwi
+         ON etwi.event_table_work_item = eq.event_table_work_item
+        AND etwi.when_condition IS NOT NULL;
+
+    IF( my_count != 1 ) THEN
+        RAISE EXCEPTION 'FAILED: when condition (expected 1 filtered event, got %)', my_count;
+        RETURN;
+    END IF;
+
+    PERFORM *
+       FROM event_manager.tb_event_queue eq
+ INNER JOIN event_manager.tb_event_table_work_item etwi
+         ON etwi.event_table_work_item = eq.event_table_work_item
+        AND etwi.when_condition IS NOT NULL
+      WHERE eq.pk_value = 2;
+
+    IF NOT FOUND THEN
+        RAISE EXCEPTION 'FAILED: when condition (matching row was not enqueued)';
+        RETURN;
+    END IF;
+
+    RAISE NOTICE 'PASSED: when condition';
+    RETURN;
+END
+ $_$
+    LANGUAGE plpgsql;
+
+DELETE FROM event_manager.tb_event_queue;
+DELETE FROM event_manager.tb_event_table_work_item
+      WHERE when_condition IS NOT NULL;
+
+UPDATE eventmanagertest.tb_a
+   SET foo = md5( a::VARCHAR ),
+       bar = reverse( md5( a::VARCHAR ) )
+ WHERE a IN( 2, 3 );
+
+DELETE FROM event_manager.tb_event_queue;
+ALTER TABLE event_manager.tb_event_queue ENABLE TRIGGER tr_handle_new_event_queue_item;
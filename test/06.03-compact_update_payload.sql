@@ -0,0 +1,45 @@
+ALTER TABLE event_manager.tb_event_queue DISABLE TRIGGER tr_handle_new_event_queue_item;
+SET event_manager.compact_update_payload = 'TRUE';
+
+UPDATE eventmanagertest.tb_a
+   SET bar = 'compact_test'
+ WHERE a = 1;
+
+DO
+ $_$
+DECLARE
+    my_old  JSONB;
+    my_new  JSONB;
+BEGIN
+    SELECT eq.old,
+           eq.new
+      INTO my_old,
+           my_new
+      FROM event_manager.tb_event_queue eq
+     WHERE eq.pk_value = 1
+       AND eq.op = 'U';
+
+    IF NOT FOUND THEN
+        RAISE EXCEPTION 'FAILED: compact update payload (no event enqueued)';
+        RETURN;
+    END IF;
+
+    IF( my_old IS DISTINCT FROM jsonb_build_object( 'bar', reverse( md5( '1' ) ) ) ) THEN
+        RAISE EXCEPTION 'FAILED: compact update payload (old contains unchanged columns: %)', my_old;
+        RETURN;
+    END IF;
+
+    IF( my_new->>'foo' IS DISTINCT FROM md5( '1' ) OR my_new->>'bar' IS DISTINCT FROM 'compact_test' ) THEN
+        RAISE EXCEPTION 'FAILED: compact update payload (new is not a full row image)';
+        RETURN;
+    END IF;
+
+    RAISE NOTICE 'PASSED: compact update payload';
+    RETURN;
+END
+ $_$
+    LANGUAGE plpgsql;
+
+RESET event_manager.compact_update_payload;
+DELETE FROM event_manager.tb_event_queue;
+ALTER TABLE event_manager.tb_event_queue ENABLE TRIGGER tr_handle_new_event_queue_item;
@@ -0,0 +1,26 @@
+DO
+ $_$
+DECLARE
+    my_query    TEXT;
+BEGIN
+    my_query := event_manager.fn_bind_query(
+                    'SELECT ?a?, ?OLD.b?, ?NEW.b?, ?c?, ?missing?, ?OLD.missing?, params ? ''key'', ''what?''',
+                    ARRAY[
+                        '{"a":1}'::JSONB,
+                        '{"b":"it''s"}'::JSONB,
+                        '{"b":null,"a":2}'::JSONB,
+                        '{"c":{"d":true}}'::JSONB
+                    ],
+                    ARRAY[ NULL, 'OLD.', 'NEW.', NULL ]
+                );
+
+    IF( my_query IS DISTINCT FROM 'SELECT ''1'', ''it''''s'', NULL, ''{"d": true}'', NULL, NULL, params ? ''key'', ''what?''' ) THEN
+        RAISE EXCEPTION 'FAILED: bind query (got %)', my_query;
+        RETURN;
+    END IF;
+
+    RAISE NOTICE 'PASSED: bind query';
+    RETURN;
+END
+ $_$
+    LANGUAGE plpgsql;
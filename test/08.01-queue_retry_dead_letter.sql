@@ -0,0 +1,129 @@
+DO
+ $_$
+DECLARE
+    my_action       INTEGER;
+    my_ctid         TID;
+    my_retry_ms     INTEGER;
+    my_item         RECORD;
+BEGIN
+    PERFORM set_config( 'event_manager.retry_max_attempts', '3', TRUE );
+    PERFORM set_config( 'event_manager.retry_base_ms', '1000', TRUE );
+    PERFORM set_config( 'event_manager.retry_max_ms', '1500', TRUE );
+
+    INSERT INTO event_manager.tb_action
+                (
+                    query
+                )
+         VALUES
+                (
+                    'SELECT 1'
+                )
+      RETURNING action
+           INTO my_action;
+
+    INSERT INTO event_manager.tb_work_queue
+                (
+                    parameters,
+                    action,
+                    execute_asynchronously,
+                    leased_until,
+                    leased_by
+                )
+         VALUES
+                (
+                    '{}'::JSONB,
+                    my_action,
+                    TRUE,
+                    clock_timestamp() + INTERVAL '1 minute',
+                    'test:1'
+                )
+      RETURNING ctid
+           INTO my_ctid;
+
+    -- First failure waits between half and all of retry_base_ms
+    my_retry_ms := event_manager.fn_schedule_retry( 'work', my_ctid, 'first error' );
+
+    IF( my_retry_ms < 500 OR my_retry_ms > 1000 ) THEN
+        RAISE EXCEPTION 'FAILED: first retry delay % outside of backoff range', my_retry_ms;
+        RETURN;
+    END IF;
+
+    SELECT ctid,
+           attempts,
+           last_error,
+           next_attempt_at,
+           leased_until,
+           leased_by
+      INTO my_item
+      FROM event_manager.tb_work_queue
+     WHERE action = my_action;
+
+    IF( my_item.attempts <> 1 OR my_item.last_error <> 'first error' OR my_item.next_attempt_at <= clock_timestamp() ) THEN
+        RAISE EXCEPTION 'FAILED: failed attempt was not recorded on the queue item';
+        RETURN;
+    END IF;
+
+    IF( my_item.leased_until IS NOT NULL OR my_item.leased_by IS NOT NULL ) THEN
+        RAISE EXCEPTION 'FAILED: failed remote call kept its lease';
+        RETURN;
+    END IF;
+
+    -- Second failure is capped by retry_max_ms
+    my_retry_ms := event_manager.fn_schedule_retry( 'work', my_item.ctid, 'second error' );
+
+    IF( my_retry_ms < 750 OR my_retry_ms > 1500 ) THEN
+        RAISE EXCEPTION 'FAILED: second retry delay % outside of capped backoff range', my_retry_ms;
+        RETURN;
+    END IF;
+
+    SELECT ctid
+      INTO my_ctid
+      FROM event_manager.tb_work_queue
+     WHERE action = my_action;
+
+    -- Third failure exhausts the attempts
+    IF( event_manager.fn_schedule_retry( 'work', my_ctid, 'final error' ) <> -1 ) THEN
+        RAISE EXCEPTION 'FAILED: item was not dead lettered after retry_max_attempts';
+        RETURN;
+    END IF;
+
+    IF EXISTS( SELECT 1 FROM event_manager.tb_work_queue WHERE action = my_action ) THEN
+        RAISE EXCEPTION 'FAILED: dead lettered item remained in the work queue';
+        RETURN;
+    END IF;
+
+    SELECT dead_letter,
+           attempts,
+           last_error,
+           item
+      INTO my_item
+      FROM event_manager.tb_dead_letter
+     WHERE queue = 'work'
+       AND ( item->>'action' )::INTEGER = my_action;
+
+    IF( my_item.dead_letter IS NULL OR my_item.attempts <> 3 OR my_item.last_error <> 'final error' ) THEN
+        RAISE EXCEPTION 'FAILED: dead letter row does not describe the failed item';
+        RETURN;
+    END IF;
+
+    IF( my_item.item ? 'attempts' ) THEN
+        RAISE EXCEPTION 'FAILED: retry bookkeeping copied into the dead letter item';
+        RETURN;
+    END IF;
+
+    IF( event_manager.fn_schedule_retry( 'work', my_ctid, 'gone' ) IS NOT NULL ) THEN
+        RAISE EXCEPTION 'FAILED: retry of a removed item was scheduled';
+        RETURN;
+    END IF;
+
+    DELETE FROM event_manager.tb_dead_letter
+          WHERE dead_letter = my_item.dead_letter;
+
+    DELETE FROM event_manager.tb_action
+          WHERE action = my_action;
+
+    RAISE NOTICE 'PASSED: queue item retries and dead letter';
+    RETURN;
+END
+ $_$
+    LANGUAGE 'plpgsql';